@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace drlog::bench {
+
+    // log lines in the layouts the agent indexes: one timestamped record every few lines, some of
+    // them followed by stack trace continuation lines, with levels, logger names and trace ids
+    inline std::string generate_corpus(std::size_t size, uint64_t seed = 1) {
+        static const char* levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+        static const char* loggers[] = {"c.e.order.OrderService", "c.e.pay.PaymentGateway", "c.e.user.SessionFilter",
+                                         "o.a.kafka.clients.NetworkClient", "c.e.inventory.StockCache"};
+        static const char* messages[] = {"order processed", "payment authorized for account", "session refreshed",
+                                         "request completed in", "cache miss for sku", "retrying upstream call to"};
+        std::mt19937_64 rng(seed);
+        std::string out;
+        out.reserve(size + 512);
+        int64_t t = 1791417600;   // 2026-10-08 00:00:00
+        char line[512];
+        while (out.size() < size) {
+            t += rng() % 3;
+            std::time_t tt = static_cast<std::time_t>(t);
+            std::tm tm{};
+            gmtime_r(&tt, &tm);
+            int n = std::snprintf(line, sizeof(line),
+                "%04d-%02d-%02d %02d:%02d:%02d.%03u %-5s [worker-%u] %s - %s %u trace_id=%016llx cost=%ums\n",
+                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                static_cast<unsigned>(rng() % 1000), levels[rng() % 6], static_cast<unsigned>(rng() % 32),
+                loggers[rng() % 5], messages[rng() % 6], static_cast<unsigned>(rng() % 100000),
+                static_cast<unsigned long long>(rng()), static_cast<unsigned>(rng() % 2000));
+            out.append(line, static_cast<std::size_t>(n));
+            if (rng() % 50 == 0) {
+                for (unsigned i = 0, frames = 3 + rng() % 8; i < frames; ++i) {
+                    n = std::snprintf(line, sizeof(line), "\tat com.example.service.Handler%u.invoke(Handler%u.java:%u)\n",
+                        static_cast<unsigned>(rng() % 40), static_cast<unsigned>(rng() % 40), static_cast<unsigned>(rng() % 900));
+                    out.append(line, static_cast<std::size_t>(n));
+                }
+            }
+        }
+        return out;
+    }
+
+    // the file named by the first argument (a real log corpus), generated lines without one
+    inline std::string load_corpus(int argc, char** argv, std::size_t generated_size) {
+        if (argc < 2) return generate_corpus(generated_size);
+        std::ifstream in(argv[1], std::ios::binary);
+        if (!in) {
+            std::fprintf(stderr, "cannot read %s\n", argv[1]);
+            return {};
+        }
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // the lines of text without their '\n'
+    inline std::vector<std::string_view> split_lines(std::string_view text) {
+        std::vector<std::string_view> lines;
+        std::size_t pos = 0;
+        while (pos < text.size()) {
+            std::size_t nl = text.find('\n', pos);
+            if (nl == std::string_view::npos) nl = text.size();
+            lines.push_back(text.substr(pos, nl - pos));
+            pos = nl + 1;
+        }
+        return lines;
+    }
+
+    // best wall time of runs calls of fn, in seconds
+    template <typename Fn>
+    double best_of(int runs, Fn&& fn) {
+        double best = 1e300;
+        for (int i = 0; i < runs; ++i) {
+            auto t0 = std::chrono::steady_clock::now();
+            fn();
+            auto t1 = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+        }
+        return best;
+    }
+
+    // one result line: throughput over bytes, and the time per item when there are items
+    inline void report(const char* name, double seconds, std::size_t bytes, std::size_t items = 0, const char* item = "") {
+        std::printf("%-32s %9.3f ms %8.2f GB/s", name, seconds * 1e3, static_cast<double>(bytes) / seconds / 1e9);
+        if (items > 0) std::printf(" %9.1f ns/%s", seconds * 1e9 / static_cast<double>(items), item);
+        std::printf("\n");
+    }
+
+    // keeps the compiler from dropping a result nothing reads
+    template <typename T>
+    inline void keep(const T& value) {
+        asm volatile("" : : "r"(&value) : "memory");
+    }
+} // namespace drlog::bench
@@ -0,0 +1,119 @@
+// reaching an offset of a gzip file: inflating from byte 0 as searches did before inflate points,
+// against resuming at the last point before it. Also the cost of recording the points while indexing
+//   inflate_checkpoint_bench [log file or .gz file]
+#include "bench_util.hpp"
+#include "util/igzip.hpp"
+#include "util/gzip_index.hpp"
+#include <cstdlib>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+    constexpr uint64_t SPAN = 8 * 1024 * 1024;       // FileIndexer's default gzip_checkpoint_span
+    constexpr std::size_t SEARCHED = 1024 * 1024;    // read after the offset, as a searched block
+
+    bool write_gzip(const std::string& path, const std::string& text) {
+        gzFile out = gzopen(path.c_str(), "wb6");
+        if (!out) return false;
+        bool ok = true;
+        for (std::size_t pos = 0; ok && pos < text.size(); pos += 1 << 20) {
+            const unsigned n = static_cast<unsigned>(std::min<std::size_t>(1 << 20, text.size() - pos));
+            ok = gzwrite(out, text.data() + pos, n) == static_cast<int>(n);
+        }
+        return gzclose(out) == Z_OK && ok;
+    }
+
+    // inflate until offset, then return the SEARCHED bytes after it; the state is already open at out
+    bool read_from(drlog::igzip_state& igzs, uint64_t out, uint64_t offset, std::string& searched) {
+        std::vector<uint8_t> buffer(64 * 1024);
+        searched.clear();
+        while (searched.size() < SEARCHED) {
+            int n = drlog::igzip::igzread(&igzs, buffer);
+            if (n <= 0) return n == 0 && !searched.empty();
+            const uint64_t begin = out;
+            out += static_cast<uint64_t>(n);
+            if (out <= offset) continue;
+            const uint64_t from = std::max(begin, offset) - begin;
+            searched.append(reinterpret_cast<const char*>(buffer.data()) + from, static_cast<std::size_t>(out - begin - from));
+        }
+        searched.resize(SEARCHED);
+        return true;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace drlog;
+    std::string path;
+    std::string corpus;
+    const bool given_gz = argc > 1 && std::string_view(argv[1]).ends_with(".gz");
+    if (given_gz) {
+        path = argv[1];
+    } else {
+        corpus = bench::load_corpus(argc, argv, 256 * 1024 * 1024);
+        if (corpus.empty()) return 1;
+        char tmpl[] = "/tmp/inflate_checkpoint_bench_XXXXXX";
+        int fd = mkstemp(tmpl);
+        if (fd < 0) return 1;
+        close(fd);
+        path = tmpl;
+        if (!write_gzip(path, corpus)) {
+            std::fprintf(stderr, "cannot write %s\n", path.c_str());
+            return 1;
+        }
+    }
+
+    // the index pass: plain ISA-L inflate, and zlib stopping at block boundaries for the points
+    uint64_t total = 0;
+    double plain_time = bench::best_of(1, [&] {
+        igzip_state igzs;
+        if (igzip::igzopen(path.c_str(), "rb", &igzs) != 0) return;
+        std::vector<uint8_t> buffer(64 * 1024);
+        total = 0;
+        for (int n; (n = igzip::igzread(&igzs, buffer)) > 0; ) total += static_cast<uint64_t>(n);
+    });
+    std::vector<inflate_point> points;
+    double points_time = bench::best_of(1, [&] {
+        gzip_index_reader reader(SPAN);
+        if (reader.open(path.c_str()) != 0) return;
+        std::vector<uint8_t> buffer(64 * 1024);
+        while (reader.read(buffer) > 0) {}
+        points = std::move(reader.points());
+    });
+    std::size_t window_bytes = 0;
+    for (const auto& p : points) window_bytes += p.window.size();
+    std::printf("%s: %llu bytes uncompressed, %zu points every %llu MiB, %zu bytes of compressed windows\n", path.c_str(),
+        static_cast<unsigned long long>(total), points.size(), static_cast<unsigned long long>(SPAN >> 20), window_bytes);
+    bench::report("index: igzip inflate", plain_time, total);
+    bench::report("index: zlib inflate + points", points_time, total);
+    if (total <= SEARCHED) {
+        if (!given_gz) unlink(path.c_str());
+        return 1;
+    }
+
+    bool same = true;
+    for (double fraction : {0.1, 0.5, 0.9}) {
+        const uint64_t offset = static_cast<uint64_t>(static_cast<double>(total - SEARCHED) * fraction);
+        std::string from_start, from_point;
+        double start_time = bench::best_of(3, [&] {
+            igzip_state igzs;
+            if (igzip::igzopen(path.c_str(), "rb", &igzs) == 0) read_from(igzs, 0, offset, from_start);
+        });
+        double point_time = bench::best_of(3, [&] {
+            igzip_state igzs;
+            const inflate_point* point = gzip_index_reader::find_point(points, offset);
+            int ret = point ? igzip::igzopen_at(path.c_str(), *point, &igzs) : igzip::igzopen(path.c_str(), "rb", &igzs);
+            if (ret == 0) read_from(igzs, point ? point->out_offset : 0, offset, from_point);
+        });
+        same = same && from_start.size() == SEARCHED && from_start == from_point &&
+               (corpus.empty() || from_start == std::string_view(corpus).substr(offset, SEARCHED));
+        char name[64];
+        std::snprintf(name, sizeof(name), "%2.0f%%: from byte 0", fraction * 100);
+        bench::report(name, start_time, offset + SEARCHED);
+        std::snprintf(name, sizeof(name), "%2.0f%%: from inflate point", fraction * 100);
+        bench::report(name, point_time, offset + SEARCHED);
+    }
+    std::printf("GB/s are of the output up to the end of the searched MiB; %s\n",
+        same ? "both paths read the same bytes" : "PATHS READ DIFFERENT BYTES");
+    if (!given_gz) unlink(path.c_str());
+    return same ? 0 : 1;
+}
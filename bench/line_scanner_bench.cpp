@@ -0,0 +1,106 @@
+// line splitting throughput: the per-line readers the indexer and searcher used before
+// line_scanner (memchr per line, std::getline, a carry string cut with find and substr), and
+// line_scanner over whole windows and line_buffer over the chunks a stream reader returns
+//   line_scanner_bench [log file]
+#include "bench_util.hpp"
+#include "util/line_scanner.hpp"
+#include <sstream>
+
+namespace {
+    constexpr std::size_t CHUNK = 64 * 1024;          // a read or an inflate call
+    constexpr std::size_t WINDOW = 1024 * 1024;       // a mapped window
+
+    // the old get_lines_gzip: every line copied out of the carry, the rest copied back into it
+    void carry_lines(std::string& carry, std::vector<std::string>& lines) {
+        std::size_t pos = 0;
+        while (pos < carry.size()) {
+            std::size_t nl = carry.find('\n', pos);
+            if (nl == std::string::npos) break;
+            lines.emplace_back(carry.substr(pos, nl - pos));
+            pos = nl + 1;
+        }
+        if (pos > 0 && pos < carry.size()) carry = carry.substr(pos);
+        else if (pos >= carry.size()) std::string().swap(carry);
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace drlog;
+    const std::string corpus = bench::load_corpus(argc, argv, 256 * 1024 * 1024);
+    if (corpus.empty()) return 1;
+    const char* data = corpus.data();
+    const std::size_t size = corpus.size();
+    std::printf("%zu bytes, kernel %s\n", size, line_scanner::kernel_name());
+
+    std::size_t memchr_lines = 0;
+    double memchr_time = bench::best_of(3, [&] {
+        memchr_lines = 0;
+        const char* p = data;
+        const char* end = data + size;
+        while (p < end) {
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+            if (!nl) break;
+            ++memchr_lines;
+            p = nl + 1;
+        }
+    });
+
+    std::size_t getline_lines = 0;
+    double getline_time = bench::best_of(3, [&] {
+        getline_lines = 0;
+        std::istringstream in(corpus);
+        std::string line;
+        while (std::getline(in, line)) ++getline_lines;
+        // getline also returns the unterminated last line
+        if (size > 0 && corpus.back() != '\n') --getline_lines;
+    });
+
+    std::size_t carry_count = 0;
+    double carry_time = bench::best_of(3, [&] {
+        carry_count = 0;
+        std::string carry;
+        std::vector<std::string> lines;
+        for (std::size_t pos = 0; pos < size; pos += CHUNK) {
+            carry.append(data + pos, std::min(CHUNK, size - pos));
+            carry_lines(carry, lines);
+            carry_count += lines.size();
+            lines.clear();
+        }
+    });
+
+    std::size_t scanner_lines = 0;
+    double scanner_time = bench::best_of(3, [&] {
+        scanner_lines = 0;
+        std::vector<uint32_t> newlines;
+        for (std::size_t pos = 0; pos < size; pos += WINDOW) {
+            newlines.clear();
+            line_scanner::find_newlines(data + pos, std::min(WINDOW, size - pos), newlines);
+            scanner_lines += newlines.size();
+        }
+    });
+
+    std::size_t buffer_lines = 0;
+    double buffer_time = bench::best_of(3, [&] {
+        buffer_lines = 0;
+        line_buffer lines;
+        std::string_view line;
+        uint64_t offset = 0;
+        for (std::size_t pos = 0; pos < size; pos += CHUNK) {
+            lines.append(data + pos, std::min(CHUNK, size - pos));
+            while (lines.next(line, offset)) {
+                bench::keep(line);
+                ++buffer_lines;
+            }
+        }
+    });
+
+    bench::report("memchr per line", memchr_time, size, memchr_lines, "line");
+    bench::report("std::getline", getline_time, size, getline_lines, "line");
+    bench::report("carry find + substr", carry_time, size, carry_count, "line");
+    bench::report("line_scanner::find_newlines", scanner_time, size, scanner_lines, "line");
+    bench::report("line_buffer (64 KiB chunks)", buffer_time, size, buffer_lines, "line");
+    const bool same = memchr_lines == getline_lines && memchr_lines == carry_count &&
+                      memchr_lines == scanner_lines && memchr_lines == buffer_lines;
+    std::printf("%zu lines, %s\n", memchr_lines, same ? "all readers agree" : "READERS DISAGREE");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+// page cache footprint of reading a cold file once, as the indexer does for a rotated log: the
+// whole-file mapping the indexer used before read modes, and sequential_reader in each read mode.
+// The file's pages are dropped before every run and counted with mincore() after it
+//   page_cache_bench [log file]    without one a corpus is written to the current directory
+#include "bench_util.hpp"
+#include "util/line_scanner.hpp"
+#include "util/sequential_reader.hpp"
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    // drop the file from the page cache, as a log rotated days ago would be
+    bool evict(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        fdatasync(fd);
+        bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+        close(fd);
+        return ok;
+    }
+
+    // pages of the file in the page cache, -1 if it cannot be mapped
+    long resident_pages(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return -1;
+        struct stat st {};
+        fstat(fd, &st);
+        const std::size_t size = static_cast<std::size_t>(st.st_size);
+        void* map = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (map == MAP_FAILED) return -1;
+        const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        std::vector<unsigned char> pages((size + page - 1) / page);
+        long resident = -1;
+        if (mincore(map, size, pages.data()) == 0) {
+            resident = 0;
+            for (unsigned char p : pages) resident += p & 1;
+        }
+        munmap(map, size);
+        return resident;
+    }
+
+    // the old update_file_index_txt_mmap: the whole file mapped and cut with memchr
+    std::size_t count_mapped(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return 0;
+        struct stat st {};
+        fstat(fd, &st);
+        const std::size_t size = static_cast<std::size_t>(st.st_size);
+        void* map = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (map == MAP_FAILED) return 0;
+        std::size_t lines = 0;
+        const char* p = static_cast<const char*>(map);
+        const char* end = p + size;
+        while (p < end) {
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+            if (!nl) break;
+            ++lines;
+            p = nl + 1;
+        }
+        munmap(map, size);
+        return lines;
+    }
+
+    // the indexer's read loop over a sequential_reader, with its 4 MiB default window
+    std::size_t count_read(const std::string& path, drlog::file_read_mode mode) {
+        drlog::sequential_reader reader;
+        if (!reader.open(path, mode)) return 0;
+        std::size_t lines = 0;
+        std::vector<uint32_t> newlines;
+        for (ssize_t n; (n = reader.read()) > 0; ) {
+            newlines.clear();
+            drlog::line_scanner::find_newlines(reader.data(), static_cast<std::size_t>(n), newlines);
+            lines += newlines.size();
+        }
+        return lines;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace drlog;
+    std::string path;
+    const bool generated = argc < 2;
+    if (generated) {
+        // the current directory, /tmp may be a tmpfs whose pages never leave memory
+        char tmpl[] = "page_cache_bench_XXXXXX";
+        int fd = mkstemp(tmpl);
+        if (fd < 0) return 1;
+        const std::string corpus = bench::generate_corpus(512 * 1024 * 1024);
+        bool ok = write(fd, corpus.data(), corpus.size()) == static_cast<ssize_t>(corpus.size());
+        close(fd);
+        path = tmpl;
+        if (!ok) {
+            unlink(path.c_str());
+            return 1;
+        }
+    } else {
+        path = argv[1];
+    }
+    struct stat st {};
+    if (stat(path.c_str(), &st) != 0) return 1;
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+    const long total = static_cast<long>((size + sysconf(_SC_PAGESIZE) - 1) / sysconf(_SC_PAGESIZE));
+    std::printf("%s: %zu bytes, %ld pages\n", path.c_str(), size, total);
+    std::printf("%-28s %10s %10s %9s %8s %10s\n", "reader", "before", "after", "resident", "ms", "lines");
+
+    struct reader_case {
+        const char* name;
+        std::size_t (*run)(const std::string&);
+    };
+    const reader_case cases[] = {
+        {"whole-file mmap (old)", count_mapped},
+        {"sequential_reader mmap", [](const std::string& p) { return count_read(p, file_read_mode::mmap); }},
+        {"sequential_reader stream", [](const std::string& p) { return count_read(p, file_read_mode::stream); }},
+        {"sequential_reader direct", [](const std::string& p) { return count_read(p, file_read_mode::direct); }},
+    };
+    std::size_t expected = 0;
+    bool same = true;
+    for (const auto& c : cases) {
+        if (!evict(path)) {
+            std::fprintf(stderr, "cannot drop %s from the page cache\n", path.c_str());
+            break;
+        }
+        const long before = resident_pages(path);
+        std::size_t lines = 0;
+        double seconds = bench::best_of(1, [&] { lines = c.run(path); });
+        const long after = resident_pages(path);
+        if (expected == 0) expected = lines;
+        same = same && lines == expected;
+        std::printf("%-28s %10ld %10ld %8.1f%% %8.1f %10zu\n", c.name, before, after,
+            total ? 100.0 * static_cast<double>(after) / static_cast<double>(total) : 0.0, seconds * 1e3, lines);
+    }
+    std::printf("%s\n", same ? "all readers agree" : "READERS DISAGREE");
+    if (generated) unlink(path.c_str());
+    return same ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+// counting the lines that hold a literal: std::string::find and memmem per line, as simple_searcher
+// searched before substring_finder, against substring_finder per line and over the whole buffer
+// as filter_views runs it, with line_scanner mapping the hits back to their lines
+//   substring_finder_bench [log file]
+#include "bench_util.hpp"
+#include "util/line_scanner.hpp"
+#include "util/substring_finder.hpp"
+#include <algorithm>
+
+namespace {
+    struct needle_case {
+        const char* name;
+        std::string needle;
+    };
+
+    // lines holding the needle, searched one line at a time
+    template <typename Find>
+    std::size_t per_line(const std::vector<std::string_view>& lines, Find&& find) {
+        std::size_t matched = 0;
+        for (std::string_view line : lines) matched += find(line);
+        return matched;
+    }
+
+    // lines holding the needle, searched once over the buffer: a hit counts its line and the
+    // search goes on from the next line
+    std::size_t whole_buffer(std::string_view text, const std::vector<uint32_t>& newlines, const drlog::substring_finder& finder) {
+        std::size_t matched = 0;
+        std::size_t from = 0;
+        while (from < text.size()) {
+            std::size_t pos = finder.find(text.data() + from, text.size() - from);
+            if (pos == drlog::substring_finder::npos) break;
+            pos += from;
+            // the end of the line of the hit
+            auto it = std::lower_bound(newlines.begin(), newlines.end(), static_cast<uint32_t>(pos));
+            const std::size_t line_end = it == newlines.end() ? text.size() : *it;
+            if (pos + finder.needle().size() <= line_end) {
+                ++matched;
+                from = line_end + 1;
+            } else {
+                // across a line break
+                from = pos + 1;
+            }
+        }
+        return matched;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace drlog;
+    std::string corpus = bench::load_corpus(argc, argv, 256 * 1024 * 1024);
+    if (corpus.empty()) return 1;
+    // newline offsets are 32 bits, as in a scan window
+    if (corpus.size() > UINT32_MAX) corpus.resize(UINT32_MAX);
+    const std::vector<std::string_view> lines = bench::split_lines(corpus);
+    std::printf("%zu bytes, %zu lines, kernels %s / %s\n", corpus.size(), lines.size(),
+        substring_finder::kernel_name(), line_scanner::kernel_name());
+
+    // an id of one line late in the corpus, a string in none, and a frequent one
+    std::string_view late = lines[lines.size() * 7 / 10];
+    const std::size_t id = late.find("trace_id=");
+    std::string rare(id != std::string_view::npos ? late.substr(id + 9, 16) : late.substr(late.size() / 2, 16));
+    const needle_case needles[] = {
+        {"rare (one line)", rare},
+        {"absent", "trace_id=zz-not-there"},
+        {"frequent", "PaymentGateway"},
+    };
+
+    bool same = true;
+    for (const auto& c : needles) {
+        const std::string& needle = c.needle;
+        const substring_finder finder(needle);
+        std::printf("\n%s: \"%s\"\n", c.name, needle.c_str());
+        std::size_t n_find = 0, n_memmem = 0, n_finder = 0, n_whole = 0;
+        double t_find = bench::best_of(3, [&] {
+            n_find = per_line(lines, [&](std::string_view line) { return line.find(needle) != std::string_view::npos; });
+        });
+        double t_memmem = bench::best_of(3, [&] {
+            n_memmem = per_line(lines, [&](std::string_view line) {
+                return memmem(line.data(), line.size(), needle.data(), needle.size()) != nullptr;
+            });
+        });
+        double t_finder = bench::best_of(3, [&] {
+            n_finder = per_line(lines, [&](std::string_view line) { return finder.find(line) != substring_finder::npos; });
+        });
+        // the mapped file search finds the newlines anyway, the finder only adds its own pass
+        std::vector<uint32_t> newlines;
+        double t_newlines = bench::best_of(3, [&] {
+            newlines.clear();
+            line_scanner::find_newlines(corpus.data(), corpus.size(), newlines);
+        });
+        double t_whole = bench::best_of(3, [&] { n_whole = whole_buffer(corpus, newlines, finder); });
+        bench::report("std::string::find per line", t_find, corpus.size(), lines.size(), "line");
+        bench::report("memmem per line", t_memmem, corpus.size(), lines.size(), "line");
+        bench::report("substring_finder per line", t_finder, corpus.size(), lines.size(), "line");
+        bench::report("substring_finder whole buffer", t_whole, corpus.size(), lines.size(), "line");
+        bench::report("  + line_scanner newlines", t_whole + t_newlines, corpus.size(), lines.size(), "line");
+        std::printf("%zu lines matched\n", n_find);
+        same = same && n_find == n_memmem && n_find == n_finder && n_find == n_whole;
+    }
+    std::printf("\n%s\n", same ? "all searches agree" : "SEARCHES DISAGREE");
+    return same ? 0 : 1;
+}
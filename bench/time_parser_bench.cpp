@@ -0,0 +1,97 @@
+// timestamp parsing per line: the regex + date::parse path the indexer used before time_parser,
+// time_parser detecting the layout, and time_parser at the layout a file has pinned
+//   time_parser_bench [log file]
+#include "bench_util.hpp"
+#include "util/time_parser.hpp"
+#include "libs/date/date.h"
+#include <boost/regex.hpp>
+#include <sstream>
+
+namespace {
+    struct regex_format {
+        std::string format;
+        boost::regex regex_pattern;
+    };
+
+    // the path replaced by time_parser: the 50 byte prefix copied, up to five regex searches and
+    // an istringstream per line; returns civil seconds, the zone is left out on both sides
+    class regex_time_parser {
+    public:
+        regex_time_parser() {
+            formats_ = {
+                {"%Y-%m-%d %H:%M:%S", boost::regex(R"(\d{4}-\d{2}-\d{2} \d{2}:\d{2}:\d{2})")},
+                {"%Y/%m/%d %H:%M:%S", boost::regex(R"(\d{4}/\d{2}/\d{2} \d{2}:\d{2}:\d{2})")},
+                {"%Y-%m-%dT%H:%M:%S", boost::regex(R"(\d{4}-\d{2}-\d{2}T\d{2}:\d{2}:\d{2})")},
+                {"%d/%b/%Y:%H:%M:%S", boost::regex(R"(\d{2}/[A-Za-z]{3}/\d{4}:\d{2}:\d{2}:\d{2})")},
+                {"%b %d %H:%M:%S", boost::regex(R"([A-Za-z]{3} \d{2} \d{2}:\d{2}:\d{2})")}
+            };
+        }
+
+        int64_t parse(std::string_view line) const {
+            std::string prefix(line.substr(0, 50));
+            boost::smatch matches;
+            for (const auto& tf : formats_) {
+                if (boost::regex_search(prefix, matches, tf.regex_pattern) && matches.size() > 0) {
+                    std::istringstream ss(matches[0].str());
+                    std::chrono::system_clock::time_point tp;
+                    ss >> date::parse(tf.format, tp);
+                    if (!ss.fail()) {
+                        return std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
+                    }
+                }
+            }
+            return 0;
+        }
+
+    private:
+        std::vector<regex_format> formats_;
+    };
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace drlog;
+    const std::string corpus = bench::load_corpus(argc, argv, 16 * 1024 * 1024);
+    if (corpus.empty()) return 1;
+    const std::vector<std::string_view> lines = bench::split_lines(corpus);
+
+    // the layout of the first timestamped line is pinned, as the indexer does per file
+    time_match pinned;
+    for (std::string_view line : lines) {
+        if (time_parser::parse(line, pinned)) break;
+    }
+    std::printf("%zu lines, %zu bytes, pinned layout %s at column %u\n", lines.size(), corpus.size(),
+        pinned.format == TIME_FMT_NONE ? "none" : time_parser::format_string(pinned.format), pinned.offset);
+
+    regex_time_parser regex_parser;
+    std::vector<int64_t> expected(lines.size());
+    double regex_time = bench::best_of(1, [&] {
+        for (std::size_t i = 0; i < lines.size(); ++i) expected[i] = regex_parser.parse(lines[i]);
+    });
+
+    std::size_t detect_mismatches = 0;
+    double detect_time = bench::best_of(5, [&] {
+        detect_mismatches = 0;
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            time_match m;
+            int64_t seconds = time_parser::parse(lines[i], m) ? m.local_seconds : 0;
+            detect_mismatches += seconds != expected[i];
+        }
+    });
+
+    std::size_t pinned_mismatches = 0;
+    double pinned_time = bench::best_of(5, [&] {
+        pinned_mismatches = 0;
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            int64_t seconds = 0;
+            if (!time_parser::parse_at(lines[i], pinned.format, pinned.offset, seconds)) seconds = 0;
+            pinned_mismatches += seconds != expected[i];
+        }
+    });
+
+    bench::report("regex + date::parse", regex_time, corpus.size(), lines.size(), "line");
+    bench::report("time_parser::parse", detect_time, corpus.size(), lines.size(), "line");
+    bench::report("time_parser::parse_at (pinned)", pinned_time, corpus.size(), lines.size(), "line");
+    std::printf("speedup: %.1fx detecting, %.1fx pinned; lines parsed differently from the regex path: %zu detecting, %zu pinned\n",
+        regex_time / detect_time, regex_time / pinned_time, detect_mismatches, pinned_mismatches);
+    return 0;
+}
@@ -0,0 +1,129 @@
+// trigram index of a file that stopped changing: its build time and size, and for a few literals
+// the share of chunks it keeps and the time of scanning only those against scanning the whole file
+//   trigram_index_bench [log file]    without one a corpus is written to the current directory
+#include "bench_util.hpp"
+#include "trigram_index.hpp"
+#include "util/time_parser.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    // occurrences of the literal in data[begin, end)
+    std::size_t count_in(const char* data, uint64_t begin, uint64_t end, const std::string& needle) {
+        std::size_t hits = 0;
+        while (begin < end) {
+            const void* hit = memmem(data + begin, static_cast<std::size_t>(end - begin), needle.data(), needle.size());
+            if (hit == nullptr) break;
+            ++hits;
+            begin = static_cast<uint64_t>(static_cast<const char*>(hit) - data) + 1;
+        }
+        return hits;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace drlog;
+    std::string path;
+    const bool generated = argc < 2;
+    if (generated) {
+        char tmpl[] = "trigram_index_bench_XXXXXX";
+        int fd = mkstemp(tmpl);
+        if (fd < 0) return 1;
+        const std::string corpus = bench::generate_corpus(256 * 1024 * 1024);
+        bool ok = write(fd, corpus.data(), corpus.size()) == static_cast<ssize_t>(corpus.size());
+        close(fd);
+        path = tmpl;
+        if (!ok) {
+            unlink(path.c_str());
+            return 1;
+        }
+    } else {
+        path = argv[1];
+    }
+    const std::string index_path = path + ".trigram_bench";
+    auto cleanup = [&] {
+        unlink(index_path.c_str());
+        if (generated) unlink(path.c_str());
+    };
+
+    FileInfo info;
+    info.fullpath = path;
+    info.file_type = "text";
+    info.file_index = std::make_shared<FileIndex>();
+    info.file_index->index_etag = "bench";
+    // records start at lines with a built-in timestamp layout
+    TrigramIndex::record_start_fn record_start = [](std::string_view line) {
+        time_match m;
+        return time_parser::parse(line, m);
+    };
+    uint64_t index_size = 0;
+    bool built = false;
+    double build_time = bench::best_of(1, [&] {
+        built = TrigramIndex::build(info, index_path, record_start, UINT64_MAX, index_size);
+    });
+    TrigramIndex index;
+    if (!built || !index.open(index_path, "bench")) {
+        std::fprintf(stderr, "cannot build the trigram index of %s\n", path.c_str());
+        cleanup();
+        return 1;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st {};
+    fstat(fd, &st);
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        cleanup();
+        return 1;
+    }
+    const char* data = static_cast<const char*>(map);
+    std::printf("%s: %zu bytes, %zu chunks, index %llu bytes (%.2f%% of the file)\n", path.c_str(), size, index.chunk_count(),
+        static_cast<unsigned long long>(index_size), 100.0 * static_cast<double>(index_size) / static_cast<double>(size));
+    bench::report("build", build_time, size);
+
+    // an id of one record late in the file, a string in none, and a frequent one
+    std::string rare = "trace_id=";
+    const char* late = static_cast<const char*>(memmem(data + size * 7 / 10, size - size * 7 / 10, rare.data(), rare.size()));
+    rare = late && late + 25 <= data + size ? std::string(late + 9, 16) : std::string("2d64c3701bebb55c");
+    const std::pair<const char*, std::string> needles[] = {
+        {"rare (one line)", rare},
+        {"absent", "trace_id=zz-not-there"},
+        {"frequent", "PaymentGateway"},
+    };
+    bool same = true;
+    for (const auto& [name, needle] : needles) {
+        std::size_t full_hits = 0, pruned_hits = 0, kept = 0;
+        uint64_t kept_bytes = 0;
+        double full_time = bench::best_of(3, [&] { full_hits = count_in(data, 0, size, needle); });
+        double pruned_time = bench::best_of(3, [&] {
+            std::vector<bool> candidates;
+            index.candidate_chunks(needle, candidates);
+            pruned_hits = 0;
+            kept = 0;
+            kept_bytes = 0;
+            for (std::size_t i = 0; i < candidates.size(); ++i) {
+                if (!candidates[i]) continue;
+                const uint64_t begin = index.chunk_start(i);
+                const uint64_t end = i + 1 < candidates.size() ? index.chunk_start(i + 1) : size;
+                pruned_hits += count_in(data, begin, end, needle);
+                ++kept;
+                kept_bytes += end - begin;
+            }
+        });
+        std::printf("\n%s: \"%s\", %zu of %zu chunks kept (%.2f%% of the bytes), %zu hits\n", name, needle.c_str(), kept,
+            index.chunk_count(), 100.0 * static_cast<double>(kept_bytes) / static_cast<double>(size), full_hits);
+        bench::report("scan the whole file", full_time, size);
+        bench::report("trigram filter + kept chunks", pruned_time, size);
+        same = same && full_hits == pruned_hits;
+    }
+    std::printf("\n%s\n", same ? "the kept chunks hold every hit" : "HITS LOST IN DROPPED CHUNKS");
+    munmap(map, size);
+    cleanup();
+    return same ? 0 : 1;
+}
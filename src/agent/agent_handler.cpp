@@ -2,6 +2,7 @@
 #include "searcher.hpp"
 #include <iostream>
 #include <vector>
+#include <map>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 #include <zlib.h>
@@ -13,10 +14,28 @@ namespace drlog {
     namespace net = boost::asio;
     using tcp = net::ip::tcp;
 
-    AgentHandler::AgentHandler(std::shared_ptr<FileIndexer> idx)
-        : indexer_(idx){}
+    #define MAX_HISTOGRAM_BUCKETS 100000
 
-    AgentHandler::~AgentHandler() {}
+    namespace {
+        // counts of a histogram bucket summed over the blocks of every file, wider than BlockStats
+        // since one bucket may cover the whole prefix over many days
+        struct volume_bucket {
+            uint64_t lines{0};
+            uint64_t bytes{0};
+            uint64_t errors{0};
+            uint64_t warns{0};
+            uint64_t infos{0};
+        };
+    }
+
+    AgentHandler::AgentHandler(std::shared_ptr<FileIndexer> idx, unsigned search_threads, unsigned search_requests)
+        : indexer_(idx),
+          scan_pool_(std::make_unique<work_stealing_pool>(search_threads > 0 ? search_threads : thread_pool::default_threads())),
+          search_executor_(std::make_unique<net::thread_pool>(search_requests > 0 ? search_requests : thread_pool::default_threads())) {}
+
+    AgentHandler::~AgentHandler() {
+        search_executor_->join();
+    }
 
     net::awaitable<void> AgentHandler::hello(std::shared_ptr<http::request<http::string_body>> req,
                 std::shared_ptr<http::response<http::string_body>> res,
@@ -53,13 +72,16 @@ namespace drlog {
             nlohmann::json j = nlohmann::json::array();
             for (const auto &fi : results) {
                 nlohmann::json item;
-                item["path"] = fi.fullpath;
-                item["size"] = fi.size;
-                item["mtime"] = fi.mtime;
-                if (!fi.etag.empty()) item["etag"] = fi.etag;
-                if (fi.file_index != nullptr && !fi.file_index->time_indexes.empty()) {
-                    item["start_time"] = fi.file_index->time_indexes.front().timestamp;
-                    item["end_time"] = fi.file_index->time_indexes.back().timestamp;
+                item["path"] = fi->fullpath;
+                item["size"] = fi->size;
+                item["mtime"] = fi->mtime;
+                if (!fi->etag.empty()) item["etag"] = fi->etag;
+                if (fi->file_index != nullptr && !fi->file_index->time_indexes.empty()) {
+                    item["start_time"] = fi->file_index->time_indexes.front().timestamp;
+                    item["end_time"] = fi->file_index->time_indexes.back().timestamp;
+                } else if (fi->cold) {
+                    item["start_time"] = fi->start_time;
+                    item["end_time"] = fi->end_time;
                 }
                 j.push_back(item);
             }
@@ -106,8 +128,7 @@ namespace drlog {
                 spdlog::warn("Path parameter is required, url: {}", std::string(req->target()));      
                 co_return;
             }
-            auto results = indexer_->list_prefix(prefix);
-            if (results.empty()) {
+            if (!indexer_->has_prefix(prefix)) {
                 res->result(http::status::not_found);
                 spdlog::warn("No files found under path: {}", prefix, std::string(req->target()));      
                 co_return;
@@ -155,92 +176,271 @@ namespace drlog {
                 co_return;
             }
 
-            LogSearcher searcher(indexer_);
-            searcher.search(search_req,result);
+            // the scan and the response body are built on search_executor_, the io thread serves
+            // the other connections meanwhile and resumes here once they are done
+            std::string res_body;
+            std::string content_encoding;
+            std::string accept_encoding;
+            auto& headers = req->base();
+            auto it = headers.find(boost::beast::http::field::accept_encoding);
+            if (it != headers.end()) accept_encoding = std::string(it->value());
+            co_await net::co_spawn(search_executor_->get_executor(), [&]() -> net::awaitable<void> {
+                LogSearcher searcher(indexer_, scan_pool_.get());
+                searcher.search(search_req,result);
+                if (result.status != 0) co_return;
+                //if debug == true or 1, print the search result to log
+                if (debug_param == "1" || debug_param == "true") {
+                    for (const auto& fm_ptr : result.matches) {
+                        spdlog::info("Search Result - File: {}, Status: {}, Error Msg: {}, Lines Found: {}", 
+                            fm_ptr->path, fm_ptr->status, fm_ptr->error_msg, fm_ptr->lines.size());
+                        for (const auto& logline : fm_ptr->lines) {
+                            spdlog::info("    Time: {}, Line: {}", logline.timestamp, logline.line);
+                        }
+                    }
+                }
+                //output
+                //{"status":0,"error_msg":"",
+                //"records":[{"path":"","status":0,"error_msg":"","start_time":0,"end_time":0,"lines":[{"line":"","time":0},{...}]}]}
+                nlohmann::json jres;
+                jres["status"] = result.status;
+                jres["error_msg"] = result.error_msg;
+                jres["records"] = nlohmann::json::array();
+                for (const auto& fm_ptr : result.matches) {
+                    if(fm_ptr->status != 0) {
+                        continue;
+                    }
+                    if(fm_ptr->lines.empty()) {
+                        continue;
+                    }
+                    nlohmann::json jfm;
+                    jfm["path"] = fm_ptr->path;
+                    jfm["status"] = fm_ptr->status;
+                    jfm["error_msg"] = fm_ptr->error_msg;
+                    jfm["lines"] = nlohmann::json::array();
+                    for (const auto& logline : fm_ptr->lines) {
+                        nlohmann::json jline;
+                        jline["line"] = ensure_utf8(logline.line);
+                        jline["time"] = logline.timestamp;
+                        jfm["lines"].push_back(jline);
+                    }
+                    jfm["start_time"] = fm_ptr->lines.front().timestamp;
+                    jfm["end_time"] = fm_ptr->lines.back().timestamp;
+                    jres["records"].push_back(jfm);
+                }
+                std::string res_body_j = jres.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+                //gzip compress if needed
+                std::string res_body_c;
+                if (!accept_encoding.empty()) {
+                    compress_body(res_body_j,accept_encoding,res_body_c,content_encoding);
+                }
+                res_body = content_encoding == "gzip" ? std::move(res_body_c) : std::move(res_body_j);
+            }, net::use_awaitable);
             if (result.status != 0) {
                 res->result(http::status::internal_server_error);
                 spdlog::error("Search failed: {}, url: {}", result.error_msg, std::string(req->target()));
                 co_return;
             }
-            //if debug == true or 1, print the search result to log
-            if (debug_param == "1" || debug_param == "true") {
-                for (const auto& fm_ptr : result.matches) {
-                    spdlog::info("Search Result - File: {}, Status: {}, Error Msg: {}, Lines Found: {}", 
-                        fm_ptr->path, fm_ptr->status, fm_ptr->error_msg, fm_ptr->lines.size());
-                    for (const auto& logline : fm_ptr->lines) {
-                        spdlog::info("    Time: {}, Line: {}", logline.timestamp, logline.line);
-                    }
-                }
+            if(content_encoding == "gzip") {
+                res->set(http::field::content_encoding, "gzip");
             }
-            //output
-            //{"status":0,"error_msg":"",
-            //"records":[{"path":"","status":0,"error_msg":"","start_time":0,"end_time":0,"lines":[{"line":"","time":0},{...}]}]}
-            nlohmann::json jres;
-            jres["status"] = result.status;
-            jres["error_msg"] = result.error_msg;
-            jres["records"] = nlohmann::json::array();
-            for (const auto& fm_ptr : result.matches) {
-                if(fm_ptr->status != 0) {
-                    continue;
-                }
-                if(fm_ptr->lines.empty()) {
-                    continue;
-                }
-                nlohmann::json jfm;
-                jfm["path"] = fm_ptr->path;
-                jfm["status"] = fm_ptr->status;
-                jfm["error_msg"] = fm_ptr->error_msg;
-                jfm["lines"] = nlohmann::json::array();
-                for (const auto& logline : fm_ptr->lines) {
-                    nlohmann::json jline;
-                    jline["line"] = ensure_utf8(logline.line);
-                    jline["time"] = logline.timestamp;
-                    jfm["lines"].push_back(jline);
-                }
-                jfm["start_time"] = fm_ptr->lines.front().timestamp;
-                jfm["end_time"] = fm_ptr->lines.back().timestamp;
-                jres["records"].push_back(jfm);
+            res->body() = std::move(res_body);
+            res->set(http::field::content_type, "application/json");
+            res->prepare_payload();
+            spdlog::info("Search completed with {} file matches under request : {}", result.matches.size(), req->target());
+            co_return;
+        } catch ( const nlohmann::json::exception& e) {
+            // best-effort 500
+            res->result(http::status::internal_server_error);
+            spdlog::error("JSON error in search handler: {}", e.what());
+            co_return;
+        } catch (const std::exception& e) {
+            // best-effort 500
+            res->result(http::status::internal_server_error);
+            spdlog::error("Internal server error in search handler: {}", e.what());
+            co_return;
+
+        } catch (...) {
+            // best-effort 500
+            res->result(http::status::internal_server_error);
+            spdlog::error("Unknown internal server error in search handler");
+            co_return;
+        }
+    }
+    
+    net::awaitable<void> AgentHandler::histogram(std::shared_ptr<http::request<http::string_body>> req,
+            std::shared_ptr<http::response<http::string_body>> res,
+            std::shared_ptr<bst::request_context> ctx) {
+        try {
+            if (req->method() != http::verb::get) {
+                res->result(http::status::method_not_allowed);
+                spdlog::warn("Method not allowed, only GET is allowed, url: {}", std::string(req->target()));
+                co_return;
+            }
+            auto prefix = util::url_decode(ctx->get_param("prefix"));
+            auto start_param = ctx->get_param("start_time");
+            auto end_param = ctx->get_param("end_time");
+            auto step_param = ctx->get_param("step");
+            if (prefix.empty() || start_param.empty() || end_param.empty()) {
+                res->result(http::status::bad_request);
+                spdlog::warn("Prefix, start_time and end_time parameters are required, url: {}", std::string(req->target()));
+                co_return;
+            }
+            //step defaults to the index interval, a block is never split across buckets
+            uint64_t start_time = 0, end_time = 0, step = indexer_->index_interval_seconds();
+            try {
+                start_time = std::stoull(start_param);
+                end_time = std::stoull(end_param);
+                if (!step_param.empty()) step = std::stoull(step_param);
+            } catch (const std::exception&) {
+                step = 0;
+            }
+            if (step == 0 || start_time > end_time || (end_time - start_time) / step >= MAX_HISTOGRAM_BUCKETS) {
+                res->result(http::status::bad_request);
+                spdlog::warn("Invalid time range or step, url: {}", std::string(req->target()));
+                co_return;
             }
-            std::string res_body_j = jres.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
-            //gzip compress if needed
+
+            // the files are aggregated and the response body is built on search_executor_, reading the
+            // sidecars of cold files keeps the io thread waiting otherwise
+            std::map<uint64_t, volume_bucket> buckets;
+            std::size_t files = 0, unindexed = 0;
+            std::string res_body_j;
             std::string res_body_c;
             std::string content_encoding;
+            std::string accept_encoding;
             auto& headers = req->base();
             auto it = headers.find(boost::beast::http::field::accept_encoding);
-            if (it != headers.end()) {
-                auto accept_encoding = it->value();
-                compress_body(res_body_j,accept_encoding,res_body_c,content_encoding);
-            }
+            if (it != headers.end()) accept_encoding = std::string(it->value());
+            co_await net::co_spawn(search_executor_->get_executor(), [&]() -> net::awaitable<void> {
+                //a block counts in the bucket of its start time, its lines may run into the next buckets
+                auto results = indexer_->list_prefix(prefix);
+                for (auto fi : results) {
+                    //cold files that may cover the range are read from their sidecars, a cold file without
+                    //one is reported unindexed rather than built, the histogram never reads log data
+                    if (fi->cold) {
+                        if (fi->end_time < start_time || fi->start_time > end_time) continue;
+                        auto loaded = indexer_->read_cold_index(fi);
+                        if (loaded == nullptr) {
+                            ++unindexed;
+                            continue;
+                        }
+                        fi = std::move(loaded);
+                    }
+                    const FileIndex* idx = fi->file_index.get();
+                    if (idx == nullptr || idx->block_stats.empty()) {
+                        ++unindexed;
+                        continue;
+                    }
+                    const auto& entries = idx->time_indexes;
+                    if (entries.back().timestamp < start_time || entries.front().timestamp > end_time) continue;
+                    ++files;
+                    for (std::size_t i = 0; i + 1 < entries.size(); ++i) {
+                        const uint64_t t = entries[i].timestamp;
+                        if (t < start_time) continue;
+                        if (t > end_time) break;
+                        const BlockStats& b = idx->block_stats[i];
+                        volume_bucket& out = buckets[t - t % step];
+                        out.bytes += b.bytes;
+                        out.lines += b.lines;
+                        out.errors += b.errors;
+                        out.warns += b.warns;
+                        out.infos += b.infos;
+                    }
+                }
+
+                //output
+                //{"status":0,"error_msg":"","step":300,"files":2,"unindexed":0,
+                //"buckets":[{"time":0,"lines":0,"bytes":0,"error":0,"warn":0,"info":0},{...}]}
+                nlohmann::json jres;
+                jres["status"] = 0;
+                jres["error_msg"] = "";
+                jres["step"] = step;
+                jres["files"] = files;
+                jres["unindexed"] = unindexed;
+                jres["buckets"] = nlohmann::json::array();
+                for (const auto& [time, b] : buckets) {
+                    nlohmann::json jb;
+                    jb["time"] = time;
+                    jb["lines"] = b.lines;
+                    jb["bytes"] = b.bytes;
+                    jb["error"] = b.errors;
+                    jb["warn"] = b.warns;
+                    jb["info"] = b.infos;
+                    jres["buckets"].push_back(jb);
+                }
+                res_body_j = jres.dump();
+                if (!accept_encoding.empty()) {
+                    compress_body(res_body_j,accept_encoding,res_body_c,content_encoding);
+                }
+                co_return;
+            }, net::use_awaitable);
             if(content_encoding == "gzip") {
                 res->set(http::field::content_encoding, "gzip");
                 res->body() = std::move(res_body_c);
-            }
-            else {
+            } else {
                 res->body() = std::move(res_body_j);
             }
             res->set(http::field::content_type, "application/json");
             res->prepare_payload();
-            spdlog::info("Search completed with {} file matches under request : {}", result.matches.size(), req->target());
+            spdlog::info("Histogram of {} files with {} buckets under request : {}", files, buckets.size(), req->target());
             co_return;
         } catch ( const nlohmann::json::exception& e) {
             // best-effort 500
             res->result(http::status::internal_server_error);
-            spdlog::error("JSON error in search handler: {}", e.what());
+            spdlog::error("JSON error in histogram handler: {}", e.what());
             co_return;
         } catch (const std::exception& e) {
             // best-effort 500
             res->result(http::status::internal_server_error);
-            spdlog::error("Internal server error in search handler: {}", e.what());
+            spdlog::error("Internal server error in histogram handler: {}", e.what());
             co_return;
-
         } catch (...) {
             // best-effort 500
             res->result(http::status::internal_server_error);
-            spdlog::error("Unknown internal server error in search handler");
+            spdlog::error("Unknown internal server error in histogram handler");
             co_return;
         }
     }
-    
+
+    net::awaitable<void> AgentHandler::metrics(std::shared_ptr<http::request<http::string_body>> req,
+            std::shared_ptr<http::response<http::string_body>> res,
+            [[maybe_unused]] std::shared_ptr<bst::request_context> ctx) {
+        try {
+            if (req->method() != http::verb::get) {
+                res->result(http::status::method_not_allowed);
+                spdlog::warn("Method not allowed, only GET is allowed, url: {}", std::string(req->target()));
+                co_return;
+            }
+            //output
+            //{"status":0,"read_bytes":0,"throttled_ms":{"rate":0,"cpu":0,"load":0},"load_pauses":0,
+            //"limits":{"max_read_mb":0,"max_cpu_share":0,"nice":0,"io_class":0,"io_level":4,"max_load":0}}
+            const resource_governor::stats stats = indexer_->index_throttle_stats();
+            const resource_governor::limits& limits = indexer_->index_limits();
+            nlohmann::json jres;
+            jres["status"] = 0;
+            jres["read_bytes"] = stats.read_bytes;
+            jres["throttled_ms"]["rate"] = stats.rate_wait_ms;
+            jres["throttled_ms"]["cpu"] = stats.cpu_wait_ms;
+            jres["throttled_ms"]["load"] = stats.load_wait_ms;
+            jres["load_pauses"] = stats.load_pauses;
+            jres["limits"]["max_read_mb"] = limits.max_read_mb_per_sec;
+            jres["limits"]["max_cpu_share"] = limits.max_cpu_share;
+            jres["limits"]["nice"] = limits.nice;
+            jres["limits"]["io_class"] = limits.io_class;
+            jres["limits"]["io_level"] = limits.io_level;
+            jres["limits"]["max_load"] = limits.max_load;
+            res->set(http::field::content_type, "application/json");
+            res->body() = jres.dump();
+            res->prepare_payload();
+            co_return;
+        } catch (const std::exception& e) {
+            // best-effort 500
+            res->result(http::status::internal_server_error);
+            spdlog::error("Internal server error in metrics handler: {}", e.what());
+            co_return;
+        }
+    }
+
     void AgentHandler::compress_body(const std::string& input,const std::string& accept_encoding, 
             std::string& output,std::string& content_encoding) {
         if(input.size() < 1024) {
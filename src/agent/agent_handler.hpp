@@ -7,6 +7,9 @@
 #include <boost/beast/http.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include "searcher.hpp"
 
 namespace drlog {
@@ -18,7 +21,9 @@ namespace drlog {
 
     class AgentHandler {
     public:
-        AgentHandler(std::shared_ptr<FileIndexer> idx);
+        // search_threads scan the files and chunks of all searches, search_requests run that many
+        // searches at once off the io threads; 0 = thread_pool::default_threads() for both
+        AgentHandler(std::shared_ptr<FileIndexer> idx, unsigned search_threads = 0, unsigned search_requests = 0);
         ~AgentHandler();
 
         // Handle the request
@@ -33,6 +38,16 @@ namespace drlog {
         net::awaitable<void> search(std::shared_ptr<http::request<http::string_body>> req,
             std::shared_ptr<http::response<http::string_body>> res,
             std::shared_ptr<bst::request_context> ctx);
+
+        // volume timeline of the files under a prefix, read from the index without scanning the logs
+        net::awaitable<void> histogram(std::shared_ptr<http::request<http::string_body>> req,
+            std::shared_ptr<http::response<http::string_body>> res,
+            std::shared_ptr<bst::request_context> ctx);
+
+        // read volume of the indexing threads and the time they were held back by the limits
+        net::awaitable<void> metrics(std::shared_ptr<http::request<http::string_body>> req,
+            std::shared_ptr<http::response<http::string_body>> res,
+            std::shared_ptr<bst::request_context> ctx);
     private:
         void compress_body(const std::string& input,const std::string& accept_encoding, 
             std::string& output,std::string& content_encoding);
@@ -40,5 +55,8 @@ namespace drlog {
          std::string ensure_utf8(const std::string& s);
     private:
         std::shared_ptr<FileIndexer> indexer_;
+        std::unique_ptr<work_stealing_pool> scan_pool_;
+        // runs the search handler's LogSearcher::search and response encoding
+        std::unique_ptr<net::thread_pool> search_executor_;
     };
 } // namespace drlog
@@ -0,0 +1,173 @@
+#include "dir_scanner.hpp"
+#include "indexer.hpp"
+#include "util/thread_pool.hpp"
+#include <spdlog/spdlog.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <cstring>
+#include <cerrno>
+
+namespace drlog {
+
+    struct linux_dirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    std::string DirScanner::join_path(const std::string& dir, const std::string& name) {
+        std::string out = dir;
+        if (out.empty() || out.back() != '/') out.push_back('/');
+        out.append(name);
+        return out;
+    }
+
+    bool DirScanner::dir_may_match(const RootPath& rp, const std::string& dir) {
+        if (rp.path_pattern.empty()) return true;
+        const std::string prefix = join_path(dir, "");
+        try {
+            boost::smatch m;
+            // a partial match means some longer path could still match
+            if (!boost::regex_match(prefix, m, rp.path_regex, boost::match_default | boost::match_partial)) return false;
+            // "^(?!EXCL).*": once EXCL matches a prefix of the directory, it matches for every path below it
+            if (rp.has_path_exclude &&
+                boost::regex_search(prefix, m, rp.path_exclude_regex,
+                    boost::match_continuous | boost::match_not_eol | boost::match_not_eob | boost::match_not_eow)) {
+                return false;
+            }
+        } catch (const std::exception& e) {
+            spdlog::warn("Regex error for dir {}: {}", dir, e.what());
+        }
+        return true;
+    }
+
+    bool DirScanner::file_matches(const RootPath& rp, const std::string& path, const std::string& filename) {
+        try {
+            boost::smatch matches;
+            if (!rp.path_pattern.empty() && !boost::regex_match(path, matches, rp.path_regex)) return false;
+            if (!rp.filename_pattern.empty() && !boost::regex_match(filename, matches, rp.filename_regex)) return false;
+        } catch (const boost::regex_error& e) {
+            spdlog::warn("Regex error for path {}: {}", rp.path, e.what());
+            return false;
+        }
+        return true;
+    }
+
+    void DirScanner::scan(const std::vector<std::shared_ptr<RootPath>>& roots, thread_pool* pool, const file_callback& on_file) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++generation_;
+        }
+        for (const auto& rp : roots) {
+            struct stat st {};
+            if (stat(rp->path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+            if (pool) {
+                pool->submit([this, rp, pool, &on_file]{ scan_dir(rp, rp->path, pool, on_file); });
+            } else {
+                scan_dir(rp, rp->path, nullptr, on_file);
+            }
+        }
+        if (pool) pool->wait();
+        // forget directories that were not reached this time
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = listings_.begin(); it != listings_.end(); ) {
+            if (it->second.generation != generation_) it = listings_.erase(it);
+            else ++it;
+        }
+    }
+
+    std::size_t DirScanner::cached_dirs() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return listings_.size();
+    }
+
+    void DirScanner::scan_dir(const std::shared_ptr<RootPath>& rp, const std::string& dir, thread_pool* pool, const file_callback& on_file) {
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno != ENOENT && errno != EACCES) spdlog::warn("Failed to open dir {}: {}", dir, std::strerror(errno));
+            return;
+        }
+        DirListing listing;
+        struct stat dst {};
+        bool cached = false;
+        if (fstat(fd, &dst) == 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = listings_.find(dir);
+            // an entry added in the same second as the listing may not have moved the mtime yet
+            if (it != listings_.end() &&
+                it->second.mtime.tv_sec == dst.st_mtim.tv_sec && it->second.mtime.tv_nsec == dst.st_mtim.tv_nsec &&
+                dst.st_mtim.tv_sec < it->second.listed_at) {
+                it->second.generation = generation_;
+                listing = it->second;
+                cached = true;
+            }
+        }
+        if (!cached) {
+            listing.mtime = dst.st_mtim;
+            listing.listed_at = std::time(nullptr);
+            list_dir(*rp, dir, fd, listing);
+            std::lock_guard<std::mutex> lock(mutex_);
+            listing.generation = generation_;
+            listings_[dir] = listing;
+        }
+
+        // the listing may be old, but size and mtime of the files must be current
+        for (const auto& name : listing.files) {
+            struct stat st {};
+            if (fstatat(fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) continue;
+            try {
+                on_file(rp, join_path(dir, name), st);
+            } catch (const std::exception& e) {
+                spdlog::error("scan_root entry error: {}", e.what());
+            }
+        }
+        close(fd);
+
+        for (const auto& name : listing.dirs) {
+            std::string sub = join_path(dir, name);
+            if (pool) {
+                pool->submit([this, rp, sub = std::move(sub), pool, &on_file]{ scan_dir(rp, sub, pool, on_file); });
+            } else {
+                scan_dir(rp, sub, nullptr, on_file);
+            }
+        }
+    }
+
+    void DirScanner::list_dir(const RootPath& rp, const std::string& dir, int fd, DirListing& out) {
+        std::vector<char> buf(64 * 1024);
+        while (true) {
+            long n = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+            if (n <= 0) {
+                if (n < 0) spdlog::warn("getdents64 failed for {}: {}", dir, std::strerror(errno));
+                break;
+            }
+            for (long off = 0; off < n; ) {
+                const linux_dirent64* d = reinterpret_cast<const linux_dirent64*>(buf.data() + off);
+                off += d->d_reclen;
+                const char* name = d->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+                unsigned char type = d->d_type;
+                if (type == DT_UNKNOWN) {
+                    // filesystems without d_type
+                    struct stat st {};
+                    if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_LNK);
+                }
+                if (type == DT_DIR) {
+                    if (dir_may_match(rp, join_path(dir, name))) {
+                        out.dirs.emplace_back(name);
+                    } else {
+                        spdlog::debug("Pruned dir {} by path pattern", join_path(dir, name));
+                    }
+                } else if (type == DT_REG) {
+                    // symbolic links and special files are skipped
+                    if (file_matches(rp, join_path(dir, name), name)) out.files.emplace_back(name);
+                }
+            }
+        }
+    }
+}   // namespace drlog
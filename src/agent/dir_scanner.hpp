@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ctime>
+#include <cstdint>
+#include <sys/stat.h>
+
+namespace drlog {
+    struct RootPath;
+    class thread_pool;
+
+    // walks the roots with getdents64 and d_type, skips directories the path pattern can never
+    // match, and reuses the listing of directories whose mtime did not change since the last pass
+    class DirScanner {
+    public:
+        using file_callback = std::function<void(const std::shared_ptr<RootPath>& rp, const std::string& path, const struct stat& st)>;
+
+        // call on_file for every regular file passing the root filters; directories are listed
+        // concurrently on pool when given, so on_file must be thread safe
+        void scan(const std::vector<std::shared_ptr<RootPath>>& roots, thread_pool* pool, const file_callback& on_file);
+        std::size_t cached_dirs() const;
+
+        // false when no path below dir can match the root's path_pattern
+        static bool dir_may_match(const RootPath& rp, const std::string& dir);
+        static bool file_matches(const RootPath& rp, const std::string& path, const std::string& filename);
+        static std::string join_path(const std::string& dir, const std::string& name);
+
+    private:
+        struct DirListing {
+            struct timespec mtime {};
+            std::time_t listed_at{0};
+            std::vector<std::string> files;   // names passing the root filters
+            std::vector<std::string> dirs;    // names of subdirectories that may match
+            uint64_t generation{0};
+        };
+        void scan_dir(const std::shared_ptr<RootPath>& rp, const std::string& dir, thread_pool* pool, const file_callback& on_file);
+        static void list_dir(const RootPath& rp, const std::string& dir, int fd, DirListing& out);
+
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string, DirListing> listings_; // key = directory path
+        uint64_t generation_{0};
+    };
+}   // namespace drlog
@@ -0,0 +1,141 @@
+#include "file_watcher.hpp"
+#include <spdlog/spdlog.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace drlog {
+
+    static constexpr uint32_t WATCH_MASK = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                                           IN_DELETE | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+    static std::string join_path(const std::string& dir, const char* name) {
+        std::string out = dir;
+        if (out.empty() || out.back() != '/') out.push_back('/');
+        out.append(name);
+        return out;
+    }
+
+    FileWatcher::FileWatcher() {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0) {
+            spdlog::warn("inotify_init1 failed: {}, falling back to periodic scans", std::strerror(errno));
+        }
+    }
+
+    FileWatcher::~FileWatcher() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool FileWatcher::add_tree(const std::string& root, std::size_t root_id, dir_filter filter) {
+        if (fd_ < 0) return false;
+        if (filter) filters_[root_id] = std::move(filter);
+        std::string dir = root;
+        while (dir.size() > 1 && dir.back() == '/') dir.pop_back();
+        return add_dir(dir, root_id, nullptr);
+    }
+
+    // watch dir and its subdirectories; for a directory that appeared after startup the files
+    // already inside it are reported as changes, they were written before the watch existed
+    bool FileWatcher::add_dir(const std::string& dir, std::size_t root_id, FileChanges* out) {
+        bool ok = true;
+        auto filter = filters_.find(root_id);
+        std::vector<std::string> pending{dir};
+        while (!pending.empty()) {
+            std::string current = std::move(pending.back());
+            pending.pop_back();
+            int wd = inotify_add_watch(fd_, current.c_str(), WATCH_MASK);
+            if (wd < 0) {
+                if (errno != ENOENT && errno != ENOTDIR) {
+                    spdlog::warn("inotify_add_watch failed for {}: {}", current, std::strerror(errno));
+                    complete_ = false;
+                    ok = false;
+                }
+                continue;
+            }
+            dirs_[wd] = WatchedDir{current, root_id};
+
+            DIR* d = opendir(current.c_str());
+            if (!d) continue;
+            while (struct dirent* e = readdir(d)) {
+                if (std::strcmp(e->d_name, ".") == 0 || std::strcmp(e->d_name, "..") == 0) continue;
+                unsigned char type = e->d_type;
+                std::string child = join_path(current, e->d_name);
+                if (type == DT_UNKNOWN) {
+                    struct stat st {};
+                    if (lstat(child.c_str(), &st) != 0) continue;
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_LNK);
+                }
+                if (type == DT_DIR) {
+                    // directories the root can never match are not watched
+                    if (filter != filters_.end() && !filter->second(child)) continue;
+                    pending.push_back(std::move(child));
+                } else if (type == DT_REG && out) {
+                    out->paths[child] = root_id;
+                }
+            }
+            closedir(d);
+        }
+        return ok;
+    }
+
+    void FileWatcher::remove_dir_watches(const std::string& dir) {
+        const std::string prefix = dir + "/";
+        for (auto it = dirs_.begin(); it != dirs_.end(); ) {
+            const std::string& path = it->second.path;
+            if (path == dir || path.compare(0, prefix.size(), prefix) == 0) {
+                inotify_rm_watch(fd_, it->first);
+                it = dirs_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    bool FileWatcher::poll(FileChanges& out) {
+        if (fd_ < 0) return false;
+        alignas(struct inotify_event) char buf[64 * 1024];
+        while (true) {
+            ssize_t n = read(fd_, buf, sizeof(buf));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                spdlog::warn("inotify read failed: {}", std::strerror(errno));
+                return false;
+            }
+            if (n == 0) break;
+            for (char* p = buf; p < buf + n; ) {
+                const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+                p += sizeof(struct inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    spdlog::warn("inotify queue overflow, events were lost");
+                    out.overflow = true;
+                    continue;
+                }
+                if (ev->mask & IN_IGNORED) {
+                    dirs_.erase(ev->wd);
+                    continue;
+                }
+                auto it = dirs_.find(ev->wd);
+                if (it == dirs_.end() || ev->len == 0) continue;
+                const std::size_t root_id = it->second.root_id;
+                std::string path = join_path(it->second.path, ev->name);
+                if (ev->mask & IN_ISDIR) {
+                    if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        auto filter = filters_.find(root_id);
+                        if (filter == filters_.end() || filter->second(path)) add_dir(path, root_id, &out);
+                    } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        remove_dir_watches(path);
+                        out.removed_dirs.push_back(std::move(path));
+                    }
+                    continue;
+                }
+                out.paths[std::move(path)] = root_id;
+            }
+        }
+        return true;
+    }
+}   // namespace drlog
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstddef>
+
+namespace drlog {
+
+    struct FileChanges {
+        // files created, written, renamed or deleted since the last poll, value = root id
+        std::unordered_map<std::string, std::size_t> paths;
+        // directories deleted or moved away, every file below them is gone
+        std::vector<std::string> removed_dirs;
+        // the kernel queue overflowed, events were lost and a full scan is needed
+        bool overflow{false};
+    };
+
+    // inotify watches on every directory below the roots, polled without blocking
+    class FileWatcher {
+    public:
+        FileWatcher();
+        ~FileWatcher();
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        using dir_filter = std::function<bool(const std::string& dir)>;
+        // watch root and the directories below it that pass filter; false if some directory could not be watched
+        bool add_tree(const std::string& root, std::size_t root_id, dir_filter filter = nullptr);
+        // drain the pending events into out
+        bool poll(FileChanges& out);
+        // every directory of every root is watched, events cover all changes
+        bool complete() const { return fd_ >= 0 && complete_; }
+        std::size_t watch_count() const { return dirs_.size(); }
+
+    private:
+        struct WatchedDir {
+            std::string path;
+            std::size_t root_id;
+        };
+        bool add_dir(const std::string& dir, std::size_t root_id, FileChanges* out);
+        void remove_dir_watches(const std::string& dir);
+
+        int fd_{-1};
+        bool complete_{true};
+        std::unordered_map<int, WatchedDir> dirs_; // key = watch descriptor
+        std::unordered_map<std::size_t, dir_filter> filters_; // key = root id
+    };
+}   // namespace drlog
@@ -0,0 +1,779 @@
+#include "index_cache.hpp"
+#include "src/util/util.hpp"
+#include <spdlog/spdlog.h>
+#include <unordered_map>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace drlog {
+    namespace fs = std::filesystem;
+
+    namespace {
+        constexpr char CACHE_MAGIC[8] = {'D', 'R', 'L', 'O', 'G', 'I', 'D', 'X'};
+        constexpr uint64_t CACHE_SEED = 0x64726c6f67636163ULL;
+        constexpr uint32_t ENTRY_HAS_FILE_INDEX = 1;
+        constexpr char JOURNAL_MAGIC[8] = {'D', 'R', 'L', 'O', 'G', 'J', 'N', 'L'};
+
+        struct cache_header {
+            char magic[8];
+            uint32_t version;
+            uint32_t entry_size;        // sizeof(entry_record), catches layout changes within a version
+            uint64_t entry_count;
+            uint64_t strings_offset;
+            uint64_t strings_size;
+            uint64_t entries_offset;
+            uint64_t time_index_offset;
+            uint64_t time_index_count;
+            uint64_t blob_offset;
+            uint64_t blob_size;
+            uint64_t checksum;          // MurMurHash64 of the string table, the entry records and the blob
+        };
+
+        struct str_ref {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        struct entry_record {
+            str_ref fullpath;
+            str_ref name;
+            str_ref dir;
+            str_ref file_type;
+            str_ref etag;
+            str_ref root_path;
+            str_ref index_etag;
+            uint64_t size;
+            int64_t mtime;
+            uint64_t inode;
+            int64_t last_index_time;
+            uint64_t time_index_first;
+            uint64_t time_index_count;
+            int32_t time_format;
+            uint32_t time_offset;
+            uint32_t flags;
+            uint32_t head_size;
+            uint64_t head_hash;
+            uint64_t points_offset;     // encoded inflate points in the blob
+            uint64_t points_size;
+            uint64_t filters_offset;    // encoded block filters in the blob
+            uint64_t filters_size;
+            uint64_t tokens_offset;     // encoded block token values in the blob
+            uint64_t tokens_size;
+            uint64_t token_pattern_hash;
+            uint64_t stats_offset;      // encoded block stats in the blob
+            uint64_t stats_size;
+        };
+
+        struct journal_header {
+            char magic[8];
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t base_checksum;
+        };
+
+        struct record_header {
+            uint32_t type;
+            uint32_t length;            // payload bytes following the header
+            uint64_t checksum;          // MurMurHash64 of the payload
+        };
+
+        static_assert(sizeof(TimeIndex) == 16, "TimeIndex is stored as packed 16 byte records");
+        static_assert(sizeof(cache_header) % 8 == 0 && sizeof(entry_record) % 8 == 0, "records must keep 8 byte alignment");
+
+        inline uint64_t align8(uint64_t v) {
+            return (v + 7) & ~uint64_t(7);
+        }
+
+        inline bool ref_valid(const str_ref& r, std::size_t strings_size) {
+            return static_cast<uint64_t>(r.offset) + r.length <= strings_size;
+        }
+
+        // first block filter carried by a record that keeps first time index entries
+        inline std::size_t first_filter_block(std::size_t first) {
+            return first > 0 ? first - 1 : 0;
+        }
+
+        // apply the per-block section (filters or token values) of a record to the merged one,
+        // what does not continue is dropped and the file is searched without it
+        void merge_blocks(IndexJournal::RecordType type, uint64_t first, std::string_view data,
+            std::vector<uint32_t>& offsets, std::vector<uint64_t>& words) {
+            const std::size_t keep = first_filter_block(first);
+            if (type == IndexJournal::RECORD_APPEND && offsets.size() > keep) {
+                offsets.resize(keep + 1);
+                words.resize(offsets.back());
+            } else {
+                offsets.clear();
+                words.clear();
+            }
+            if ((type == IndexJournal::RECORD_FILE || !offsets.empty()) && !IndexCache::decode_block_filters(data, offsets, words)) {
+                offsets.clear();
+                words.clear();
+            }
+        }
+
+        // first block stats carried by a record that keeps first time index entries: when the old
+        // last entry is kept the block before it lost the lines from it on, its stats changed too
+        inline std::size_t first_stats_block(std::size_t first) {
+            return first > 1 ? first - 2 : 0;
+        }
+
+        // the same for the block stats
+        void merge_stats(IndexJournal::RecordType type, uint64_t first, std::string_view data, std::vector<BlockStats>& stats) {
+            const std::size_t keep = first_stats_block(first);
+            const bool carried = type == IndexJournal::RECORD_APPEND && stats.size() > keep;
+            if (carried) stats.resize(keep);
+            else stats.clear();
+            if ((type == IndexJournal::RECORD_FILE || carried) && !IndexCache::decode_block_stats(data, stats)) stats.clear();
+        }
+
+        // string table with the repeated values (dir, root, type) stored once
+        class string_table {
+        public:
+            str_ref add(const std::string& s) {
+                str_ref r{static_cast<uint32_t>(data_.size()), static_cast<uint32_t>(s.size())};
+                data_.append(s);
+                return r;
+            }
+            str_ref intern(const std::string& s) {
+                auto it = interned_.find(s);
+                if (it != interned_.end()) return it->second;
+                str_ref r = add(s);
+                interned_.emplace(s, r);
+                return r;
+            }
+            const std::string& data() const { return data_; }
+
+        private:
+            std::string data_;
+            std::unordered_map<std::string, str_ref> interned_;
+        };
+
+        template <typename T>
+        inline void put(std::string& out, T v) {
+            out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+        }
+
+        inline void put_str(std::string& out, std::string_view v) {
+            put<uint32_t>(out, static_cast<uint32_t>(v.size()));
+            out.append(v.data(), v.size());
+        }
+
+        // bounds checked decoding of a journal payload
+        class payload_reader {
+        public:
+            payload_reader(const char* p, std::size_t n) : p_(p), end_(p + n) {}
+            template <typename T>
+            bool get(T& v) {
+                if (static_cast<std::size_t>(end_ - p_) < sizeof(T)) return false;
+                std::memcpy(&v, p_, sizeof(T));
+                p_ += sizeof(T);
+                return true;
+            }
+            bool get_str(std::string_view& v) {
+                uint32_t n = 0;
+                if (!get(n) || static_cast<std::size_t>(end_ - p_) < n) return false;
+                v = std::string_view(p_, n);
+                p_ += n;
+                return true;
+            }
+            bool get_time_indexes(uint64_t count, std::vector<TimeIndex>& out) {
+                if (static_cast<uint64_t>(end_ - p_) / sizeof(TimeIndex) < count) return false;
+                out.resize(count);
+                if (count) std::memcpy(out.data(), p_, count * sizeof(TimeIndex));
+                p_ += count * sizeof(TimeIndex);
+                return true;
+            }
+            bool done() const { return p_ == end_; }
+
+        private:
+            const char* p_;
+            const char* end_;
+        };
+
+        void encode_index_record(std::string& out, IndexJournal::RecordType type, const FileInfo& info, std::size_t first) {
+            const FileIndex& idx = *info.file_index;
+            const std::size_t begin = out.size();
+            out.resize(begin + sizeof(record_header));
+            put_str(out, info.fullpath);
+            put_str(out, info.root_path ? std::string_view(info.root_path->path) : std::string_view());
+            put<uint64_t>(out, info.inode);
+            put_str(out, idx.index_etag);
+            put<int64_t>(out, static_cast<int64_t>(idx.last_index_time));
+            put<int32_t>(out, idx.time_format);
+            put<uint32_t>(out, idx.time_offset);
+            put<uint64_t>(out, idx.head_hash);
+            put<uint32_t>(out, idx.head_size);
+            put<uint64_t>(out, first);
+            const std::size_t count = idx.time_indexes.size() - first;
+            put<uint64_t>(out, count);
+            out.append(reinterpret_cast<const char*>(idx.time_indexes.data() + first), count * sizeof(TimeIndex));
+            std::string points;
+            IndexCache::encode_inflate_points(idx.inflate_points, points);
+            put_str(out, points);
+            std::string filters;
+            IndexCache::encode_block_filters(idx.block_filters, idx.block_filter_words, first_filter_block(first), filters);
+            put_str(out, filters);
+            put<uint64_t>(out, idx.token_pattern_hash);
+            std::string tokens;
+            IndexCache::encode_block_filters(idx.block_tokens, idx.block_token_hashes, first_filter_block(first), tokens);
+            put_str(out, tokens);
+            std::string stats;
+            IndexCache::encode_block_stats(idx.block_stats, first_stats_block(first), stats);
+            put_str(out, stats);
+
+            record_header h {type, static_cast<uint32_t>(out.size() - begin - sizeof(record_header)), 0};
+            h.checksum = util::MurMurHash64(out.data() + begin + sizeof(record_header), h.length, CACHE_SEED);
+            std::memcpy(&out[begin], &h, sizeof(h));
+        }
+    }
+
+    IndexCache::~IndexCache() {
+        close();
+    }
+
+    void IndexCache::close() {
+        if (data_) munmap(const_cast<char*>(data_), length_);
+        data_ = nullptr;
+        length_ = 0;
+        entry_count_ = 0;
+        strings_ = nullptr;
+        strings_size_ = 0;
+        entries_ = nullptr;
+        time_indexes_ = nullptr;
+        time_index_count_ = 0;
+        blob_ = nullptr;
+        blob_size_ = 0;
+        checksum_ = 0;
+    }
+
+    bool IndexCache::open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st {};
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(cache_header)) {
+            ::close(fd);
+            spdlog::warn("Index cache {} is truncated", path);
+            return false;
+        }
+        std::size_t length = static_cast<std::size_t>(st.st_size);
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            spdlog::warn("Failed to mmap index cache {}", path);
+            return false;
+        }
+        data_ = static_cast<const char*>(mapped);
+        length_ = length;
+
+        cache_header h;
+        std::memcpy(&h, data_, sizeof(h));
+        if (std::memcmp(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || h.version != VERSION ||
+            h.entry_size != sizeof(entry_record)) {
+            spdlog::warn("Index cache {} has an unknown format or version {}, ignoring it", path, h.version);
+            close();
+            return false;
+        }
+        if (h.strings_offset + h.strings_size > length_ ||
+            h.entries_offset + h.entry_count * sizeof(entry_record) > length_ ||
+            h.time_index_offset + h.time_index_count * sizeof(TimeIndex) > length_ ||
+            h.blob_offset + h.blob_size > length_ ||
+            h.entries_offset % 8 != 0 || h.time_index_offset % 8 != 0) {
+            spdlog::warn("Index cache {} is truncated", path);
+            close();
+            return false;
+        }
+        uint64_t checksum = util::MurMurHash64(data_ + h.strings_offset, h.strings_size, CACHE_SEED) ^
+            util::MurMurHash64(data_ + h.entries_offset, h.entry_count * sizeof(entry_record), CACHE_SEED) ^
+            util::MurMurHash64(data_ + h.blob_offset, h.blob_size, CACHE_SEED);
+        if (checksum != h.checksum) {
+            spdlog::warn("Index cache {} checksum mismatch, ignoring it", path);
+            close();
+            return false;
+        }
+        strings_ = data_ + h.strings_offset;
+        strings_size_ = h.strings_size;
+        entries_ = data_ + h.entries_offset;
+        entry_count_ = h.entry_count;
+        time_indexes_ = reinterpret_cast<const TimeIndex*>(data_ + h.time_index_offset);
+        time_index_count_ = h.time_index_count;
+        blob_ = data_ + h.blob_offset;
+        blob_size_ = h.blob_size;
+        checksum_ = h.checksum;
+
+        // bounds are checked once here so entry() can decode without checks
+        for (std::size_t i = 0; i < entry_count_; ++i) {
+            const entry_record* r = reinterpret_cast<const entry_record*>(entries_) + i;
+            bool ok = ref_valid(r->fullpath, strings_size_) && ref_valid(r->name, strings_size_) &&
+                      ref_valid(r->dir, strings_size_) && ref_valid(r->file_type, strings_size_) &&
+                      ref_valid(r->etag, strings_size_) && ref_valid(r->root_path, strings_size_) &&
+                      ref_valid(r->index_etag, strings_size_) &&
+                      r->time_index_first + r->time_index_count <= time_index_count_ &&
+                      r->points_offset + r->points_size <= blob_size_ &&
+                      r->filters_offset + r->filters_size <= blob_size_ &&
+                      r->tokens_offset + r->tokens_size <= blob_size_ &&
+                      r->stats_offset + r->stats_size <= blob_size_;
+            if (!ok) {
+                spdlog::warn("Index cache {} has an invalid entry {}, ignoring it", path, i);
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CacheEntry IndexCache::entry(std::size_t i) const {
+        const entry_record* r = reinterpret_cast<const entry_record*>(entries_) + i;
+        auto str = [this](const str_ref& ref) { return std::string_view(strings_ + ref.offset, ref.length); };
+        CacheEntry e;
+        e.fullpath = str(r->fullpath);
+        e.name = str(r->name);
+        e.dir = str(r->dir);
+        e.file_type = str(r->file_type);
+        e.etag = str(r->etag);
+        e.root_path = str(r->root_path);
+        e.size = r->size;
+        e.mtime = static_cast<std::time_t>(r->mtime);
+        e.inode = r->inode;
+        e.has_file_index = (r->flags & ENTRY_HAS_FILE_INDEX) != 0;
+        e.index_etag = str(r->index_etag);
+        e.last_index_time = static_cast<std::time_t>(r->last_index_time);
+        e.time_format = r->time_format;
+        e.time_offset = r->time_offset;
+        e.time_indexes = time_indexes_ + r->time_index_first;
+        e.time_index_count = r->time_index_count;
+        e.inflate_points = std::string_view(blob_ + r->points_offset, r->points_size);
+        e.head_hash = r->head_hash;
+        e.head_size = r->head_size;
+        e.block_filters = std::string_view(blob_ + r->filters_offset, r->filters_size);
+        e.block_tokens = std::string_view(blob_ + r->tokens_offset, r->tokens_size);
+        e.token_pattern_hash = r->token_pattern_hash;
+        e.block_stats = std::string_view(blob_ + r->stats_offset, r->stats_size);
+        return e;
+    }
+
+    bool IndexCache::write(const std::string& path, const std::vector<std::shared_ptr<FileInfo>>& files, uint64_t& checksum) {
+        string_table strings;
+        std::vector<entry_record> records;
+        records.reserve(files.size());
+        std::size_t total_time_indexes = 0;
+        for (const auto& fi : files) {
+            if (fi->file_index) total_time_indexes += fi->file_index->time_indexes.size();
+        }
+        std::vector<TimeIndex> time_indexes;
+        time_indexes.reserve(total_time_indexes);
+        std::string blob;
+
+        for (const auto& fi : files) {
+            entry_record r {};
+            r.fullpath = strings.add(fi->fullpath);
+            r.name = strings.add(fi->name);
+            r.dir = strings.intern(fi->dir);
+            r.file_type = strings.intern(fi->file_type);
+            r.etag = strings.add(fi->etag);
+            r.root_path = strings.intern(fi->root_path ? fi->root_path->path : std::string());
+            r.size = fi->size;
+            r.mtime = static_cast<int64_t>(fi->mtime);
+            r.inode = fi->inode;
+            r.time_format = TIME_FMT_NONE;
+            if (fi->file_index) {
+                const FileIndex& idx = *fi->file_index;
+                r.flags |= ENTRY_HAS_FILE_INDEX;
+                r.index_etag = strings.add(idx.index_etag);
+                r.last_index_time = static_cast<int64_t>(idx.last_index_time);
+                r.time_format = idx.time_format;
+                r.time_offset = idx.time_offset;
+                r.head_hash = idx.head_hash;
+                r.head_size = idx.head_size;
+                r.time_index_first = time_indexes.size();
+                r.time_index_count = idx.time_indexes.size();
+                time_indexes.insert(time_indexes.end(), idx.time_indexes.begin(), idx.time_indexes.end());
+                r.points_offset = blob.size();
+                encode_inflate_points(idx.inflate_points, blob);
+                r.points_size = blob.size() - r.points_offset;
+                r.filters_offset = blob.size();
+                encode_block_filters(idx.block_filters, idx.block_filter_words, 0, blob);
+                r.filters_size = blob.size() - r.filters_offset;
+                r.tokens_offset = blob.size();
+                encode_block_filters(idx.block_tokens, idx.block_token_hashes, 0, blob);
+                r.tokens_size = blob.size() - r.tokens_offset;
+                r.token_pattern_hash = idx.token_pattern_hash;
+                r.stats_offset = blob.size();
+                encode_block_stats(idx.block_stats, 0, blob);
+                r.stats_size = blob.size() - r.stats_offset;
+            }
+            records.push_back(r);
+        }
+        if (strings.data().size() > UINT32_MAX) {
+            spdlog::error("Index cache string table too large: {}", strings.data().size());
+            return false;
+        }
+
+        cache_header h {};
+        std::memcpy(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        h.version = VERSION;
+        h.entry_size = sizeof(entry_record);
+        h.entry_count = records.size();
+        h.strings_offset = sizeof(cache_header);
+        h.strings_size = strings.data().size();
+        h.entries_offset = align8(h.strings_offset + h.strings_size);
+        h.time_index_offset = h.entries_offset + records.size() * sizeof(entry_record);
+        h.time_index_count = time_indexes.size();
+        h.blob_offset = h.time_index_offset + time_indexes.size() * sizeof(TimeIndex);
+        h.blob_size = blob.size();
+        h.checksum = util::MurMurHash64(strings.data().data(), h.strings_size, CACHE_SEED) ^
+            util::MurMurHash64(records.data(), records.size() * sizeof(entry_record), CACHE_SEED) ^
+            util::MurMurHash64(blob.data(), blob.size(), CACHE_SEED);
+
+        const std::string tmp = path + ".tmp";
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            spdlog::error("Failed to open cache temp file for writing: {}", tmp);
+            return false;
+        }
+        static const char padding[8] = {0};
+        ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        ofs.write(strings.data().data(), static_cast<std::streamsize>(h.strings_size));
+        ofs.write(padding, static_cast<std::streamsize>(h.entries_offset - h.strings_offset - h.strings_size));
+        ofs.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(entry_record)));
+        ofs.write(reinterpret_cast<const char*>(time_indexes.data()), static_cast<std::streamsize>(time_indexes.size() * sizeof(TimeIndex)));
+        ofs.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+        ofs.close();
+        if (!ofs) {
+            spdlog::error("Failed to write cache temp file {}", tmp);
+            return false;
+        }
+
+        // atomic replace
+        std::error_code ec;
+        fs::rename(tmp, path, ec);
+        if (ec) {
+            spdlog::error("Failed to move cache temp file {} to {}: {}", tmp, path, ec.message());
+            return false;
+        }
+        checksum = h.checksum;
+        return true;
+    }
+
+    void IndexCache::encode_inflate_points(const std::vector<inflate_point>& points, std::string& out) {
+        for (const auto& p : points) {
+            put<uint64_t>(out, p.out_offset);
+            put<uint64_t>(out, p.in_offset);
+            put<uint32_t>(out, p.bits);
+            put_str(out, p.window);
+        }
+    }
+
+    bool IndexCache::decode_inflate_points(std::string_view data, std::vector<inflate_point>& out) {
+        out.clear();
+        payload_reader r(data.data(), data.size());
+        while (!r.done()) {
+            inflate_point p;
+            std::string_view window;
+            if (!r.get(p.out_offset) || !r.get(p.in_offset) || !r.get(p.bits) || !r.get_str(window) || p.bits > 7) {
+                out.clear();
+                return false;
+            }
+            p.window.assign(window.data(), window.size());
+            out.push_back(std::move(p));
+        }
+        return true;
+    }
+
+    void IndexCache::encode_block_filters(const std::vector<uint32_t>& offsets, const std::vector<uint64_t>& words, std::size_t first, std::string& out) {
+        for (std::size_t i = first; i + 1 < offsets.size(); ++i) {
+            const uint32_t count = offsets[i + 1] - offsets[i];
+            put<uint32_t>(out, count);
+            out.append(reinterpret_cast<const char*>(words.data() + offsets[i]), count * sizeof(uint64_t));
+        }
+    }
+
+    bool IndexCache::decode_block_filters(std::string_view data, std::vector<uint32_t>& offsets, std::vector<uint64_t>& words) {
+        if (offsets.empty()) offsets.push_back(static_cast<uint32_t>(words.size()));
+        payload_reader r(data.data(), data.size());
+        while (!r.done()) {
+            uint32_t count = 0;
+            if (!r.get(count) || static_cast<std::size_t>(data.size()) / sizeof(uint64_t) < count) return false;
+            const std::size_t begin = words.size();
+            words.resize(begin + count);
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!r.get(words[begin + i])) return false;
+            }
+            offsets.push_back(static_cast<uint32_t>(words.size()));
+        }
+        return true;
+    }
+
+    void IndexCache::encode_block_stats(const std::vector<BlockStats>& stats, std::size_t first, std::string& out) {
+        for (std::size_t i = first; i < stats.size(); ++i) {
+            put<uint64_t>(out, stats[i].bytes);
+            put<uint32_t>(out, stats[i].lines);
+            put<uint32_t>(out, stats[i].errors);
+            put<uint32_t>(out, stats[i].warns);
+            put<uint32_t>(out, stats[i].infos);
+        }
+    }
+
+    bool IndexCache::decode_block_stats(std::string_view data, std::vector<BlockStats>& stats) {
+        payload_reader r(data.data(), data.size());
+        while (!r.done()) {
+            BlockStats s;
+            if (!r.get(s.bytes) || !r.get(s.lines) || !r.get(s.errors) || !r.get(s.warns) || !r.get(s.infos)) return false;
+            stats.push_back(s);
+        }
+        return true;
+    }
+
+    bool IndexJournal::create(const std::string& path, uint64_t base_checksum) {
+        journal_header h {};
+        std::memcpy(h.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        h.version = VERSION;
+        h.base_checksum = base_checksum;
+
+        const std::string tmp = path + ".tmp";
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            spdlog::error("Failed to open journal temp file for writing: {}", tmp);
+            return false;
+        }
+        ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        ofs.close();
+        if (!ofs) {
+            spdlog::error("Failed to write journal temp file {}", tmp);
+            return false;
+        }
+        std::error_code ec;
+        fs::rename(tmp, path, ec);
+        if (ec) {
+            spdlog::error("Failed to move journal temp file {} to {}: {}", tmp, path, ec.message());
+            return false;
+        }
+        return true;
+    }
+
+    void IndexJournal::encode_file(std::string& out, const FileInfo& info) {
+        encode_index_record(out, RECORD_FILE, info, 0);
+    }
+
+    void IndexJournal::encode_append(std::string& out, const FileInfo& info, std::size_t first) {
+        encode_index_record(out, RECORD_APPEND, info, first);
+    }
+
+    void IndexJournal::encode_remove(std::string& out, const std::string& fullpath) {
+        const std::size_t begin = out.size();
+        out.resize(begin + sizeof(record_header));
+        put_str(out, fullpath);
+        record_header h {RECORD_REMOVE, static_cast<uint32_t>(out.size() - begin - sizeof(record_header)), 0};
+        h.checksum = util::MurMurHash64(out.data() + begin + sizeof(record_header), h.length, CACHE_SEED);
+        std::memcpy(&out[begin], &h, sizeof(h));
+    }
+
+    bool IndexJournal::append(const std::string& path, const std::string& records) {
+        // no O_CREAT, a journal without its header is never started here
+        int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd < 0) {
+            spdlog::warn("Failed to open index journal {}: {}", path, std::strerror(errno));
+            return false;
+        }
+        const char* p = records.data();
+        std::size_t left = records.size();
+        while (left > 0) {
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                spdlog::warn("Failed to append to index journal {}: {}", path, std::strerror(errno));
+                ::close(fd);
+                return false;
+            }
+            p += n;
+            left -= static_cast<std::size_t>(n);
+        }
+        ::close(fd);
+        return true;
+    }
+
+    bool IndexJournal::replay(const std::string& path, uint64_t base_checksum, const record_callback& on_record) {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open()) return false;
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+        journal_header jh {};
+        if (data.size() < sizeof(jh)) return false;
+        std::memcpy(&jh, data.data(), sizeof(jh));
+        if (std::memcmp(jh.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || jh.version != VERSION) {
+            spdlog::warn("Index journal {} has an unknown format or version {}, ignoring it", path, jh.version);
+            return false;
+        }
+        if (jh.base_checksum != base_checksum) {
+            spdlog::warn("Index journal {} belongs to another index cache, ignoring it", path);
+            return false;
+        }
+
+        std::vector<TimeIndex> time_indexes;
+        std::size_t pos = sizeof(jh);
+        std::size_t count = 0;
+        while (data.size() - pos >= sizeof(record_header)) {
+            record_header rh {};
+            std::memcpy(&rh, data.data() + pos, sizeof(rh));
+            const char* payload = data.data() + pos + sizeof(rh);
+            if (data.size() - pos - sizeof(rh) < rh.length ||
+                util::MurMurHash64(payload, rh.length, CACHE_SEED) != rh.checksum) {
+                spdlog::warn("Index journal {} has a torn record at {}, replayed {} records", path, pos, count);
+                return true;
+            }
+            pos += sizeof(rh) + rh.length;
+
+            payload_reader r(payload, rh.length);
+            Record rec{};
+            rec.type = static_cast<RecordType>(rh.type);
+            CacheEntry& e = rec.entry;
+            bool ok = r.get_str(e.fullpath);
+            if (ok && rh.type != RECORD_REMOVE) {
+                int64_t last_index_time = 0;
+                int32_t time_format = 0;
+                uint64_t n = 0;
+                ok = r.get_str(e.root_path) && r.get(e.inode) && r.get_str(e.index_etag) &&
+                     r.get(last_index_time) && r.get(time_format) && r.get(e.time_offset) &&
+                     r.get(e.head_hash) && r.get(e.head_size) &&
+                     r.get(rec.first) && r.get(n) && r.get_time_indexes(n, time_indexes) &&
+                     r.get_str(e.inflate_points) && r.get_str(e.block_filters) &&
+                     r.get(e.token_pattern_hash) && r.get_str(e.block_tokens) && r.get_str(e.block_stats);
+                e.has_file_index = true;
+                e.last_index_time = static_cast<std::time_t>(last_index_time);
+                e.time_format = time_format;
+                e.time_indexes = time_indexes.data();
+                e.time_index_count = time_indexes.size();
+            }
+            if (!ok || rh.type < RECORD_FILE || rh.type > RECORD_REMOVE) {
+                spdlog::warn("Index journal {} has an invalid record at {}, replayed {} records", path, pos, count);
+                return true;
+            }
+            on_record(rec);
+            ++count;
+        }
+        return true;
+    }
+
+    std::size_t IndexJournal::merge(const IndexCache& base, const std::string& path, const std::function<void(const CacheEntry&)>& on_entry) {
+        // files touched by the journal, owned copies since record views die with the replay
+        struct merged_file {
+            std::string root_path;
+            uint64_t inode{0};
+            std::string index_etag;
+            std::time_t last_index_time{0};
+            int time_format{TIME_FMT_NONE};
+            uint32_t time_offset{0};
+            std::vector<TimeIndex> time_indexes;
+            std::string inflate_points;
+            uint64_t head_hash{0};
+            uint32_t head_size{0};
+            std::vector<uint32_t> filter_offsets;
+            std::vector<uint64_t> filter_words;
+            std::string block_filters;
+            uint64_t token_pattern_hash{0};
+            std::vector<uint32_t> token_offsets;
+            std::vector<uint64_t> token_hashes;
+            std::string block_tokens;
+            std::vector<BlockStats> stats;
+            std::string block_stats;
+            bool removed{false};
+        };
+        std::unordered_map<std::string_view, std::size_t> base_pos;
+        for (std::size_t i = 0; i < base.size(); ++i) base_pos.emplace(base.entry(i).fullpath, i);
+
+        std::unordered_map<std::string, merged_file> touched;
+        std::size_t count = 0;
+        replay(path, base.checksum(), [&](const Record& rec) {
+            ++count;
+            const CacheEntry& e = rec.entry;
+            auto it = touched.find(std::string(e.fullpath));
+            if (rec.type == RECORD_REMOVE) {
+                if (it == touched.end()) it = touched.emplace(std::string(e.fullpath), merged_file()).first;
+                it->second = merged_file();
+                it->second.removed = true;
+                return;
+            }
+            if (it == touched.end()) {
+                it = touched.emplace(std::string(e.fullpath), merged_file()).first;
+                auto b = base_pos.find(e.fullpath);
+                if (rec.type == RECORD_APPEND && b != base_pos.end()) {
+                    CacheEntry be = base.entry(b->second);
+                    it->second.time_indexes.assign(be.time_indexes, be.time_indexes + be.time_index_count);
+                    IndexCache::decode_block_filters(be.block_filters, it->second.filter_offsets, it->second.filter_words);
+                    IndexCache::decode_block_filters(be.block_tokens, it->second.token_offsets, it->second.token_hashes);
+                    IndexCache::decode_block_stats(be.block_stats, it->second.stats);
+                }
+            }
+            merged_file& f = it->second;
+            if (rec.type == RECORD_FILE) {
+                f.time_indexes.clear();
+            } else if (f.removed || rec.first > f.time_indexes.size()) {
+                // the append does not continue what we have, leave the file to be re-indexed
+                f = merged_file();
+                f.removed = true;
+                return;
+            }
+            f.removed = false;
+            f.root_path.assign(e.root_path.data(), e.root_path.size());
+            f.inode = e.inode;
+            f.index_etag.assign(e.index_etag.data(), e.index_etag.size());
+            f.last_index_time = e.last_index_time;
+            f.time_format = e.time_format;
+            f.time_offset = e.time_offset;
+            f.inflate_points.assign(e.inflate_points.data(), e.inflate_points.size());
+            f.head_hash = e.head_hash;
+            f.head_size = e.head_size;
+            f.time_indexes.resize(rec.first);
+            f.time_indexes.insert(f.time_indexes.end(), e.time_indexes, e.time_indexes + e.time_index_count);
+            merge_blocks(rec.type, rec.first, e.block_filters, f.filter_offsets, f.filter_words);
+            if (rec.type == RECORD_APPEND && f.token_pattern_hash != e.token_pattern_hash) {
+                f.token_offsets.clear();
+                f.token_hashes.clear();
+            }
+            f.token_pattern_hash = e.token_pattern_hash;
+            merge_blocks(rec.type, rec.first, e.block_tokens, f.token_offsets, f.token_hashes);
+            merge_stats(rec.type, rec.first, e.block_stats, f.stats);
+        });
+
+        for (std::size_t i = 0; i < base.size(); ++i) {
+            CacheEntry e = base.entry(i);
+            if (!touched.empty() && touched.count(std::string(e.fullpath))) continue;
+            on_entry(e);
+        }
+        for (auto& kv : touched) {
+            merged_file& f = kv.second;
+            if (f.removed) continue;
+            IndexCache::encode_block_filters(f.filter_offsets, f.filter_words, 0, f.block_filters);
+            IndexCache::encode_block_filters(f.token_offsets, f.token_hashes, 0, f.block_tokens);
+            IndexCache::encode_block_stats(f.stats, 0, f.block_stats);
+            CacheEntry e;
+            e.fullpath = kv.first;
+            e.root_path = f.root_path;
+            e.inode = f.inode;
+            e.has_file_index = true;
+            e.index_etag = f.index_etag;
+            e.last_index_time = f.last_index_time;
+            e.time_format = f.time_format;
+            e.time_offset = f.time_offset;
+            e.time_indexes = f.time_indexes.data();
+            e.time_index_count = f.time_indexes.size();
+            e.inflate_points = f.inflate_points;
+            e.head_hash = f.head_hash;
+            e.head_size = f.head_size;
+            e.block_filters = f.block_filters;
+            e.token_pattern_hash = f.token_pattern_hash;
+            e.block_tokens = f.block_tokens;
+            e.block_stats = f.block_stats;
+            on_entry(e);
+        }
+        return count;
+    }
+}   // namespace drlog
@@ -0,0 +1,130 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <ctime>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include "indexer.hpp"
+
+namespace drlog {
+
+    // one file of a mapped cache; views point into the mapping and live as long as the IndexCache
+    struct CacheEntry {
+        std::string_view fullpath;
+        std::string_view name;
+        std::string_view dir;
+        std::string_view file_type;
+        std::string_view etag;
+        std::string_view root_path;
+        uint64_t size{0};
+        std::time_t mtime{0};
+        uint64_t inode{0};
+        bool has_file_index{false};
+        std::string_view index_etag;
+        std::time_t last_index_time{0};
+        int time_format{TIME_FMT_NONE};
+        uint32_t time_offset{0};
+        const TimeIndex* time_indexes{nullptr};
+        std::size_t time_index_count{0};
+        // FileIndex::inflate_points in the encoding of IndexCache::encode_inflate_points
+        std::string_view inflate_points;
+        uint64_t head_hash{0};
+        uint32_t head_size{0};
+        // FileIndex::block_filters in the encoding of IndexCache::encode_block_filters
+        std::string_view block_filters;
+        // FileIndex::block_tokens in the same encoding
+        std::string_view block_tokens;
+        uint64_t token_pattern_hash{0};
+        // FileIndex::block_stats in the encoding of IndexCache::encode_block_stats
+        std::string_view block_stats;
+    };
+
+    // binary index cache: header, string table, fixed size entry records, one packed
+    // TimeIndex array and a blob of inflate points, block filters, token values and stats.
+    // The file is mmap'd read-only and entries are decoded on access.
+    // Integers are stored in host byte order, the cache never leaves the agent host.
+    class IndexCache {
+    public:
+        static constexpr uint32_t VERSION = 6;
+
+        IndexCache() = default;
+        ~IndexCache();
+        IndexCache(const IndexCache&) = delete;
+        IndexCache& operator=(const IndexCache&) = delete;
+
+        // map and validate a cache file, false if missing, truncated, corrupt or another version
+        bool open(const std::string& path);
+        void close();
+        std::size_t size() const { return entry_count_; }
+        CacheEntry entry(std::size_t i) const;
+
+        // checksum of the mapped cache, a journal is only replayed on the base it was started for
+        uint64_t checksum() const { return checksum_; }
+
+        // write files to path through a temp file and rename, checksum receives the new file's checksum
+        static bool write(const std::string& path, const std::vector<std::shared_ptr<FileInfo>>& files, uint64_t& checksum);
+
+        static void encode_inflate_points(const std::vector<inflate_point>& points, std::string& out);
+        static bool decode_inflate_points(std::string_view data, std::vector<inflate_point>& out);
+        // FileIndex::block_filters from block first on, a word count and the words per block
+        static void encode_block_filters(const std::vector<uint32_t>& offsets, const std::vector<uint64_t>& words, std::size_t first, std::string& out);
+        // append the encoded blocks to the offsets and words of FileIndex::block_filters
+        static bool decode_block_filters(std::string_view data, std::vector<uint32_t>& offsets, std::vector<uint64_t>& words);
+        // FileIndex::block_stats from block first on
+        static void encode_block_stats(const std::vector<BlockStats>& stats, std::size_t first, std::string& out);
+        // append the encoded stats to stats
+        static bool decode_block_stats(std::string_view data, std::vector<BlockStats>& stats);
+
+    private:
+        const char* data_{nullptr};
+        std::size_t length_{0};
+        std::size_t entry_count_{0};
+        const char* strings_{nullptr};
+        std::size_t strings_size_{0};
+        const char* entries_{nullptr};
+        const TimeIndex* time_indexes_{nullptr};
+        std::size_t time_index_count_{0};
+        const char* blob_{nullptr};
+        std::size_t blob_size_{0};
+        uint64_t checksum_{0};
+    };
+
+    // append-only log of index changes made after the base cache was written:
+    // a full index for a new or rewritten file, the new entries of a growing file, a removed file.
+    // Each record carries its own checksum, replay stops at the first torn or corrupt record.
+    class IndexJournal {
+    public:
+        static constexpr uint32_t VERSION = 6;
+        enum RecordType : uint32_t {
+            RECORD_FILE = 1,
+            RECORD_APPEND = 2,
+            RECORD_REMOVE = 3,
+        };
+        struct Record {
+            RecordType type{RECORD_FILE};
+            // RECORD_APPEND: number of entries kept from before, the new ones follow them
+            uint64_t first{0};
+            // time_indexes of an append hold only the new entries, its block_filters and block_tokens
+            // the blocks from first - 1 on, the block ending at the first new entry changed too;
+            // block_stats start one block earlier (see first_stats_block)
+            CacheEntry entry;
+        };
+        using record_callback = std::function<void(const Record&)>;
+
+        // replace the journal at path with an empty one that belongs to the base cache with base_checksum
+        static bool create(const std::string& path, uint64_t base_checksum);
+        // replay the records of the journal at path in order, false if it is missing or belongs to another base
+        static bool replay(const std::string& path, uint64_t base_checksum, const record_callback& on_record);
+        // the entries of base with the journal at path applied, returns the number of records replayed
+        static std::size_t merge(const IndexCache& base, const std::string& path, const std::function<void(const CacheEntry&)>& on_entry);
+
+        static void encode_file(std::string& out, const FileInfo& info);
+        static void encode_append(std::string& out, const FileInfo& info, std::size_t first);
+        static void encode_remove(std::string& out, const std::string& fullpath);
+        // append encoded records with a single write
+        static bool append(const std::string& path, const std::string& records);
+    };
+}   // namespace drlog
@@ -3,13 +3,14 @@
 #include <iostream>
 #include <mutex>
 #include <chrono>
-#include <type_traits>
 #include <sstream>
 #include <iomanip>
 #include <spdlog/spdlog.h>
 #include <fstream>
 #include <map>
+#include <unordered_set>
 #include <algorithm>
+#include <cctype>
 #include <zlib.h>
 #include <cstring>
 #include <ctime>
@@ -20,8 +21,12 @@
 #include "src/util/util.hpp"
 #include <sys/mman.h>
 #include <fcntl.h>
-#include "libs/date/date.h"
+#include "util/time_parser.hpp"
 #include "util/igzip.hpp"
+#include "util/line_scanner.hpp"
+#include "util/token_filter.hpp"
+#include "index_cache.hpp"
+#include "trigram_index.hpp"
 
 namespace drlog {
     namespace fs = std::filesystem;
@@ -29,16 +34,10 @@ namespace drlog {
 
     FileIndexer::FileIndexer(unsigned scan_interval_secs)
         : running_(false), scan_interval_seconds_(scan_interval_secs) {
-            time_formats_ = {
-                {"%Y-%m-%d %H:%M:%S", boost::regex(R"(\d{4}-\d{2}-\d{2} \d{2}:\d{2}:\d{2})")},
-                {"%Y/%m/%d %H:%M:%S", boost::regex(R"(\d{4}/\d{2}/\d{2} \d{2}:\d{2}:\d{2})")},
-                {"%Y-%m-%dT%H:%M:%S", boost::regex(R"(\d{4}-\d{2}-\d{2}T\d{2}:\d{2}:\d{2})")},
-                {"%d/%b/%Y:%H:%M:%S", boost::regex(R"(\d{2}/[A-Za-z]{3}/\d{4}:\d{2}:\d{2}:\d{2})")},
-                {"%b %d %H:%M:%S", boost::regex(R"([A-Za-z]{3} \d{2} \d{2}:\d{2}:\d{2})")}
-            };
             // ensure indexing policy has sane defaults to avoid uninitialized use
             index_interval_seconds_ = 300;
             index_count_threshold_ = 50000;
+            snapshot_.store(std::make_shared<const IndexSnapshot>());
         }
 
     FileIndexer::~FileIndexer() {
@@ -47,7 +46,9 @@ namespace drlog {
 
     // replace add_root implementation to accept time_format_regex
     void FileIndexer::add_root(const std::string& root_path, const std::string& filename_pattern, 
-        const std::string& time_format_pattern, const std::string& path_pattern, const std::string& prefix_pattern, int max_days) {
+        const std::string& time_format_pattern, const std::string& path_pattern, const std::string& prefix_pattern, int max_days,
+        const std::string& time_zone_name, uint64_t trigram_budget, const std::string& token_pattern, bool token_lookup,
+        file_read_mode read_mode) {
         try {
              std::shared_ptr<RootPath> rp = std::make_shared<RootPath>();
              rp->path = root_path;
@@ -60,17 +61,35 @@ namespace drlog {
             }
             if (!time_format_pattern.empty()) {
                 rp->time_format_pattern = time_format_pattern;
-                try { rp->time_format_regex = boost::regex(time_format_pattern); }
-                catch (const std::exception& e) {
-                    spdlog::warn("Bad time format pattern '{}': {}", time_format_pattern, e.what());
+                auto tp = std::make_shared<time_pattern>();
+                if (tp->compile(time_format_pattern)) {
+                    rp->time_format = tp;
+                } else {
+                    spdlog::warn("Bad time format pattern '{}', using built-in layouts", time_format_pattern);
                 }
             }
+            rp->zone = time_zone::load(time_zone_name.empty() ? "local" : time_zone_name);
+            if (!rp->zone) {
+                spdlog::warn("Unknown time zone '{}' for root {}, using local time", time_zone_name, root_path);
+                rp->zone = time_zone::local();
+            }
             if (!path_pattern.empty()) {
                 rp->path_pattern = path_pattern;
                 try { rp->path_regex = boost::regex(path_pattern); }
                 catch (const std::exception& e) {
                     spdlog::warn("Bad path pattern '{}': {}", path_pattern, e.what());
                 }
+                // a leading negative lookahead over the whole path excludes entire subtrees
+                static const boost::regex exclude_shape("^\\^?\\(\\?!(.+)\\)\\.\\*\\$?$");
+                boost::smatch m;
+                if (boost::regex_match(path_pattern, m, exclude_shape)) {
+                    try {
+                        rp->path_exclude_regex = boost::regex("(?:" + m[1].str() + ")");
+                        rp->has_path_exclude = true;
+                    } catch (const std::exception& e) {
+                        spdlog::debug("Path pattern '{}' exclusion not usable for pruning: {}", path_pattern, e.what());
+                    }
+                }
             }
             if (!prefix_pattern.empty()) {
                 rp->prefix_pattern = prefix_pattern;
@@ -79,7 +98,20 @@ namespace drlog {
                     spdlog::warn("Bad prefix pattern '{}': {}", prefix_pattern, e.what());
                 }
             }
+            if (!token_pattern.empty()) {
+                rp->token_pattern = token_pattern;
+                try {
+                    rp->token_regex = boost::regex(token_pattern);
+                    rp->token_pattern_hash = util::MurMurHash64(token_pattern.data(), token_pattern.size(), HEAD_FINGERPRINT_SEED);
+                    rp->has_token_pattern = true;
+                } catch (const std::exception& e) {
+                    spdlog::warn("Bad token pattern '{}': {}", token_pattern, e.what());
+                }
+            }
+            rp->token_lookup = rp->has_token_pattern && token_lookup;
             rp->max_days = max_days;
+            rp->trigram_budget = trigram_budget;
+            rp->read_mode = read_mode;
             {
                 std::unique_lock<std::shared_mutex> lock(mutex_);
                 roots_.emplace_back(std::move(rp));
@@ -90,14 +122,18 @@ namespace drlog {
     }
 
     void FileIndexer::init_indexes() {
+        //step0 watch the roots before scanning them, so nothing written meanwhile is missed
+        reset_watcher();
         //step1 scan the roots
-        for (const auto& rp : roots_) scan_root(rp);
+        scan_roots();
+        last_full_scan_ = std::time(nullptr);
         //step2 load existing index from cache on startup
         load_index_from_cache();
-        //step3 update file index
-        update_file_index();
-        //step4 remove unused indexes
+        //step3 remove unused indexes, and move the ones past max_days out of memory
         remove_unused_indexes();
+        evict_cold_indexes();
+        //step4 update file index
+        update_file_index();
         //step5 write to cache
         save_index_to_cache();
     }
@@ -117,13 +153,32 @@ namespace drlog {
     void FileIndexer::scan_loop() {
         while (running_) {
             try {
-                //step1 scan the roots
-                for (const auto& rp : roots_) scan_root(rp);
-                //step2 update file index
+                //step1 apply the inotify events, or scan the roots when they can not be trusted
+                bool full_scan = !watcher_ || !watcher_->complete() ||
+                    std::time(nullptr) - last_full_scan_ >= static_cast<std::time_t>(full_scan_interval_seconds_);
+                FileChanges changes;
+                if (!full_scan && (!watcher_->poll(changes) || changes.overflow)) {
+                    // events were lost, the watched directory set may be stale too
+                    reset_watcher();
+                    full_scan = true;
+                }
+                if (full_scan) {
+                    scan_roots();
+                    last_full_scan_ = std::time(nullptr);
+                } else {
+                    apply_file_changes(changes);
+                }
+                //step2 remove unused indexes, deletes are seen as events in between;
+                //before indexing, so a renamed file finds the index of its old name
+                if (full_scan) {
+                    remove_unused_indexes();
+                    evict_cold_indexes();
+                }
+                //step3 update file index
                 update_file_index();
-                //step3 remove unused indexes
-                remove_unused_indexes();
-                //step4 write to cache
+                //step4 build the trigram indexes of files that stopped changing
+                update_trigram_indexes();
+                //step5 write to cache
                 save_index_to_cache();
             } catch (const std::exception& e) {
                 spdlog::error("Indexer scan error: {}", e.what());
@@ -133,147 +188,372 @@ namespace drlog {
         }
     }
 
-    // Updated signature: accept RootPath const&
-    void FileIndexer::scan_root(const std::shared_ptr<RootPath> rp) {
+    // full pass over every root, directories are listed on the worker pool
+    void FileIndexer::scan_roots() {
+        double d1 = util::get_micro_timestamp();
+        std::atomic<std::size_t> files{0};
+        dir_scanner_.scan(roots_, worker_pool(), [this, &files](const std::shared_ptr<RootPath>& rp, const std::string& path, const struct stat& st) {
+            update_file_info(rp, path, st);
+            files++;
+        });
+        publish_snapshot();
+        double d2 = util::get_micro_timestamp();
+        spdlog::info("Scanned {} roots: files={} cached_dirs={} time_cost={}", roots_.size(), files.load(), dir_scanner_.cached_dirs(), (d2-d1)/1000.0);
+    }
+
+    // check one path reported by the watcher against its root
+    void FileIndexer::scan_file(const std::shared_ptr<RootPath>& rp, const std::string& path) {
         try {
-            const std::string& root = rp->path;
-            boost::smatch matches;
-            if (!fs::exists(root) || !fs::is_directory(root)) return;
-            for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied);
-                it != fs::recursive_directory_iterator(); ++it)
-            {
-                try {
-                    const auto& p = it->path();
-                    // skip symbolic links
-                    if (fs::is_symlink(p)) continue;
-
-                    // get inode via POSIX stat
-                    struct stat st {};
-                    // use string() to obtain a stable char* for stat
-                    if (stat(p.string().c_str(), &st) == 0) {
-                        // set inode if available
-                        // FileInfo::inode is uint64_t
-                        // st.st_ino is implementation-defined width; cast to uint64_t
-                    } else {
-                        // if stat fails, skip this entry
-                        continue;
-                    }
-                    if (!fs::is_regular_file(p)) continue;
-                    
-                    std::string filename = p.filename().string();
-                    //match path and name pattern
-                    try {
-                        if (!rp->path_pattern.empty() && !boost::regex_match(p.string(), matches, rp->path_regex)) continue;
-                        if (!rp->filename_pattern.empty() && !boost::regex_match(filename, matches, rp->filename_regex)) continue;
-                    } catch (const boost::regex_error& e) {
-                        spdlog::warn("Regex error for path {}: {}", rp->path, e.what());
-                        continue;
-                    }
-                    
-                    
-                    std::shared_ptr<FileInfo> info = std::make_shared<FileInfo>();
-                    info->name = filename;
-                    info->dir = p.parent_path().string();
-                    info->fullpath = p.string();
-                    info->size = static_cast<std::uint64_t>(fs::file_size(p));
-                    // set inode from stat result
-                    info->inode = static_cast<uint64_t>(st.st_ino);
-
-                    // portable conversion from filesystem::file_time_type to system_clock::time_point
-                    auto ftime = fs::last_write_time(p);
-                    using file_time_type = decltype(ftime);
-                    using file_clock = file_time_type::clock;
-                    std::chrono::system_clock::time_point sctp;
-                    if constexpr (std::is_same_v<file_clock, std::chrono::system_clock>) {
-                        sctp = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(ftime.time_since_epoch()));
-                    } else {
-                        auto now_file = file_clock::now();
-                        auto now_sys = std::chrono::system_clock::now();
-                        auto diff = ftime - now_file; // file_clock::duration
-                        auto diff_sys = std::chrono::duration_cast<std::chrono::system_clock::duration>(diff);
-                        sctp = now_sys + diff_sys;
-                    }
-                    info->mtime = std::chrono::system_clock::to_time_t(sctp);
-                    // determine file type based on suffix
-                    std::string lower = filename;
-                    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
-                    if (lower.size() >= 3 && lower.substr(lower.size()-3) == ".gz") {
-                        info->file_type = "gzip";
-                    } else {
-                        info->file_type = "text";
-                    }
-                    // compute cheap etag using util helper (size + mtime)
-                    info->etag = util::etag_from_size_mtime(info->size, info->mtime);
-                    info->root_path = rp;
+            // skip symbolic links and anything not a regular file
+            struct stat st {};
+            if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return;
+            if (!DirScanner::dir_may_match(*rp, fs::path(path).parent_path().string())) return;
+            if (!DirScanner::file_matches(*rp, path, fs::path(path).filename().string())) return;
+            update_file_info(rp, path, st);
+        } catch (const std::exception& e) {
+            // skip individual file errors
+            spdlog::error("scan_root entry error: {}", e.what());
+        }
+    }
 
-                    // insert or update under unique lock
-                    {
-                        std::unique_lock<std::shared_mutex> lock(mutex_);
-                        auto itmap = index_.find(info->fullpath);
-                        if (itmap == index_.end() || itmap->second->inode != info->inode) {
-                            index_[info->fullpath] = info;
-                            spdlog::info("Indexed new file: {} inode={}", info->fullpath, info->inode);
-                        } else {
-                            if (itmap->second->size != info->size || itmap->second->mtime != info->mtime) {
-                                info->file_index = itmap->second->file_index; // preserve existing file_index
-                                itmap->second = info; // update
-                                spdlog::info("Updated file info: {} inode={}", info->fullpath, info->inode);
-                            } else {
-                                // no change
-                                spdlog::debug("No change for file: {} inode={}", info->fullpath, info->inode);
-                            }
-                        }
+    // no write for the root's max_days, and no log line that recent in the index when there is one
+    static bool is_cold(const FileInfo& info, std::time_t now) {
+        if (!info.root_path || info.root_path->max_days <= 0) return false;
+        const std::time_t cutoff = now - static_cast<std::time_t>(info.root_path->max_days) * 24 * 3600;
+        if (info.mtime >= cutoff) return false;
+        const FileIndex* idx = info.file_index.get();
+        return !idx || idx->time_indexes.empty() || static_cast<std::time_t>(idx->time_indexes.back().timestamp) < cutoff;
+    }
+
+    // insert or update the FileInfo of a matching regular file
+    void FileIndexer::update_file_info(const std::shared_ptr<RootPath>& rp, const std::string& path, const struct stat& st) {
+        {
+            // most files did not change since the last pass
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto itmap = index_.find(path);
+            if (itmap != index_.end() && itmap->second->inode == static_cast<uint64_t>(st.st_ino) &&
+                itmap->second->size == static_cast<std::uint64_t>(st.st_size) && itmap->second->mtime == st.st_mtim.tv_sec) {
+                return;
+            }
+        }
+        const fs::path p(path);
+        std::string filename = p.filename().string();
+        std::shared_ptr<FileInfo> info = std::make_shared<FileInfo>();
+        info->name = filename;
+        info->dir = p.parent_path().string();
+        info->fullpath = p.string();
+        info->size = static_cast<std::uint64_t>(st.st_size);
+        // st.st_ino is implementation-defined width; cast to uint64_t
+        info->inode = static_cast<uint64_t>(st.st_ino);
+        info->mtime = st.st_mtim.tv_sec;
+        info->file_type = file_type_of(filename);
+        // compute cheap etag using util helper (size + mtime)
+        info->etag = util::etag_from_size_mtime(info->size, info->mtime);
+        info->root_path = rp;
+        // too old to be indexed, searches build its index on demand
+        if (is_cold(*info, std::time(nullptr))) {
+            info->cold = true;
+            info->end_time = static_cast<uint64_t>(info->mtime);
+        }
+
+        // insert or update under unique lock
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            auto itmap = index_.find(info->fullpath);
+            if (itmap == index_.end() || itmap->second->inode != info->inode) {
+                // the file that had this name may live on under another one
+                if (itmap != index_.end()) detach_file_info(itmap->second);
+                index_[info->fullpath] = info;
+                spdlog::info("Indexed new file: {} inode={}", info->fullpath, info->inode);
+            } else {
+                if (itmap->second->size != info->size || itmap->second->mtime != info->mtime) {
+                    info->file_index = itmap->second->file_index; // preserve existing file_index
+                    itmap->second = info; // update
+                    spdlog::info("Updated file info: {} inode={}", info->fullpath, info->inode);
+                } else {
+                    // no change
+                    spdlog::debug("No change for file: {} inode={}", info->fullpath, info->inode);
+                }
+            }
+        }
+    }
+
+    void FileIndexer::apply_file_changes(const FileChanges& changes) {
+        if (!changes.removed_dirs.empty()) {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            for (const auto& dir : changes.removed_dirs) {
+                const std::string prefix = dir + "/";
+                for (auto it = index_.begin(); it != index_.end(); ) {
+                    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                        spdlog::info("Removing index for file under removed dir: {}", it->first);
+                        detach_file_info(it->second);
+                        it = index_.erase(it);
+                    } else {
+                        ++it;
                     }
-                } catch (const std::exception& e) {
-                    // skip individual file errors
-                    spdlog::error("scan_root entry error: {}", e.what());
                 }
             }
-        } catch (const std::exception& e) {
-            spdlog::error("scan_root error for {}: {}", rp->path, e.what());
         }
+        for (const auto& [path, root_id] : changes.paths) {
+            if (root_id >= roots_.size()) continue;
+            std::error_code ec;
+            if (!fs::exists(path, ec)) {
+                std::unique_lock<std::shared_mutex> lock(mutex_);
+                auto it = index_.find(path);
+                if (it != index_.end()) {
+                    spdlog::info("Removing index for deleted file: {}", path);
+                    detach_file_info(it->second);
+                    index_.erase(it);
+                }
+                continue;
+            }
+            scan_file(roots_[root_id], path);
+        }
+        publish_snapshot();
+        spdlog::debug("Applied {} file change events, {} removed dirs", changes.paths.size(), changes.removed_dirs.size());
+    }
+
+    void FileIndexer::reset_watcher() {
+        watcher_ = std::make_unique<FileWatcher>();
+        for (std::size_t i = 0; i < roots_.size(); ++i) {
+            std::shared_ptr<RootPath> rp = roots_[i];
+            auto dir_filter = [rp](const std::string& dir) { return DirScanner::dir_may_match(*rp, dir); };
+            if (!watcher_->add_tree(rp->path, i, dir_filter)) {
+                spdlog::warn("Not every directory of {} is watched, using full scans every {}s", roots_[i]->path, scan_interval_seconds_);
+            }
+        }
+        spdlog::info("Watching {} directories for changes", watcher_->watch_count());
     }
 
     void FileIndexer::update_file_index() {
         updated_index_count_ = 0;
-        for (auto& kv : index_) {
-            const std::string& path = kv.first;
-            std::shared_ptr<FileInfo> info = kv.second;
-            bool need_update = false;
-            if (!info->file_index) {
-                need_update = true;
-            } else if (info->file_index->index_etag != info->etag) {
-                need_update = true;
+        {
+            // a renamed or compressed file shows up within a few passes, or not at all
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            const std::time_t now = std::time(nullptr);
+            for (auto it = detached_.begin(); it != detached_.end(); ) {
+                if (now - it->second.detached_at > DETACHED_TTL_SECONDS) it = detached_.erase(it);
+                else ++it;
+            }
+        }
+        // collect the changed files under the lock, scan_root may modify index_ meanwhile
+        std::vector<std::shared_ptr<FileInfo>> changed;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            for (const auto& kv : index_) {
+                const std::shared_ptr<FileInfo>& info = kv.second;
+                if (info->cold) continue;
+                if (!info->file_index || info->file_index->index_etag != info->etag) {
+                    changed.push_back(info);
+                }
             }
-            if (!need_update) continue;
+        }
+        if (changed.empty()) return;
+        thread_pool* pool = worker_pool();
+        double d1 = util::get_micro_timestamp();
+        for (const auto& info : changed) {
+            pool->submit([this, info]{ update_one_file_index(info); });
+        }
+        pool->wait();
+        publish_snapshot();
+        double d2 = util::get_micro_timestamp();
+        spdlog::info("Updated {} of {} changed file indexes time_cost={}", updated_index_count_.load(), changed.size(), (d2-d1)/1000.0);
+    }
 
-            try {
-                // choose handler based on suffix
-                std::vector<TimeIndex> outputs;
-                if (info->file_type == "gzip") {
-                    update_file_index_igzip(path, *info, outputs);
+    // workers shared by the directory scan and the indexing, both run from scan_loop one after another
+    thread_pool* FileIndexer::worker_pool() {
+        if (!index_pool_) {
+            std::size_t threads = index_threads_ > 0 ? index_threads_ : thread_pool::default_threads();
+            index_pool_ = std::make_unique<thread_pool>(threads);
+            spdlog::info("Index worker pool started with {} threads", threads);
+        }
+        return index_pool_.get();
+    }
+
+    void FileIndexer::update_one_file_index(const std::shared_ptr<FileInfo>& info) {
+        const std::string& path = info->fullpath;
+        governor_.govern_this_thread();
+        try {
+            // choose handler based on suffix
+            auto output = std::make_shared<FileIndex>();
+            bool custom_root = info->root_path && info->root_path->time_format;
+            if (info->file_index && (info->file_index->time_format == TIME_FMT_CUSTOM) == custom_root) {
+                // keep the detected layout as a hint, the readers re-detect on a miss
+                output->time_format = info->file_index->time_format;
+                output->time_offset = info->file_index->time_offset;
+            }
+            // a new name may belong to a file indexed under another one
+            std::shared_ptr<FileIndex> previous = info->file_index;
+            if (!previous) previous = find_renamed_index(*info);
+            bool reused = false;
+            if (previous && previous != info->file_index && previous->index_etag == info->etag) {
+                // renamed and unchanged
+                *output = *previous;
+                reused = true;
+                spdlog::info("Reused index of renamed file for {} inode={}", path, info->inode);
+            } else if (info->file_type == "gzip") {
+                // also after a pass that caught the copy half written
+                reused = map_compressed_copy(*info, *output);
+            }
+            if (!reused) {
+                FileInfo source = *info;
+                source.file_index = previous;
+                if (source.file_type == "gzip") {
+                    update_file_index_igzip(path, source, *output);
                 } else {
-                    update_file_index_txt_mmap(path, *info, outputs);
+                    update_file_index_txt_mmap(path, source, *output);
                 }
-                // update index_ with new file_index, index_etag, last_index_time
-                {
-                    std::unique_lock<std::shared_mutex> wlock(mutex_);
-                    if(info->file_index == nullptr) {
-                        info->file_index = std::make_shared<FileIndex>();
+                std::string head;
+                if (read_head(path, info->file_type, HEAD_FINGERPRINT_SIZE, head)) {
+                    output->head_size = static_cast<uint32_t>(head.size());
+                    output->head_hash = head_fingerprint(head);
+                }
+            }
+            output->index_etag = info->etag;
+            output->last_index_time = std::time(nullptr);
+            // publish a new FileInfo and FileIndex, searchers may still hold the old ones
+            {
+                std::unique_lock<std::shared_mutex> wlock(mutex_);
+                auto it = index_.find(path);
+                if (it == index_.end() || it->second->inode != info->inode) {
+                    spdlog::debug("File {} was replaced while indexing, drop the result", path);
+                    return;
+                }
+                auto updated = std::make_shared<FileInfo>(*it->second);
+                updated->file_index = output;
+                it->second = updated;
+            }
+            updated_index_count_++;
+            // a pass over many or large files shows the ones done so far
+            if (util::get_micro_timestamp() - last_snapshot_time_ >= SNAPSHOT_INTERVAL_MICROS) publish_snapshot();
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to update index for {}: {}", path, e.what());
+        }
+    }
+
+    std::string FileIndexer::file_type_of(const std::string& filename) {
+        // determine file type based on suffix
+        std::string lower = filename;
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
+        if (lower.size() >= 3 && lower.substr(lower.size()-3) == ".gz") return "gzip";
+        return "text";
+    }
+
+    uint64_t FileIndexer::head_fingerprint(const std::string& head) {
+        return util::MurMurHash64(head.data(), head.size(), HEAD_FINGERPRINT_SEED);
+    }
+
+    // first size bytes of the content, inflated for gzip
+    bool FileIndexer::read_head(const std::string& path, const std::string& file_type, std::size_t size, std::string& out) {
+        out.clear();
+        if (file_type == "gzip") {
+            igzip_state igzs;
+            if (igzip::igzopen(path.c_str(), "rb", &igzs) != 0) return false;
+            std::vector<uint8_t> buf(16 * 1024);
+            while (out.size() < size) {
+                int n = igzip::igzread(&igzs, buf);
+                if (n < 0) return false;
+                if (n == 0) break;
+                out.append(reinterpret_cast<const char*>(buf.data()), std::min<std::size_t>(static_cast<std::size_t>(n), size - out.size()));
+            }
+            return true;
+        }
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open()) return false;
+        out.resize(size);
+        ifs.read(&out[0], static_cast<std::streamsize>(size));
+        out.resize(static_cast<std::size_t>(ifs.gcount()));
+        return true;
+    }
+
+    // keep the index of a file that left index_ for a while, it may come back under another name;
+    // the caller holds the unique lock
+    void FileIndexer::detach_file_info(const std::shared_ptr<FileInfo>& info) {
+        if (!info->file_index || info->file_index->time_indexes.empty() || info->file_index->head_size == 0) return;
+        detached_[info->inode] = DetachedFile{std::time(nullptr), info};
+    }
+
+    // index of the file that had this inode under another name, when the head still matches
+    std::shared_ptr<FileIndex> FileIndexer::find_renamed_index(const FileInfo& info) {
+        std::shared_ptr<FileInfo> old;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto it = detached_.find(info.inode);
+            if (it == detached_.end()) return nullptr;
+            old = it->second.info;
+        }
+        if (old->fullpath == info.fullpath) return nullptr;
+        const FileIndex& idx = *old->file_index;
+        std::string head;
+        // inodes are reused once a file is deleted, the head tells whether it is the same file
+        if (!read_head(info.fullpath, info.file_type, idx.head_size, head) || head.size() != idx.head_size ||
+            head_fingerprint(head) != idx.head_hash) {
+            return nullptr;
+        }
+        spdlog::info("File {} is {} renamed, inode={}", info.fullpath, old->fullpath, info.inode);
+        return old->file_index;
+    }
+
+    // "X.gz" holding the same bytes as the text file X: the uncompressed offsets are the same,
+    // so the time index of X is copied and only the inflate points are built
+    bool FileIndexer::map_compressed_copy(const FileInfo& info, FileIndex& output) {
+        const std::string& path = info.fullpath;
+        if (path.size() <= 3) return false;
+        const std::string source_path = path.substr(0, path.size() - 3);
+        std::shared_ptr<FileInfo> source;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto it = index_.find(source_path);
+            if (it != index_.end()) {
+                source = it->second;
+            } else {
+                // gzip removes the source once the copy is complete
+                for (const auto& kv : detached_) {
+                    if (kv.second.info->fullpath == source_path) {
+                        source = kv.second.info;
+                        break;
                     }
-                    info->file_index->time_indexes.swap(outputs);
-                    info->file_index->index_etag = info->etag;
-                    info->file_index->last_index_time = std::time(nullptr);
                 }
-                updated_index_count_++;
-            } catch (const std::exception& e) {
-                spdlog::error("Failed to update index for {}: {}", path, e.what());
             }
         }
+        if (!source || source->file_type != "text" || !source->file_index) return false;
+        const FileIndex& idx = *source->file_index;
+        // the source index must cover the whole source, and the copy must be as long as the source
+        if (idx.index_etag != source->etag || idx.time_indexes.empty() || idx.head_size == 0) return false;
+        if (gzip_index_reader::trailer_size(path.c_str()) != (source->size & 0xffffffffULL)) return false;
+        std::string head;
+        if (!read_head(path, info.file_type, idx.head_size, head) || head.size() != idx.head_size ||
+            head_fingerprint(head) != idx.head_hash) {
+            return false;
+        }
+
+        double d1 = util::get_micro_timestamp();
+        const uint64_t span = gzip_checkpoint_span_;
+        std::vector<inflate_point> points;
+        if (span > 0 && source->size >= span) {
+            gzip_index_reader reader(span);
+            if (reader.open(path.c_str()) != 0) return false;
+            std::vector<uint8_t> buf(64 * 1024);
+            uint64_t total = 0;
+            int n = 0;
+            while ((n = reader.read(buf)) > 0) total += static_cast<uint64_t>(n);
+            if (n < 0 || total != source->size) {
+                spdlog::warn("Compressed copy {} does not match {}, indexing it", path, source_path);
+                return false;
+            }
+            points = std::move(reader.points());
+        }
+        output = idx;
+        output.inflate_points = std::move(points);
+        double d2 = util::get_micro_timestamp();
+        spdlog::info("Mapped index of {} to compressed copy {} entries={} inflate_points={} time_cost={}", source_path, path,
+            output.time_indexes.size(), output.inflate_points.size(), (d2-d1)/1000.0);
+        return true;
     }
 
     // update file index for plain text file
-    void FileIndexer::update_file_index_txt(const std::string& path, const FileInfo& file_info, std::vector<TimeIndex>& outputs) {
+    void FileIndexer::update_file_index_txt(const std::string& path, const FileInfo& file_info, FileIndex& output) {
+        std::vector<TimeIndex>& outputs = output.time_indexes;
         // parse text file and build time index
         double d1 = util::get_micro_timestamp();
         std::ifstream ifs(path, std::ios::binary);
@@ -286,11 +566,15 @@ namespace drlog {
         uint64_t file_size = (uint64_t)ifs.tellg();
         ifs.seekg(0, std::ios::beg);
         outputs.reserve(1024);
-        std::string line;
+        const int BUF_SIZE = 64*1024;
+        std::vector<char> buf(BUF_SIZE);
+        line_buffer lines;
         std::time_t last_recorded_bucket = 0;
         std::size_t lines_since_last = 0;
         const unsigned interval = index_interval_seconds_;
         const std::size_t count_threshold = index_count_threshold_;
+        // lines of a layout without a year are placed against the day the pass started
+        const civil_date today = civil_date::today();
         std::size_t skipped_lines = 0;
 
         if (file_info.file_index && file_info.file_index->time_indexes.size() > 1) {
@@ -299,90 +583,304 @@ namespace drlog {
             const TimeIndex& last_index = file_info.file_index->time_indexes.back();
             if (last_index.offset < file_size) {
                 ifs.seekg(static_cast<std::streampos>(last_index.offset));
+                lines.set_base_offset(last_index.offset);
                 // insert existing index entries into entries vector
                 outputs.insert(outputs.end(), index_entries.begin(), index_entries.end() - 1);
                 last_recorded_bucket = static_cast<std::time_t>(outputs.back().timestamp);
             }
         }
-        std::streampos last_start_pos;
-        std::string last_line;
-        while (ifs) {
-            std::streampos start_pos = ifs.tellg();
-            if (!std::getline(ifs, line))
-            {
-                // add the last index entry
-                if (!outputs.empty()) {
-                    uint64_t offset = 0;
-                    if (last_start_pos!= std::streampos(-1)) offset = static_cast<uint64_t>(last_start_pos);
-                    std::time_t bucket = get_timestamp_from_log_line(last_line);
-                    if(bucket!=0) {
-                        outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), offset});
-                        std::string time_str = util::format_timestamp(bucket);
-                        spdlog::debug("Last index entry for {}: bucket={} offset={} time={}", path, bucket, offset, time_str);
+        uint64_t last_start_pos = 0;
+        std::time_t last_ts = 0;
+        bool eof = false;
+        bool give_up = false;
+        while (!eof && !give_up) {
+            ifs.read(buf.data(), BUF_SIZE);
+            std::streamsize n = ifs.gcount();
+            if (n > 0) lines.append(buf.data(), static_cast<std::size_t>(n));
+            eof = !ifs;
+            std::string_view line;
+            uint64_t start_pos = 0;
+            // the unterminated last line is indexed too
+            while (lines.next(line, start_pos) || (eof && lines.tail(line, start_pos))) {
+                std::time_t ts = detect_timestamp_from_log_line(line, file_info.root_path, output, today);
+                if (ts == 0) {
+                    // no timestamp -> skip and count
+                    ++skipped_lines;
+                    if(skipped_lines > 5000 && outputs.empty()) {
+                        spdlog::debug("Too many skipped lines without timestamp for {}, give up indexing", path);
+                        give_up = true;
+                        break;
                     }
+                    continue;
                 }
-                break;
-            }
-            std::time_t ts = get_timestamp_from_log_line(line);
-            if (ts == 0) {
-                // no timestamp -> skip and count
-                ++skipped_lines;
-                if(skipped_lines > 5000 && outputs.empty()) {
-                    spdlog::debug("Too many skipped lines without timestamp for {}, give up indexing", path);
-                    break;
-                }   
-                continue;
-            }
 
-            // bucket by interval
-            std::time_t bucket = ts - (ts % interval);
-            last_start_pos = start_pos;
-            last_line = line;
+                // bucket by interval
+                std::time_t bucket = ts - (ts % interval);
+                last_start_pos = start_pos;
+                last_ts = ts;
+
+                if (last_recorded_bucket == 0) {
+                    // first index entry
+                    outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), start_pos});
+                    last_recorded_bucket = bucket;
+                    lines_since_last = 0;
+                    std::string time_str = util::format_timestamp(bucket);
+                    spdlog::debug("First index entry for {}: bucket={} offset={} time={}", path, bucket, start_pos,time_str);
+                    continue;
+                }
 
-            if (last_recorded_bucket == 0) {
-                // first index entry
-                uint64_t offset = 0;
-                if (start_pos != std::streampos(-1)) offset = static_cast<uint64_t>(start_pos);
-                outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), offset});
-                last_recorded_bucket = bucket;
-                lines_since_last = 0;
-                std::string time_str = util::format_timestamp(bucket);
-                spdlog::debug("First index entry for {}: bucket={} offset={} time={}", path, bucket, offset,time_str);
-                continue;
+                lines_since_last++;
+
+                if (bucket >= static_cast<std::time_t>(last_recorded_bucket + interval) ||
+                    lines_since_last >= count_threshold) {
+                    outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), start_pos});
+                    last_recorded_bucket = bucket;
+                    lines_since_last = 0;
+                    // debug: record created
+                    std::string time_str = util::format_timestamp(bucket);
+                    spdlog::debug("Added index entry for {}: bucket={} offset={} time={}", path, bucket, start_pos,time_str);
+                }
             }
+        }
+        // add the last index entry
+        if (!outputs.empty() && last_ts != 0) {
+            outputs.push_back(TimeIndex{static_cast<uint64_t>(last_ts), last_start_pos});
+            std::string time_str = util::format_timestamp(last_ts);
+            spdlog::debug("Last index entry for {}: bucket={} offset={} time={}", path, last_ts, last_start_pos, time_str);
+        }
 
-            lines_since_last++;
+        double d2 = util::get_micro_timestamp();
+        spdlog::info("Indexed text file {} entries={} skipped_lines={} time_format={} time_cost={}", path, outputs.size(), skipped_lines,
+            time_parser::format_string(output.time_format), (d2-d1)/1000.0);
+    }
 
-            if (bucket >= static_cast<std::time_t>(last_recorded_bucket + interval) ||
-                lines_since_last >= count_threshold) {
-                uint64_t offset = 0;
-                if (start_pos != std::streampos(-1)) offset = static_cast<uint64_t>(start_pos);
-                outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), offset});
-                last_recorded_bucket = bucket;
-                lines_since_last = 0;
-                // debug: record created
-                std::string time_str = util::format_timestamp(bucket);
-                spdlog::debug("Added index entry for {}: bucket={} offset={} time={}", path, bucket, offset,time_str);
+    // level of a record, from the first level word near the start of the line: 1 for ERROR (and
+    // FATAL, CRITICAL), 2 for WARN(ING), 3 for INFO; 0 for DEBUG, TRACE or no level word
+    static int log_level_of(std::string_view line) {
+        static constexpr std::size_t LEVEL_SCAN_SIZE = 128;
+        const std::size_t size = std::min(line.size(), LEVEL_SCAN_SIZE);
+        auto is_word = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+        for (std::size_t i = 0; i < size; ++i) {
+            const char c = line[i];
+            if (!std::isalpha(static_cast<unsigned char>(c)) || (i > 0 && is_word(line[i - 1]))) continue;
+            std::size_t end = i;
+            while (end < line.size() && is_word(line[end])) ++end;
+            if (end - i >= 4 && end - i <= 8) {
+                char upper[8];
+                for (std::size_t k = i; k < end; ++k) upper[k - i] = static_cast<char>(std::toupper(static_cast<unsigned char>(line[k])));
+                const std::string_view word(upper, end - i);
+                if (word == "ERROR" || word == "FATAL" || word == "CRITICAL") return 1;
+                if (word == "WARN" || word == "WARNING") return 2;
+                if (word == "INFO") return 3;
+                if (word == "DEBUG" || word == "TRACE") return 0;
             }
+            i = end;
         }
+        return 0;
+    }
 
-        double d2 = util::get_micro_timestamp();
-        spdlog::info("Indexed text file {} entries={} skipped_lines={} time_cost={}", path, outputs.size(), skipped_lines,(d2-d1)/1000.0);
+    // what the index keeps of the lines of the open block: their token filter, the values of
+    // the root's token_pattern and their stats
+    class block_summary {
+    public:
+        explicit block_summary(const std::shared_ptr<RootPath>& root)
+            : token_regex_(root && root->has_token_pattern ? &root->token_regex : nullptr),
+              token_pattern_hash_(token_regex_ ? root->token_pattern_hash : 0) {}
+
+        // record is true for a line with a timestamp, the lines after it up to the next one continue it
+        void add_line(std::string_view line, bool record = false) {
+            filter.add_line(line);
+            if (record) {
+                record_stats = BlockStats();
+                switch (log_level_of(line)) {
+                    case 1: ++stats.errors; ++record_stats.errors; break;
+                    case 2: ++stats.warns; ++record_stats.warns; break;
+                    case 3: ++stats.infos; ++record_stats.infos; break;
+                    default: break;
+                }
+            }
+            ++stats.lines;
+            ++record_stats.lines;
+            stats.bytes += line.size() + 1;
+            record_stats.bytes += line.size() + 1;
+            if (!token_regex_) return;
+            boost::cregex_iterator it(line.data(), line.data() + line.size(), *token_regex_);
+            for (boost::cregex_iterator end; it != end; ++it) {
+                const auto& value = it->size() > 1 && (*it)[1].matched ? (*it)[1] : (*it)[0];
+                if (value.length() > 0) tokens.push_back(token_filter::token_hash(value.first, static_cast<std::size_t>(value.length())));
+            }
+        }
+        bool with_tokens() const { return token_regex_ != nullptr; }
+        uint64_t token_pattern_hash() const { return token_pattern_hash_; }
+        // append the sorted distinct values of the block to out and start the next one
+        void finish_tokens(std::vector<uint64_t>& out) {
+            std::sort(tokens.begin(), tokens.end());
+            tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+            out.insert(out.end(), tokens.begin(), tokens.end());
+            tokens.clear();
+        }
+
+        token_filter filter;
+        std::vector<uint64_t> tokens;
+        BlockStats stats;
+        // stats of the lines from the last record on
+        BlockStats record_stats;
+
+    private:
+        const boost::regex* token_regex_;
+        uint64_t token_pattern_hash_;
+    };
+
+    // whether an index can go on with its block stats and the values of root's token_pattern
+    static bool summary_resumable(const FileIndex& previous, const std::shared_ptr<RootPath>& root) {
+        if (previous.block_stats.size() != previous.time_indexes.size()) return false;
+        if (!root || !root->has_token_pattern) return true;
+        return previous.token_pattern_hash == root->token_pattern_hash && previous.block_tokens.size() == previous.time_indexes.size();
     }
 
-    void FileIndexer::update_file_index_txt_mmap(const std::string& path, const FileInfo& file_info, std::vector<TimeIndex>& outputs) {
-        // Open the file using memory-mapped I/O
-        double d1 = util::get_micro_timestamp();
-        std::ifstream ifs(path, std::ios::binary);
-        if (!ifs.is_open()) {
-            spdlog::warn("Failed to open text file for indexing: {}", path);
+    // carry the filters, values and stats of a resumed index over to output; the block that ended
+    // at the dropped last entry is open again and goes on in blocks
+    static void resume_block_filters(const FileIndex& previous, FileIndex& output, block_summary& blocks) {
+        const std::size_t kept = previous.time_indexes.size() - 1;
+        // the lines from the dropped entry on are read again
+        output.block_stats.assign(previous.block_stats.begin(), previous.block_stats.begin() + kept - 1);
+        const BlockStats& open = previous.block_stats[kept - 1];
+        const BlockStats& tail = previous.block_stats[kept];
+        blocks.stats = BlockStats{open.bytes - tail.bytes, open.lines - tail.lines, open.errors - tail.errors,
+            open.warns - tail.warns, open.infos - tail.infos};
+        if (blocks.with_tokens()) {
+            output.block_tokens.assign(previous.block_tokens.begin(), previous.block_tokens.begin() + kept);
+            output.block_token_hashes.assign(previous.block_token_hashes.begin(), previous.block_token_hashes.begin() + output.block_tokens.back());
+            blocks.tokens.assign(previous.block_token_hashes.begin() + previous.block_tokens[kept - 1],
+                previous.block_token_hashes.begin() + previous.block_tokens[kept]);
+        }
+        if (previous.block_filters.size() != previous.time_indexes.size()) {
+            // nothing to go on with, the kept blocks rule nothing out
+            output.block_filters.assign(kept, 0);
+            output.block_filter_words.clear();
+            blocks.filter.resume(nullptr, 0);
             return;
         }
+        output.block_filters.assign(previous.block_filters.begin(), previous.block_filters.begin() + kept);
+        output.block_filter_words.assign(previous.block_filter_words.begin(), previous.block_filter_words.begin() + output.block_filters.back());
+        const uint32_t begin = previous.block_filters[kept - 1];
+        blocks.filter.resume(previous.block_filter_words.data() + begin, previous.block_filters[kept] - begin);
+    }
 
-        ifs.seekg(0, std::ios::end);
-        uint64_t file_size = static_cast<uint64_t>(ifs.tellg());
-        ifs.seekg(0, std::ios::beg);
-        ifs.close();
+    // a new time index entry closes the open block and opens the next one
+    static void next_block_filter(FileIndex& output, block_summary& blocks) {
+        if (!output.block_filters.empty()) output.block_stats.push_back(blocks.stats);
+        blocks.stats = BlockStats();
+        if (!output.block_filters.empty()) {
+            blocks.filter.finish(output.block_filter_words);
+            output.block_filters.push_back(static_cast<uint32_t>(output.block_filter_words.size()));
+        } else {
+            output.block_filters.push_back(0);
+        }
+        blocks.filter.reset();
+        if (blocks.with_tokens()) {
+            if (!output.block_tokens.empty()) blocks.finish_tokens(output.block_token_hashes);
+            output.block_tokens.push_back(static_cast<uint32_t>(output.block_token_hashes.size()));
+        }
+        blocks.tokens.clear();
+    }
+
+    // close the open block once the file is read, the last block runs to the end of the file;
+    // the last entry only marks where the last line starts and opens no block
+    static void finish_block_filters(FileIndex& output, block_summary& blocks) {
+        const std::size_t n = output.time_indexes.size();
+        std::vector<BlockStats>& stats = output.block_stats;
+        if (!output.block_filters.empty()) stats.push_back(blocks.stats);
+        if (n > 1 && stats.size() == n) {
+            // as below, the open block is added to the last one and is the lines from the last entry on
+            const BlockStats& tail = stats.back();
+            BlockStats& last = stats[n - 2];
+            last.bytes += tail.bytes;
+            last.lines += tail.lines;
+            last.errors += tail.errors;
+            last.warns += tail.warns;
+            last.infos += tail.infos;
+        } else if (n > 1 && stats.size() == n - 1) {
+            stats.push_back(blocks.record_stats);
+        }
+        if (stats.size() != n || n < 2) stats.clear();
+
+        token_filter& filter = blocks.filter;
+        if (!output.block_filters.empty()) {
+            filter.finish(output.block_filter_words);
+            output.block_filters.push_back(static_cast<uint32_t>(output.block_filter_words.size()));
+        }
+        std::vector<uint32_t>& offsets = output.block_filters;
+        std::vector<uint64_t>& words = output.block_filter_words;
+        if (n > 1 && offsets.size() == n + 1) {
+            // no last entry was added, the last block takes the lines of the open one
+            filter.resume(words.data() + offsets[n - 2], offsets[n - 1] - offsets[n - 2]);
+            filter.merge(words.data() + offsets[n - 1], offsets[n] - offsets[n - 1]);
+            offsets.erase(offsets.begin() + (n - 1), offsets.end());
+            words.resize(offsets.back());
+            filter.finish(words);
+            offsets.push_back(static_cast<uint32_t>(words.size()));
+        } else if (n == 1 && !offsets.empty()) {
+            offsets.erase(offsets.begin() + 1, offsets.end());
+            words.clear();
+        }
+        if (offsets.size() != n) {
+            offsets.clear();
+            words.clear();
+        }
+
+        std::vector<uint32_t>& token_offsets = output.block_tokens;
+        std::vector<uint64_t>& hashes = output.block_token_hashes;
+        output.token_pattern_hash = 0;
+        if (!blocks.with_tokens()) {
+            token_offsets.clear();
+            hashes.clear();
+            return;
+        }
+        if (!token_offsets.empty()) {
+            blocks.finish_tokens(hashes);
+            token_offsets.push_back(static_cast<uint32_t>(hashes.size()));
+        }
+        if (n > 1 && token_offsets.size() == n + 1) {
+            // the same for the values, a union of the last two blocks
+            blocks.tokens.assign(hashes.begin() + token_offsets[n - 2], hashes.end());
+            token_offsets.erase(token_offsets.begin() + (n - 1), token_offsets.end());
+            hashes.resize(token_offsets.back());
+            blocks.finish_tokens(hashes);
+            token_offsets.push_back(static_cast<uint32_t>(hashes.size()));
+        }
+        if (token_offsets.size() != n || n < 2) {
+            token_offsets.clear();
+            hashes.clear();
+            return;
+        }
+        output.token_pattern_hash = blocks.token_pattern_hash();
+    }
+
+    // the root's read_mode picks mmap, or windows read by a sequential_reader that leave the page cache alone
+    void FileIndexer::update_file_index_txt_mmap(const std::string& path, const FileInfo& file_info, FileIndex& output) {
+        std::vector<TimeIndex>& outputs = output.time_indexes;
+        double d1 = util::get_micro_timestamp();
+        const file_read_mode read_mode = file_info.root_path ? file_info.root_path->read_mode : file_read_mode::mmap;
+        sequential_reader reader;
+        int fd = -1;
+        uint64_t file_size = 0;
+        if (read_mode == file_read_mode::mmap) {
+            fd = open(path.c_str(), O_RDONLY);
+            struct stat st {};
+            if (fd == -1 || fstat(fd, &st) != 0) {
+                spdlog::warn("Failed to open text file for indexing: {}", path);
+                if (fd != -1) close(fd);
+                return;
+            }
+            file_size = static_cast<uint64_t>(st.st_size);
+        } else {
+            if (!reader.open(path, read_mode)) {
+                spdlog::warn("Failed to open text file for indexing: {}", path);
+                return;
+            }
+            file_size = reader.size();
+        }
 
         outputs.reserve(1024);
         const int MAX_LINE_SIZE = 16*1024; // maximum line size to prevent excessive carry growth
@@ -390,66 +888,51 @@ namespace drlog {
         std::size_t lines_since_last = 0;
         const unsigned interval = index_interval_seconds_;
         const std::size_t count_threshold = index_count_threshold_;
+        const civil_date today = civil_date::today();
         std::size_t skipped_lines = 0;
+        block_summary blocks(file_info.root_path);
 
-        // Memory-map the file
-        int fd = open(path.c_str(), O_RDONLY);
-        if (fd == -1) {
-            spdlog::warn("Failed to open file descriptor for mmap: {}", path);
-            return;
-        }
-
-        void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-        if (mapped == MAP_FAILED) {
-            spdlog::warn("Failed to mmap file: {}", path);
-            close(fd);
-            return;
-        }
-
-        const char* data = static_cast<const char*>(mapped);
-        const char* end = data + file_size;
-        const char* line_start = data;
-        //check for existing index to resume from last offset
-        if (file_info.file_index && file_info.file_index->time_indexes.size() > 1) {
+        uint64_t start = 0;
+        //check for existing index to resume from last offset, one without stats or with values of another token_pattern is rebuilt
+        if (file_info.file_index && file_info.file_index->time_indexes.size() > 1 &&
+            summary_resumable(*file_info.file_index, file_info.root_path)) {
             // start from last indexed offset
             auto &index_entries = file_info.file_index->time_indexes;
             const TimeIndex& last_index = index_entries.back();
             if (last_index.offset < file_size) {
-                line_start = data + static_cast<std::ptrdiff_t>(last_index.offset);
+                start = last_index.offset;
                 // insert existing index entries into entries vector
                 outputs.insert(outputs.end(), index_entries.begin(), index_entries.end() - 1);
                 last_recorded_bucket = static_cast<std::time_t>(outputs.back().timestamp);
+                resume_block_filters(*file_info.file_index, output, blocks);
             }
         }
-        std::string_view last_line;
+        // timestamp and offset of the last line read, 0 when it has none
+        std::time_t last_line_ts = 0;
         uint64_t last_offset = 0;
+        bool give_up = false;
 
-        while (line_start < end) {
-            const char* line_end = static_cast<const char*>(memchr(line_start, '\n', end - line_start));
-            if (!line_end) {
-                line_end = end; // Handle the last line without a newline
-                break;
-            }
-            uint64_t offset = static_cast<uint64_t>(line_start - data);
-            std::string_view line(line_start, line_end - line_start);
+        auto index_line = [&](std::string_view line, uint64_t offset) {
             if(line.size() > MAX_LINE_SIZE) {
                 spdlog::debug("Line size exceeded max line size for {}, give up line ", path);
-                line_start = line_end + 1;
                 ++skipped_lines;
-                continue;
+                // searches still read it as part of the record above
+                if (!outputs.empty()) blocks.add_line(line);
+                return;
             }
 
-            last_line = line;
+            std::time_t ts = detect_timestamp_from_log_line(line, file_info.root_path, output, today);
+            last_line_ts = ts;
             last_offset = offset;
-            std::time_t ts = get_timestamp_from_log_line(line);
             if (ts == 0) {
                 ++skipped_lines;
                 if(skipped_lines > 5000 && outputs.empty()) {
                     spdlog::debug("Too many skipped lines without timestamp for {}, give up indexing", path);
-                    break;
+                    give_up = true;
+                    return;
                 }
-                line_start = line_end + 1;
-                continue;
+                if (!outputs.empty()) blocks.add_line(line);
+                return;
             }
 
             std::time_t bucket = ts - (ts % interval);
@@ -457,6 +940,7 @@ namespace drlog {
                 bucket >= static_cast<std::time_t>(last_recorded_bucket + interval) ||
                 lines_since_last >= count_threshold) {
                 outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), offset});
+                next_block_filter(output, blocks);
                 lines_since_last = 0;
                 std::string time_str = util::format_timestamp(bucket);
                 if(last_recorded_bucket == 0)
@@ -466,30 +950,87 @@ namespace drlog {
                 last_recorded_bucket = bucket;
             }
 
+            blocks.add_line(line, true);
             ++lines_since_last;
-            line_start = line_end + 1;
+        };
+
+        // newlines are found a window at a time, a line may span two windows
+        const std::size_t SCAN_WINDOW = 4*1024*1024;
+        if (read_mode == file_read_mode::mmap) {
+            void* mapped = file_size > 0 ? mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            if (mapped == MAP_FAILED) {
+                spdlog::warn("Failed to mmap file: {}", path);
+                close(fd);
+                return;
+            }
+            const char* data = static_cast<const char*>(mapped);
+            const char* end = data + file_size;
+            const char* line_start = data + static_cast<std::ptrdiff_t>(start);
+            std::vector<uint32_t> newlines;
+            newlines.reserve(64*1024);
+            const char* window = line_start;
+            while (window < end && !give_up) {
+                std::size_t window_size = std::min<std::size_t>(SCAN_WINDOW, static_cast<std::size_t>(end - window));
+                governor_.throttle(window_size);
+                newlines.clear();
+                line_scanner::find_newlines(window, window_size, newlines);
+                for (uint32_t nl : newlines) {
+                    const char* line_end = window + nl;
+                    uint64_t offset = static_cast<uint64_t>(line_start - data);
+                    std::string_view line(line_start, line_end - line_start);
+                    line_start = line_end + 1;
+                    index_line(line, offset);
+                    if (give_up) break;
+                }
+                window += window_size;
+            }
+            // an unterminated last line is read by searches too
+            if (!give_up && !outputs.empty() && line_start < end) {
+                blocks.add_line(std::string_view(line_start, static_cast<std::size_t>(end - line_start)));
+            }
+            munmap(mapped, file_size);
+            close(fd);
+        } else {
+            line_buffer lines;
+            lines.set_base_offset(start);
+            reader.seek(start);
+            while (!give_up) {
+                ssize_t n = reader.read();
+                if (n < 0) {
+                    spdlog::warn("Failed to read text file {}: {}", path, std::strerror(errno));
+                    break;
+                }
+                // stop at the size seen at open, like the mapping does
+                uint64_t remaining = file_size - (lines.base_offset() + lines.pending());
+                std::size_t size = static_cast<std::size_t>(std::min<uint64_t>(static_cast<uint64_t>(n), remaining));
+                if (size == 0) break;
+                governor_.throttle(size);
+                lines.append(reader.data(), size);
+                std::string_view line;
+                uint64_t offset = 0;
+                while (!give_up && lines.next(line, offset)) index_line(line, offset);
+            }
+            std::string_view line;
+            uint64_t offset = 0;
+            if (!give_up && !outputs.empty() && lines.tail(line, offset)) blocks.add_line(line);
+            reader.close();
         }
         // add the last index entry
-        if (!outputs.empty() && !last_line.empty()) {
-            uint64_t offset = 0;
-            if (line_start != data) offset = last_offset;
-            std::time_t bucket = get_timestamp_from_log_line(last_line);
-            if(bucket!=0) {
-                outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), offset});
-                std::string time_str = util::format_timestamp(bucket);
-                spdlog::debug("Last index entry for {}: bucket={} offset={} time={}", path, bucket, offset, time_str);
-            }
+        if (!outputs.empty() && last_line_ts != 0) {
+            outputs.push_back(TimeIndex{static_cast<uint64_t>(last_line_ts), last_offset});
+            std::string time_str = util::format_timestamp(last_line_ts);
+            spdlog::debug("Last index entry for {}: bucket={} offset={} time={}", path, last_line_ts, last_offset, time_str);
         }
-
-        munmap(mapped, file_size);
-        close(fd);
+        finish_block_filters(output, blocks);
 
         double d2 = util::get_micro_timestamp();
-        spdlog::info("Indexed text file {} entries={} skipped_lines={} time_cost={}", path, outputs.size(), skipped_lines,(d2-d1)/1000.0);
+        spdlog::info("Indexed text file {} entries={} skipped_lines={} time_format={} read_mode={} time_cost={}", path, outputs.size(),
+            skipped_lines, time_parser::format_string(output.time_format), read_mode_name(read_mode), (d2-d1)/1000.0);
     }
 
     // update file index for gzip file (use zlib gzread) - robust offset handling
-    void FileIndexer::update_file_index_gzip(const std::string& path, const FileInfo& file_info, std::vector<TimeIndex>& outputs) {
+    void FileIndexer::update_file_index_gzip(const std::string& path, const FileInfo& file_info, FileIndex& output) {
+        std::vector<TimeIndex>& outputs = output.time_indexes;
         // parse gzip file and build time index
         double d1 = util::get_micro_timestamp();
         gzFile gz = gzopen(path.c_str(), "rb");
@@ -501,21 +1042,21 @@ namespace drlog {
         const int BUF_SIZE = 16*1024;
         const int MAX_LINE_SIZE = 16*1024; // maximum line size to prevent excessive carry growth
         std::vector<char> buf(BUF_SIZE);
-        std::string carry; // leftover partial line from previous chunk
+        line_buffer lines; // complete lines of the decompressed stream, plus the partial tail
         outputs.reserve(1024);
 
-        uint64_t total_uncompressed = 0; // total uncompressed bytes BEFORE current chunk
         std::time_t last_recorded_bucket = 0;
         std::size_t lines_since_last = 0;
         const unsigned interval = index_interval_seconds_;
         const std::size_t count_threshold = index_count_threshold_;
+        const civil_date today = civil_date::today();
         std::size_t skipped_lines = 0;
         
         uint64_t last_offset = 0;
-        std::time_t last_bucket;
-        std::string last_line;
+        std::time_t last_ts = 0;
+        bool give_up = false;
 
-        while (true) {
+        while (!give_up) {
             int n = gzread(gz, buf.data(), BUF_SIZE);
             if (n < 0) {
                 int errnum = 0;
@@ -526,95 +1067,78 @@ namespace drlog {
             if (n == 0) {
                 // end of file,add the last index entry
                 if (!outputs.empty()) {
-                    uint64_t offset = 0;
-                    if (last_offset!= 0) offset = last_offset;
-                    last_bucket = get_timestamp_from_log_line(last_line);
-                    outputs.push_back(TimeIndex{static_cast<uint64_t>(last_bucket), offset});
-                    std::string time_str = util::format_timestamp(last_bucket);
-                    spdlog::debug("Last index entry for {}: bucket={} offset={} time={}", path, last_bucket, offset, time_str);
+                    outputs.push_back(TimeIndex{static_cast<uint64_t>(last_ts), last_offset});
+                    std::string time_str = util::format_timestamp(last_ts);
+                    spdlog::debug("Last index entry for {}: bucket={} offset={} time={}", path, last_ts, last_offset, time_str);
                 }   
                 break;
             }
 
-            // Append exactly n bytes
-            carry.append(buf.data(), static_cast<size_t>(n));
-            if(carry.size() > MAX_LINE_SIZE) {
-                spdlog::debug("Line size exceeded max line size for {}, give up line", path);
-                std::string().swap(carry);
-                continue;
-            }
-
-            // compute previous leftover size and base offset for this carry buffer
-            size_t previous_carry_size = (carry.size() >= static_cast<size_t>(n)) ? (carry.size() - static_cast<size_t>(n)) : 0;
-            uint64_t base_offset = (total_uncompressed >= previous_carry_size) ? (total_uncompressed - previous_carry_size) : 0;
-
-            // scan lines in carry
-            size_t pos = 0;
-            size_t processed_up_to = 0;
-            while (true) {
-                size_t nl = carry.find('\n', pos);
-                if (nl == std::string::npos) break;
-                std::string line = carry.substr(pos, nl - pos);
-                uint64_t line_start_offset = base_offset + pos;
-
-                std::time_t ts = get_timestamp_from_log_line(line);
+            lines.append(buf.data(), static_cast<size_t>(n));
+            std::string_view line;
+            uint64_t line_start_offset = 0;
+            while (lines.next(line, line_start_offset)) {
+                std::time_t ts = detect_timestamp_from_log_line(line, file_info.root_path, output, today);
                 if (ts == 0) {
                     // skip lines without timestamp and count them
                     ++skipped_lines;
                     if(skipped_lines > 5000 && outputs.empty()) {
                         spdlog::debug("Too many skipped lines without timestamp for {}, give up indexing", path);
+                        give_up = true;
                         break;
                     }
-                    pos = nl + 1;
+                    continue;
+                }
+                std::time_t bucket = ts - (ts % interval);
+                last_ts = ts;
+                last_offset = line_start_offset;
+
+                if (last_recorded_bucket == 0) {
+                    outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), line_start_offset});
+                    last_recorded_bucket = bucket;
+                    lines_since_last = 0;
+                    std::string time_str = util::format_timestamp(bucket);
+                    spdlog::debug("First index entry for {}: bucket={} offset={} time={}", path, bucket, line_start_offset,time_str);
+                    // continue to next line
                 } else {
-                    std::time_t bucket = ts - (ts % interval);
-                    last_bucket = bucket;
-                    last_offset = line_start_offset;
-                    last_line = line;
-
-                    if (last_recorded_bucket == 0) {
+                    lines_since_last++;
+                    if (bucket >= static_cast<std::time_t>(last_recorded_bucket + interval) ||
+                        lines_since_last >= count_threshold) {
                         outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), line_start_offset});
                         last_recorded_bucket = bucket;
                         lines_since_last = 0;
                         std::string time_str = util::format_timestamp(bucket);
-                        spdlog::debug("First index entry for {}: bucket={} offset={} time={}", path, bucket, line_start_offset,time_str);
-                        // continue to next line
-                    } else {
-                        lines_since_last++;
-                        if (bucket >= static_cast<std::time_t>(last_recorded_bucket + interval) ||
-                            lines_since_last >= count_threshold) {
-                            outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), line_start_offset});
-                            last_recorded_bucket = bucket;
-                            lines_since_last = 0;
-                            std::string time_str = util::format_timestamp(bucket);
-                            spdlog::debug("Added index entry for {}: bucket={} offset={} time={}", path, bucket, line_start_offset,time_str);
-                        }
+                        spdlog::debug("Added index entry for {}: bucket={} offset={} time={}", path, bucket, line_start_offset,time_str);
                     }
                 }
-
-                pos = nl + 1;
-                processed_up_to = pos;
             }
-
-            // remove processed prefix (keep partial line)
-            if (processed_up_to > 0) carry.erase(0, processed_up_to);
-
-            // advance total_uncompressed by n (bytes uncompressed in this chunk)
-            total_uncompressed += static_cast<uint64_t>(n);
+            if(lines.pending() > MAX_LINE_SIZE) {
+                spdlog::debug("Line size exceeded max line size for {}, give up line", path);
+                lines.clear();
+            }
         }
 
         gzclose(gz);
 
         double d2 = util::get_micro_timestamp();
-        spdlog::info("Indexed gzip file {} entries={} skipped_lines={} time_cost={}", path, outputs.size(), skipped_lines,(d2-d1)/1000.0);
+        spdlog::info("Indexed gzip file {} entries={} skipped_lines={} time_format={} time_cost={}", path, outputs.size(), skipped_lines,
+            time_parser::format_string(output.time_format), (d2-d1)/1000.0);
         
     }
 
-    void FileIndexer::update_file_index_igzip(const std::string& path, const FileInfo& file_info, std::vector<TimeIndex>& outputs) {
+    // files long enough for inflate points are inflated with zlib, which can stop at deflate block
+    // boundaries to record them; searches resume there with ISA-L instead of inflating from the start
+    void FileIndexer::update_file_index_igzip(const std::string& path, const FileInfo& file_info, FileIndex& output) {
+        std::vector<TimeIndex>& outputs = output.time_indexes;
         // parse gzip file and build time index
         double d1 = util::get_micro_timestamp();
+        const uint64_t span = gzip_checkpoint_span_;
+        // the trailer size wraps at 4 GiB, a file that large compressed needs points anyway
+        const bool with_points = span > 0 &&
+            (file_info.size >= span || gzip_index_reader::trailer_size(path.c_str()) >= span);
+        gzip_index_reader reader(span);
         igzip_state igzs;
-        int ret = igzip::igzopen(path.c_str(), "rb",&igzs);
+        int ret = with_points ? reader.open(path.c_str()) : igzip::igzopen(path.c_str(), "rb", &igzs);
         if (ret != 0) {
             spdlog::warn("Failed to open gzip file for indexing: {}, ret: ", path, ret);
             return;
@@ -623,194 +1147,233 @@ namespace drlog {
         const int BUF_SIZE = 16*1024;
         const int MAX_LINE_SIZE = 4*1024*1024;
         std::vector<uint8_t> buf(BUF_SIZE);
-        std::string carry; // leftover partial line from previous chunk
+        line_buffer lines; // complete lines of the decompressed stream, plus the partial tail
         outputs.reserve(1024);
 
-        uint64_t total_uncompressed = 0; // total uncompressed bytes BEFORE current chunk
         std::time_t last_recorded_bucket = 0;
         std::size_t lines_since_last = 0;
         const unsigned interval = index_interval_seconds_;
         const std::size_t count_threshold = index_count_threshold_;
+        const civil_date today = civil_date::today();
         std::size_t skipped_lines = 0;
+        block_summary blocks(file_info.root_path);
         
         uint64_t last_offset = 0;
-        std::time_t last_bucket;
-        std::string last_line;
+        std::time_t last_ts = 0;
+        bool give_up = false;
+        // the read rate counts the compressed bytes
+        std::size_t ungoverned = 0;
+        uint64_t governed_offset = 0;
+        // stdio has no O_DIRECT, stream and direct roots drop the compressed pages read so far instead
+        const bool drop_cache = file_info.root_path && file_info.root_path->read_mode != file_read_mode::mmap;
+        uint64_t dropped_offset = 0;
+        if (FILE* in = with_points ? reader.file() : igzs.in_file; drop_cache && in) {
+            sequential_reader::advise_sequential(fileno(in));
+        }
 
-        while (true) {
-            int n = igzip::igzread(&igzs, buf);
+        while (!give_up) {
+            int n = with_points ? reader.read(buf) : igzip::igzread(&igzs, buf);
             if (n < 0) {
-                spdlog::warn("gzread error on {}, error: {}", path, ret);
+                spdlog::warn("gzread error on {}, error: {}", path, n);
                 break;
             }
+            ungoverned += static_cast<std::size_t>(n);
+            if (ungoverned >= GOVERN_SPAN || n == 0) {
+                FILE* in = with_points ? reader.file() : igzs.in_file;
+                off_t pos = in ? ftello(in) : -1;
+                uint64_t offset = pos > 0 ? static_cast<uint64_t>(pos) : governed_offset;
+                governor_.throttle(static_cast<std::size_t>(offset - governed_offset));
+                governed_offset = offset;
+                if (drop_cache && in) sequential_reader::drop_behind(fileno(in), dropped_offset, offset);
+                ungoverned = 0;
+            }
             if (n == 0) {
                 // end of file,add the last index entry
                 if (!outputs.empty()) {
-                    uint64_t offset = 0;
-                    if (last_offset!= 0) offset = last_offset;
-                    last_bucket = get_timestamp_from_log_line(last_line);
-                    outputs.push_back(TimeIndex{static_cast<uint64_t>(last_bucket), offset});
-                    std::string time_str = util::format_timestamp(last_bucket);
-                    spdlog::debug("Last index entry for {}: bucket={} offset={} time={}", path, last_bucket, offset, time_str);
+                    outputs.push_back(TimeIndex{static_cast<uint64_t>(last_ts), last_offset});
+                    std::string time_str = util::format_timestamp(last_ts);
+                    spdlog::debug("Last index entry for {}: bucket={} offset={} time={}", path, last_ts, last_offset, time_str);
                 }   
                 break;
             }
 
-            // Append exactly n bytes
-            carry.append((char *)buf.data(), static_cast<size_t>(n));
-            if(carry.size() > MAX_LINE_SIZE) {
-                spdlog::debug("Carry buffer exceeded max line size for {}, give up line", path);
-                std::string().swap(carry);
-                break;
-            }
-
-            // compute previous leftover size and base offset for this carry buffer
-            size_t previous_carry_size = (carry.size() >= static_cast<size_t>(n)) ? (carry.size() - static_cast<size_t>(n)) : 0;
-            uint64_t base_offset = (total_uncompressed >= previous_carry_size) ? (total_uncompressed - previous_carry_size) : 0;
-
-            // scan lines in carry
-            size_t pos = 0;
-            size_t processed_up_to = 0;
-            while (true) {
-                size_t nl = carry.find('\n', pos);
-                if (nl == std::string::npos) break;
-                std::string_view line = std::string_view(carry).substr(pos, nl - pos);
-                uint64_t line_start_offset = base_offset + pos;
-
-                std::time_t ts = get_timestamp_from_log_line(line);
+            lines.append(reinterpret_cast<const char*>(buf.data()), static_cast<size_t>(n));
+            std::string_view line;
+            uint64_t line_start_offset = 0;
+            while (lines.next(line, line_start_offset)) {
+                std::time_t ts = detect_timestamp_from_log_line(line, file_info.root_path, output, today);
                 if (ts == 0) {
                     // skip lines without timestamp and count them
                     ++skipped_lines;
                     if(skipped_lines > 5000 && outputs.empty()) {
                         spdlog::debug("Too many skipped lines without timestamp for {}, give up indexing", path);
+                        give_up = true;
                         break;
                     }
+                    if (!outputs.empty()) blocks.add_line(line);
+                    continue;
+                }
+                std::time_t bucket = ts - (ts % interval);
+                last_ts = ts;
+                last_offset = line_start_offset;
+
+                if (last_recorded_bucket == 0) {
+                    outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), line_start_offset});
+                    next_block_filter(output, blocks);
+                    last_recorded_bucket = bucket;
+                    lines_since_last = 0;
+                    std::string time_str = util::format_timestamp(bucket);
+                    spdlog::debug("First index entry for {}: bucket={} offset={} time={}", path, bucket, line_start_offset,time_str);
+                    // continue to next line
                 } else {
-                    std::time_t bucket = ts - (ts % interval);
-                    last_bucket = bucket;
-                    last_offset = line_start_offset;
-                    last_line = line;
-
-                    if (last_recorded_bucket == 0) {
+                    lines_since_last++;
+                    if (bucket >= static_cast<std::time_t>(last_recorded_bucket + interval) ||
+                        lines_since_last >= count_threshold) {
                         outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), line_start_offset});
+                        next_block_filter(output, blocks);
                         last_recorded_bucket = bucket;
                         lines_since_last = 0;
                         std::string time_str = util::format_timestamp(bucket);
-                        spdlog::debug("First index entry for {}: bucket={} offset={} time={}", path, bucket, line_start_offset,time_str);
-                        // continue to next line
-                    } else {
-                        lines_since_last++;
-                        if (bucket >= static_cast<std::time_t>(last_recorded_bucket + interval) ||
-                            lines_since_last >= count_threshold) {
-                            outputs.push_back(TimeIndex{static_cast<uint64_t>(bucket), line_start_offset});
-                            last_recorded_bucket = bucket;
-                            lines_since_last = 0;
-                            std::string time_str = util::format_timestamp(bucket);
-                            spdlog::debug("Added index entry for {}: bucket={} offset={} time={}", path, bucket, line_start_offset,time_str);
-                        }
+                        spdlog::debug("Added index entry for {}: bucket={} offset={} time={}", path, bucket, line_start_offset,time_str);
                     }
                 }
-
-                pos = nl + 1;
-                processed_up_to = pos;
+                blocks.add_line(line, true);
             }
-
-            // remove processed prefix (keep partial line)
-            if (processed_up_to > 0) {
-                std::string tmp = carry.substr(processed_up_to);
-                carry.swap(tmp);
+            if(lines.pending() > MAX_LINE_SIZE) {
+                spdlog::debug("Carry buffer exceeded max line size for {}, give up line", path);
+                break;
             }
-
-            // advance total_uncompressed by n (bytes uncompressed in this chunk)
-            total_uncompressed += static_cast<uint64_t>(n);
         }
 
-        igzip::igzclose(&igzs);
+        finish_block_filters(output, blocks);
+
+        if (with_points) {
+            reader.close();
+            output.inflate_points = std::move(reader.points());
+        } else {
+            igzip::igzclose(&igzs);
+        }
 
         double d2 = util::get_micro_timestamp();
-        spdlog::info("Indexed gzip file {} entries={} skipped_lines={} time_cost={}", path, outputs.size(), skipped_lines,(d2-d1)/1000.0);
+        spdlog::info("Indexed gzip file {} entries={} inflate_points={} skipped_lines={} time_format={} time_cost={}", path, outputs.size(),
+            output.inflate_points.size(), skipped_lines, time_parser::format_string(output.time_format), (d2-d1)/1000.0);
     }
 
-    std::vector<FileInfo> FileIndexer::list_prefix(const std::string& prefix) const {
-        std::vector<FileInfo> out;
-        std::shared_lock<std::shared_mutex> lock(mutex_);
-        boost::smatch matches;
-        for (const auto& [path, info] : index_) {
-            // check if prefix matches root path regex
+    // the files of the snapshot under prefix in path order, until visit returns false; a root takes
+    // part when prefix lies inside it and matches its prefix pattern
+    void FileIndexer::visit_prefix(const IndexSnapshot& snapshot, const std::string& prefix,
+        const std::function<bool(const std::shared_ptr<const FileInfo>&)>& visit) const {
+        std::vector<const RootPath*> roots;
+        for (const auto& rp : snapshot.roots) {
+            if (prefix.compare(0, rp->path.size(), rp->path) != 0) continue;
             try {
-                if (!boost::regex_match(prefix, matches, info->root_path->prefix_regex)) continue;
+                if (!boost::regex_match(prefix, rp->prefix_regex)) continue;
             } catch (const boost::regex_error& e) {
-                spdlog::warn("Regex error for path {}: {}", info->root_path->path, e.what());
+                spdlog::warn("Regex error for path {}: {}", rp->path, e.what());
                 continue;
             }
-            // check if root starts with prefix
-            if(prefix.find(info->root_path->path) != 0) continue;
-            // check if path starts with prefix
-            if(path.find(prefix) != 0) continue;
-            out.push_back(*info);
+            roots.push_back(rp.get());
         }
+        if (roots.empty()) return;
+        auto it = std::lower_bound(snapshot.sorted.begin(), snapshot.sorted.end(), prefix,
+            [](const std::shared_ptr<const FileInfo>& info, const std::string& p) { return info->fullpath < p; });
+        for (; it != snapshot.sorted.end() && (*it)->fullpath.compare(0, prefix.size(), prefix) == 0; ++it) {
+            if (std::find(roots.begin(), roots.end(), (*it)->root_path.get()) == roots.end()) continue;
+            if (!visit(*it)) return;
+        }
+    }
+
+    std::vector<std::shared_ptr<const FileInfo>> FileIndexer::list_prefix(const std::string& prefix) const {
+        std::vector<std::shared_ptr<const FileInfo>> out;
+        std::shared_ptr<const IndexSnapshot> snapshot = snapshot_.load();
+        visit_prefix(*snapshot, prefix, [&out](const std::shared_ptr<const FileInfo>& info) {
+            out.push_back(info);
+            return true;
+        });
         return out;
     }
 
-    std::time_t FileIndexer::get_timestamp_from_log_line(const std::string &line) {
-        std::string prefix = line.substr(0, 50);
-        boost::smatch matches;
-        //time zone
-        static int tz_offset = 0;
-        if (tz_offset == 0) tz_offset = util::get_local_utc_offset_seconds();
-        
-        for (const auto& tf : time_formats_) {
-            const boost::regex& pattern = tf.regex_pattern;
-            const std::string& format = tf.format;
-            if(boost::regex_search(prefix, matches, pattern) && matches.size() > 0) {
-                std::string matched_time = matches[0];
-                
-                // Try to parse the matched time string
-                std::istringstream ss(matched_time);
-                std::chrono::system_clock::time_point tp;
-                // date::parse instead std::get_time
-                ss >> date::parse(format, tp);
-                
-                if (!ss.fail()) {
-                    return std::chrono::duration_cast<std::chrono::seconds>(
-                        tp.time_since_epoch()).count() - tz_offset;
-                }
-            }
-        }
-        return 0; // Return 0 if no valid timestamp found
-    }
-
-    std::time_t FileIndexer::get_timestamp_from_log_line(const std::string_view &line) {
-        std::string prefix(line.substr(0, 50));
-        boost::smatch matches;
-        //time zone
-        static int tz_offset = 0;
-        if (tz_offset == 0) tz_offset = util::get_local_utc_offset_seconds();
-
-        for (const auto& tf : time_formats_) {
-            const boost::regex& pattern = tf.regex_pattern;
-            const std::string& format = tf.format;
-            if(boost::regex_search(prefix, matches, pattern) && matches.size() > 0) {
-                std::string matched_time = matches[0];
-                
-                // Try to parse the matched time string
-                std::istringstream ss(matched_time);
-                std::chrono::system_clock::time_point tp;
-                // date::parse instead std::get_time
-                ss >> date::parse(format, tp);
-                
-                if (!ss.fail()) {
-                    return std::chrono::duration_cast<std::chrono::seconds>(
-                        tp.time_since_epoch()).count() - tz_offset;
-                }
-            }
-        }
-        return 0; // Return 0 if no valid timestamp found
+    bool FileIndexer::has_prefix(const std::string& prefix) const {
+        bool found = false;
+        std::shared_ptr<const IndexSnapshot> snapshot = snapshot_.load();
+        visit_prefix(*snapshot, prefix, [&found](const std::shared_ptr<const FileInfo>&) {
+            found = true;
+            return false;
+        });
+        return found;
+    }
+
+    // a root without a zone reads its times in the host zone, with the offset of the instant they name
+    static std::time_t to_utc(const std::shared_ptr<RootPath> &root, int64_t seconds, bool is_utc) {
+        if (is_utc) return static_cast<std::time_t>(seconds);
+        if (root && root->zone) return static_cast<std::time_t>(root->zone->to_utc(seconds));
+        // the host zone is resolved once, not per line
+        static const std::shared_ptr<const time_zone> local = time_zone::local();
+        return static_cast<std::time_t>(local->to_utc(seconds));
+    }
+
+    // root pattern or built-in layouts at the pinned column
+    static bool parse_pinned(const std::string_view &line, const std::shared_ptr<RootPath> &root,
+        const FileIndex &file_index, const civil_date &today, int64_t &seconds, bool &is_utc) {
+        is_utc = false;
+        if (file_index.time_format == TIME_FMT_NONE) return false;
+        if (file_index.time_format == TIME_FMT_CUSTOM) {
+            return root && root->time_format && root->time_format->parse_at(line, file_index.time_offset, today, seconds, is_utc);
+        }
+        return time_parser::parse_at(line, file_index.time_format, file_index.time_offset, seconds);
+    }
+
+    // a root pattern is used exclusively, the built-in layouts only without one
+    static bool parse_with_root(const std::string_view &line, const std::shared_ptr<RootPath> &root,
+        const civil_date &today, time_match &match, bool &is_utc) {
+        is_utc = false;
+        if (root && root->time_format) {
+            return root->time_format->parse(line, today, match, is_utc);
+        }
+        return time_parser::parse(line, match);
+    }
+
+    std::time_t FileIndexer::get_timestamp_from_log_line(const std::string_view &line, const std::shared_ptr<RootPath> &root,
+        const FileIndex &file_index, const civil_date &today) {
+        int64_t seconds = 0;
+        bool is_utc = false;
+        if (parse_pinned(line, root, file_index, today, seconds, is_utc)) {
+            return to_utc(root, seconds, is_utc);
+        }
+        time_match match;
+        if (!parse_with_root(line, root, today, match, is_utc)) {
+            return 0;
+        }
+        return to_utc(root, match.local_seconds, is_utc);
+    }
+
+    std::time_t FileIndexer::detect_timestamp_from_log_line(const std::string_view &line, const std::shared_ptr<RootPath> &root,
+        FileIndex &file_index, const civil_date &today) {
+        int64_t seconds = 0;
+        bool is_utc = false;
+        if (parse_pinned(line, root, file_index, today, seconds, is_utc)) {
+            return to_utc(root, seconds, is_utc);
+        }
+        time_match match;
+        if (!parse_with_root(line, root, today, match, is_utc)) {
+            return 0;
+        }
+        if (file_index.time_format == TIME_FMT_NONE) {
+            file_index.time_format = match.format;
+            file_index.time_offset = match.offset;
+        }
+        return to_utc(root, match.local_seconds, is_utc);
     }
 
     void FileIndexer::remove_unused_indexes() {
         std::unique_lock<std::shared_mutex> lock(mutex_);
         for (auto it = index_.begin(); it != index_.end(); ) {
+            if (it->second->cold && !fs::exists(it->first)) {
+                // its sidecar goes with the next eviction pass
+                spdlog::info("Removing cold file: {}", it->first);
+                it = index_.erase(it);
+                continue;
+            }
             //skip non-indexed files
             if (!it->second->file_index || it->second->file_index->time_indexes.empty()) {
                 //spdlog::info("Removing unused index for file: {}", it->first);
@@ -823,180 +1386,612 @@ namespace drlog {
             if (!fs::exists(it->first)) {
                 //remove deleted files
                 spdlog::info("Removing index for deleted file: {}", it->first);
+                detach_file_info(it->second);
                 it = index_.erase(it);
                 continue;
             }
             ++it;
         }
+        lock.unlock();
+        publish_snapshot();
+    }
+
+    // files that went cold leave memory: a current index is written to a sidecar first and the time
+    // range it covers stays with the file; the sidecars of files no longer cold or gone are removed
+    void FileIndexer::evict_cold_indexes() {
+        const fs::path dir = fs::path(cache_path_) / "cold";
+        const std::time_t now = std::time(nullptr);
+        std::vector<std::shared_ptr<FileInfo>> candidates;
+        std::vector<std::shared_ptr<FileInfo>> unranged;
+        std::unordered_set<std::string> names;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            for (const auto& [path, info] : index_) {
+                if (info->cold) {
+                    names.insert(fs::path(cold_index_path(path)).filename().string());
+                    if (info->start_time == 0) unranged.push_back(info);
+                } else if (is_cold(*info, now)) {
+                    candidates.push_back(info);
+                }
+            }
+        }
+        // found cold by the scan after a restart, the sidecar tells the range
+        for (const auto& info : unranged) {
+            IndexCache cache;
+            if (!cache.open(cold_index_path(info->fullpath)) || cache.size() != 1) continue;
+            CacheEntry e = cache.entry(0);
+            if (!e.has_file_index || e.inode != info->inode || e.index_etag != info->etag || e.time_index_count == 0) continue;
+            auto ranged = std::make_shared<FileInfo>(*info);
+            ranged->start_time = e.time_indexes[0].timestamp;
+            ranged->end_time = e.time_indexes[e.time_index_count - 1].timestamp;
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            auto it = index_.find(info->fullpath);
+            if (it != index_.end() && it->second == info) it->second = std::move(ranged);
+        }
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        if (ec) {
+            spdlog::warn("Failed to create cold index dir {}: {}", dir.string(), ec.message());
+            return;
+        }
+        double d1 = util::get_micro_timestamp();
+        std::size_t evicted = 0;
+        for (const auto& info : candidates) {
+            auto cold = std::make_shared<FileInfo>(*info);
+            cold->cold = true;
+            cold->file_index = nullptr;
+            cold->start_time = 0;
+            cold->end_time = static_cast<uint64_t>(info->mtime);
+            const FileIndex* idx = info->file_index.get();
+            if (idx && idx->index_etag == info->etag && !idx->time_indexes.empty()) {
+                uint64_t checksum = 0;
+                // kept in memory when the sidecar can not be written
+                if (!IndexCache::write(cold_index_path(info->fullpath), {info}, checksum)) continue;
+                cold->start_time = idx->time_indexes.front().timestamp;
+                cold->end_time = idx->time_indexes.back().timestamp;
+            }
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            auto it = index_.find(info->fullpath);
+            if (it == index_.end() || it->second != info) continue;
+            it->second = std::move(cold);
+            names.insert(fs::path(cold_index_path(info->fullpath)).filename().string());
+            ++evicted;
+        }
+        // temp files are being written by IndexCache::write, and a file being built by load_cold_index
+        // may have gone cold after names was taken; cold_mutex_ keeps new builds out of the sweep
+        std::size_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(cold_mutex_);
+            for (const auto& [path, build] : cold_builds_) names.insert(fs::path(cold_index_path(path)).filename().string());
+            for (const auto& entry : fs::directory_iterator(dir, ec)) {
+                const std::string name = entry.path().filename().string();
+                if (names.count(name) || name.ends_with(".tmp")) continue;
+                fs::remove(entry.path(), ec);
+                ++dropped;
+            }
+        }
+        if (evicted > 0 || !unranged.empty()) publish_snapshot();
+        double d2 = util::get_micro_timestamp();
+        spdlog::info("Evicted {} cold file indexes, cold={} dropped_sidecars={} time_cost={}", evicted, names.size(), dropped, (d2-d1)/1000.0);
     }
 
     void FileIndexer::save_index_to_cache() {
         try {
-            if (updated_index_count_ == 0) {
+            if (updated_index_count_ == 0 && !cache_compact_pending_) {
                 spdlog::info("No updated indexes, skipping cache save");
                 return;
             }
             // ensure cache dir exists
             if (!cache_path_.empty()) fs::create_directories(cache_path_);
 
-            fs::path target = fs::path(cache_path_) / ".index_cache.json";
-            fs::path tmp = target.string() + ".tmp";
+            std::vector<std::shared_ptr<FileInfo>> snapshot = snapshot_index();
+            // small changes go to the journal, the base cache is rewritten when the journal grew
+            // to a good part of it or the compaction interval passed
+            bool compact = cache_compact_pending_ ||
+                std::time(nullptr) - last_cache_compact_ >= static_cast<std::time_t>(cache_compact_interval_seconds_) ||
+                journal_size_ > std::max<std::size_t>(cache_base_size_ / 2, MIN_JOURNAL_COMPACT_SIZE);
+            if (!compact && append_index_journal(snapshot)) return;
+            write_index_cache(snapshot);
+        } catch (const std::exception &e) {
+            spdlog::error("Exception in save_index_to_cache: {}", e.what());
+        }
+    }
 
-            // make a snapshot copy of index_ under lock, then release lock
-            std::unordered_map<std::string, std::shared_ptr<FileInfo>> snapshot;
-            {
-                std::shared_lock<std::shared_mutex> lock(mutex_);
-                snapshot = index_; // copy
-            }
-
-            json j = json::array();
-            for (const auto &kv : snapshot) {
-                const FileInfo &fi = *kv.second;
-                json o;
-                o["fullpath"] = fi.fullpath;
-                o["name"] = fi.name;
-                o["dir"] = fi.dir;
-                o["size"] = fi.size;
-                o["mtime"] = fi.mtime;
-                o["ftype"] = fi.file_type;
-                o["etag"] = fi.etag;
-                o["inode"] = fi.inode;
-                // root path -> only store path string (regex not serializable)
-                o["root_path"] = fi.root_path->path;
-                if (fi.file_index) {
-                    json idx;
-                    idx["index_etag"] = fi.file_index->index_etag;
-                    idx["last_index_time"] = fi.file_index->last_index_time;
-                    idx["time_indexes"] = json::array();
-                    for (const auto &ti : fi.file_index->time_indexes) {
-                        json it;
-                        it["timestamp"] = ti.timestamp;
-                        it["offset"] = ti.offset;
-                        idx["time_indexes"].push_back(it);
-                    }
-                    o["file_index"] = idx;
+    // sidecar of a file, named by a hash of its path
+    std::string FileIndexer::trigram_path(const std::string& fullpath) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.tri", util::MurMurHash64(fullpath.data(), fullpath.size(), HEAD_FINGERPRINT_SEED));
+        return (fs::path(cache_path_) / "trigrams" / name).string();
+    }
+
+    // evicted index of a cold file, named like the trigram sidecars
+    std::string FileIndexer::cold_index_path(const std::string& fullpath) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.idx", util::MurMurHash64(fullpath.data(), fullpath.size(), HEAD_FINGERPRINT_SEED));
+        return (fs::path(cache_path_) / "cold" / name).string();
+    }
+
+    // build the trigram indexes of the files of roots with a trigram budget once they stop changing:
+    // gzip files as soon as they are indexed, text files after TRIGRAM_IDLE_SECONDS without a write.
+    // Newer files go first, a file that does not fit the rest of its root's budget gets none
+    void FileIndexer::update_trigram_indexes() {
+        bool enabled = false;
+        for (const auto& rp : roots_) enabled = enabled || rp->trigram_budget > 0;
+        if (!enabled) return;
+        const fs::path dir = fs::path(cache_path_) / "trigrams";
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        if (ec) {
+            spdlog::warn("Failed to create trigram index dir {}: {}", dir.string(), ec.message());
+            return;
+        }
+        const std::time_t now = std::time(nullptr);
+        std::unordered_map<const RootPath*, uint64_t> used;
+        std::vector<std::shared_ptr<FileInfo>> candidates;
+        std::size_t dropped = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            // drop the sidecars of removed and changed files
+            for (auto it = trigrams_.begin(); it != trigrams_.end(); ) {
+                auto f = index_.find(it->first);
+                if (f == index_.end() || !f->second->file_index || f->second->file_index->index_etag != it->second->etag() ||
+                    !f->second->root_path || f->second->root_path->trigram_budget == 0) {
+                    fs::remove(trigram_path(it->first), ec);
+                    it = trigrams_.erase(it);
+                    ++dropped;
+                    continue;
                 }
-                j.push_back(o);
+                used[f->second->root_path.get()] += it->second->size();
+                ++it;
             }
+            if (dropped > 0) trigram_rejected_.clear();
+            std::unordered_set<std::string> names;
+            for (const auto& kv : index_) {
+                const std::shared_ptr<FileInfo>& info = kv.second;
+                if (!info->root_path || info->root_path->trigram_budget == 0) continue;
+                names.insert(fs::path(trigram_path(kv.first)).filename().string());
+                if (trigrams_.count(kv.first)) continue;
+                if (!info->file_index || info->file_index->index_etag != info->etag || info->file_index->time_indexes.size() < 2) continue;
+                if (info->file_type != "gzip" && now - info->mtime < TRIGRAM_IDLE_SECONDS) continue;
+                auto rejected = trigram_rejected_.find(kv.first);
+                if (rejected != trigram_rejected_.end() && rejected->second == info->etag) continue;
+                candidates.push_back(info);
+            }
+            // sidecars of files removed while the agent was down
+            if (!trigram_dir_swept_) {
+                for (const auto& entry : fs::directory_iterator(dir, ec)) {
+                    if (!names.count(entry.path().filename().string())) fs::remove(entry.path(), ec);
+                }
+                trigram_dir_swept_ = true;
+            }
+        }
+        if (candidates.empty()) {
+            if (dropped > 0) publish_snapshot();
+            return;
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a->mtime > b->mtime; });
 
-            // write to temp file
-            std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
-            if (!ofs.is_open()) {
-                spdlog::error("Failed to open cache temp file for writing: {}", tmp.string());
-                return;
+        double d1 = util::get_micro_timestamp();
+        std::mutex budget_mutex;
+        std::atomic<std::size_t> built{0};
+        std::atomic<uint64_t> built_size{0};
+        thread_pool* pool = worker_pool();
+        for (const auto& info : candidates) {
+            pool->submit([this, info, &used, &budget_mutex, &built, &built_size] {
+                const RootPath* rp = info->root_path.get();
+                const std::string path = trigram_path(info->fullpath);
+                auto index = std::make_shared<TrigramIndex>();
+                // left over from an earlier run
+                bool loaded = index->open(path, info->file_index->index_etag);
+                if (!loaded) {
+                    uint64_t remaining = 0;
+                    {
+                        std::lock_guard<std::mutex> lock(budget_mutex);
+                        remaining = rp->trigram_budget > used[rp] ? rp->trigram_budget - used[rp] : 0;
+                    }
+                    double t1 = util::get_micro_timestamp();
+                    uint64_t size = 0;
+                    const civil_date today = civil_date::today();
+                    auto record_start = [this, &info, &today](std::string_view line) {
+                        return get_timestamp_from_log_line(line, info->root_path, *info->file_index, today) != 0;
+                    };
+                    bool ok = remaining > 0 && TrigramIndex::build(*info, path, record_start, remaining, size) &&
+                        index->open(path, info->file_index->index_etag);
+                    double t2 = util::get_micro_timestamp();
+                    if (!ok) {
+                        std::error_code ec;
+                        fs::remove(path, ec);
+                        if (size > remaining) {
+                            spdlog::debug("Trigram index of {} needs {} bytes, {} left in the budget of root {}", info->fullpath, size, remaining, rp->path);
+                        }
+                        std::unique_lock<std::shared_mutex> wlock(mutex_);
+                        trigram_rejected_[info->fullpath] = info->etag;
+                        return;
+                    }
+                    spdlog::info("Built trigram index of {} chunks={} size={} time_cost={}", info->fullpath, index->chunk_count(), size, (t2-t1)/1000.0);
+                    built++;
+                    built_size += size;
+                }
+                {
+                    // concurrent builds may together pass the budget, the later ones give way
+                    std::lock_guard<std::mutex> lock(budget_mutex);
+                    if (used[rp] + index->size() > rp->trigram_budget) {
+                        std::error_code ec;
+                        fs::remove(path, ec);
+                        std::unique_lock<std::shared_mutex> wlock(mutex_);
+                        trigram_rejected_[info->fullpath] = info->etag;
+                        return;
+                    }
+                    used[rp] += index->size();
+                }
+                std::unique_lock<std::shared_mutex> wlock(mutex_);
+                trigrams_[info->fullpath] = index;
+            });
+        }
+        pool->wait();
+        publish_snapshot();
+        double d2 = util::get_micro_timestamp();
+        uint64_t total = 0;
+        for (const auto& kv : used) total += kv.second;
+        spdlog::info("Built {} of {} trigram indexes size={} total_size={} time_cost={}", built.load(), candidates.size(),
+            built_size.load(), total, (d2-d1)/1000.0);
+    }
+
+    // FileInfo and FileIndex are never modified once published, copying the pointers is enough
+    std::vector<std::shared_ptr<FileInfo>> FileIndexer::snapshot_index() const {
+        std::vector<std::shared_ptr<FileInfo>> snapshot;
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        snapshot.reserve(index_.size());
+        for (const auto& kv : index_) snapshot.push_back(kv.second);
+        return snapshot;
+    }
+
+    // rebuild what the searchers see from index_ and trigrams_, the old snapshot lives on
+    // until its last reader lets go of it
+    void FileIndexer::publish_snapshot() {
+        std::lock_guard<std::mutex> publish_lock(snapshot_mutex_);
+        auto next = std::make_shared<IndexSnapshot>();
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            next->files.reserve(index_.size());
+            next->sorted.reserve(index_.size());
+            for (const auto& [path, info] : index_) {
+                auto t = trigrams_.find(path);
+                next->files.emplace(info->fullpath, IndexSnapshot::Entry{info, t != trigrams_.end() ? t->second : nullptr});
+                next->sorted.push_back(info);
             }
-            ofs << j.dump(2);
-            ofs.close();
+            next->roots = roots_;
+        }
+        std::sort(next->sorted.begin(), next->sorted.end(),
+            [](const auto& a, const auto& b) { return a->fullpath < b->fullpath; });
+        last_snapshot_time_ = util::get_micro_timestamp();
+        snapshot_.store(std::move(next));
+    }
 
-            // atomic replace
-            std::error_code ec;
-            fs::rename(tmp, target, ec);
-            if (ec) {
-                // fallback to std::rename
-                if (std::rename(tmp.string().c_str(), target.string().c_str()) != 0) {
-                    spdlog::error("Failed to move cache temp file {} to {}: {}", tmp.string(), target.string(), ec.message());
+    bool FileIndexer::write_index_cache(const std::vector<std::shared_ptr<FileInfo>>& snapshot) {
+        fs::path target = fs::path(cache_path_) / ".index_cache.bin";
+        fs::path journal = fs::path(cache_path_) / ".index_journal";
+        // until both are written the journal may not continue from the base
+        cache_compact_pending_ = true;
+        double d1 = util::get_micro_timestamp();
+        uint64_t checksum = 0;
+        if (!IndexCache::write(target.string(), snapshot, checksum)) return false;
+        if (!IndexJournal::create(journal.string(), checksum)) return false;
+        double d2 = util::get_micro_timestamp();
+
+        persisted_.clear();
+        for (const auto& fi : snapshot) {
+            if (fi->file_index) persisted_.emplace(fi->fullpath, PersistedIndex{fi->inode, fi->file_index});
+        }
+        std::error_code ec;
+        cache_base_size_ = fs::file_size(target, ec);
+        journal_size_ = 0;
+        last_cache_compact_ = std::time(nullptr);
+        cache_compact_pending_ = false;
+        spdlog::info("Index cache saved to {}, entries={} time_cost={}", target.string(), snapshot.size(), (d2-d1)/1000.0);
+        return true;
+    }
+
+    // journal the difference between the snapshot and what the base cache and the journal hold
+    bool FileIndexer::append_index_journal(const std::vector<std::shared_ptr<FileInfo>>& snapshot) {
+        std::string records;
+        std::vector<std::pair<std::string, PersistedIndex>> changed;
+        std::vector<std::string> removed;
+        std::unordered_set<std::string_view> live;
+        live.reserve(snapshot.size());
+        for (const auto& fi : snapshot) {
+            live.insert(fi->fullpath);
+            auto it = persisted_.find(fi->fullpath);
+            if (!fi->file_index) {
+                if (it != persisted_.end()) {
+                    IndexJournal::encode_remove(records, fi->fullpath);
+                    removed.push_back(fi->fullpath);
                 }
-            } else {
-                spdlog::info("Wrote index cache to {}", target.string());
+                continue;
             }
-            spdlog::info("Index cache saved, entries={}", snapshot.size());
-        } catch (const std::exception &e) {
-            spdlog::error("Exception in save_index_to_cache: {}", e.what());
+            if (it != persisted_.end() && it->second.index == fi->file_index && it->second.inode == fi->inode) continue;
+
+            // a grown file is indexed again from its last entry, the entries before it stay a prefix
+            std::size_t kept = 0;
+            bool appended = false;
+            // resuming keeps the filters, values and stats of the kept blocks, a file that gained or lost them is written whole
+            if (it != persisted_.end() && it->second.inode == fi->inode &&
+                it->second.index->block_filters.empty() == fi->file_index->block_filters.empty() &&
+                it->second.index->block_stats.empty() == fi->file_index->block_stats.empty() &&
+                it->second.index->block_tokens.empty() == fi->file_index->block_tokens.empty() &&
+                it->second.index->token_pattern_hash == fi->file_index->token_pattern_hash) {
+                const auto& old = it->second.index->time_indexes;
+                const auto& cur = fi->file_index->time_indexes;
+                auto is_prefix = [&](std::size_t n) {
+                    return n <= cur.size() && (n == 0 || std::memcmp(old.data(), cur.data(), n * sizeof(TimeIndex)) == 0);
+                };
+                if (is_prefix(old.size())) {
+                    kept = old.size();
+                    appended = true;
+                } else if (!old.empty() && is_prefix(old.size() - 1)) {
+                    kept = old.size() - 1;
+                    appended = true;
+                }
+            }
+            if (appended) IndexJournal::encode_append(records, *fi, kept);
+            else IndexJournal::encode_file(records, *fi);
+            changed.emplace_back(fi->fullpath, PersistedIndex{fi->inode, fi->file_index});
+        }
+        for (const auto& kv : persisted_) {
+            if (live.count(kv.first)) continue;
+            IndexJournal::encode_remove(records, kv.first);
+            removed.push_back(kv.first);
+        }
+        if (records.empty()) return true;
+
+        fs::path journal = fs::path(cache_path_) / ".index_journal";
+        if (!IndexJournal::append(journal.string(), records)) {
+            cache_compact_pending_ = true;
+            return false;
+        }
+        for (auto& kv : changed) persisted_[kv.first] = std::move(kv.second);
+        for (const auto& path : removed) persisted_.erase(path);
+        journal_size_ += records.size();
+        spdlog::info("Index journal appended, changed={} removed={} bytes={}", changed.size(), removed.size(), records.size());
+        return true;
+    }
+
+    // the FileIndex of a cache entry; filters, token values and stats that do not fit its time index are left out
+    std::shared_ptr<FileIndex> FileIndexer::decode_cached_index(const CacheEntry& e) {
+        auto pfi = std::make_shared<FileIndex>();
+        pfi->index_etag.assign(e.index_etag.data(), e.index_etag.size());
+        pfi->last_index_time = e.last_index_time;
+        pfi->time_format = e.time_format;
+        pfi->time_offset = e.time_offset;
+        pfi->time_indexes.assign(e.time_indexes, e.time_indexes + e.time_index_count);
+        if (!IndexCache::decode_inflate_points(e.inflate_points, pfi->inflate_points)) {
+            spdlog::warn("Dropping corrupt inflate points of cached index for {}", e.fullpath);
+        }
+        pfi->head_hash = e.head_hash;
+        pfi->head_size = e.head_size;
+        if (!IndexCache::decode_block_filters(e.block_filters, pfi->block_filters, pfi->block_filter_words) ||
+            pfi->block_filters.size() != pfi->time_indexes.size() || pfi->block_filters.back() != pfi->block_filter_words.size()) {
+            // searched without them until the file is indexed from scratch
+            pfi->block_filters.clear();
+            pfi->block_filter_words.clear();
+        }
+        pfi->token_pattern_hash = e.token_pattern_hash;
+        if (!IndexCache::decode_block_filters(e.block_tokens, pfi->block_tokens, pfi->block_token_hashes) ||
+            pfi->block_tokens.size() != pfi->time_indexes.size() || pfi->block_tokens.back() != pfi->block_token_hashes.size()) {
+            pfi->block_tokens.clear();
+            pfi->block_token_hashes.clear();
+            pfi->token_pattern_hash = 0;
+        }
+        if (!IndexCache::decode_block_stats(e.block_stats, pfi->block_stats) || pfi->block_stats.size() != pfi->time_indexes.size()) {
+            pfi->block_stats.clear();
+        }
+        return pfi;
+    }
+
+    // attach a cached index to the scanned entry of the same file; the scanned size, mtime and
+    // etag are kept, so a file that changed while the agent was down is re-indexed from there
+    bool FileIndexer::attach_cached_index(const CacheEntry& e, const std::unordered_map<std::string, std::shared_ptr<RootPath>>& root_paths) {
+        if (!e.has_file_index) return false;
+        auto root = root_paths.find(std::string(e.root_path));
+        if (root == root_paths.end()) return false;
+        auto it = index_.find(std::string(e.fullpath));
+
+        auto pfi = decode_cached_index(e);
+        // gone or another file under the same name; it may have been renamed while the agent was down
+        if (it == index_.end() || it->second->inode != e.inode) {
+            auto moved = std::make_shared<FileInfo>();
+            moved->fullpath.assign(e.fullpath.data(), e.fullpath.size());
+            moved->name = fs::path(moved->fullpath).filename().string();
+            moved->size = e.size;
+            moved->etag.assign(e.etag.data(), e.etag.size());
+            moved->file_type = file_type_of(moved->name);
+            moved->inode = e.inode;
+            moved->root_path = root->second;
+            moved->file_index = std::move(pfi);
+            detach_file_info(moved);
+            return false;
         }
+        auto updated = std::make_shared<FileInfo>(*it->second);
+        updated->file_index = std::move(pfi);
+        // an index cached before the file went cold, the next eviction pass moves it to a sidecar
+        updated->cold = false;
+        it->second = std::move(updated);
+        return true;
     }
 
     void FileIndexer::load_index_from_cache() {
         try {
-            fs::path target = fs::path(cache_path_) / ".index_cache.json";
-            if (!fs::exists(target)) {
-                spdlog::debug("Cache file not found: {}", target.string());
-                return;
+            fs::path target = fs::path(cache_path_) / ".index_cache.bin";
+            fs::path journal = fs::path(cache_path_) / ".index_journal";
+            fs::path legacy = fs::path(cache_path_) / ".index_cache.json";
+
+            std::unordered_map<std::string, std::shared_ptr<RootPath>> root_paths;
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex_);
+                for (const auto& rp : roots_) root_paths.emplace(rp->path, rp);
             }
-            std::ifstream ifs(target, std::ios::binary);
-            if (!ifs.is_open()) {
-                spdlog::error("Failed to open cache file for reading: {}", target.string());
+
+            IndexCache cache;
+            if (cache.open(target.string())) {
+                double d1 = util::get_micro_timestamp();
+                std::size_t entries = 0, attached = 0, records = 0;
+                {
+                    std::unique_lock<std::shared_mutex> lock(mutex_);
+                    records = IndexJournal::merge(cache, journal.string(), [&](const CacheEntry& e) {
+                        ++entries;
+                        if (attach_cached_index(e, root_paths)) ++attached;
+                    });
+                }
+                double d2 = util::get_micro_timestamp();
+                spdlog::info("Loaded index cache from {}, entries={} journal_records={} attached={} time_cost={}",
+                    target.string(), entries, records, attached, (d2-d1)/1000.0);
                 return;
             }
-            json j;
-            try {
-                ifs >> j;
-            } catch (const std::exception &e) {
-                spdlog::error("Failed to parse cache JSON {}: {}", target.string(), e.what());
+            if (fs::exists(legacy)) {
+                // one-time migration from the JSON cache of older agents
+                if (!load_index_from_json(legacy, root_paths)) return;
+                if (write_index_cache(snapshot_index())) {
+                    std::error_code ec;
+                    fs::rename(legacy, legacy.string() + ".migrated", ec);
+                    if (ec) spdlog::warn("Failed to rename migrated cache {}: {}", legacy.string(), ec.message());
+                    else spdlog::info("Migrated index cache {} to {}", legacy.string(), target.string());
+                }
                 return;
             }
+            spdlog::debug("Cache file not found: {}", target.string());
+        } catch (const std::exception &e) {
+            spdlog::error("Exception in load_index_from_cache: {}", e.what());
+        }
+    }
 
-            //make root path to temp map from roots_
-            std::unordered_map<std::string, std::shared_ptr<RootPath>> root_paths;
-            for (const auto rp : roots_) {
-                root_paths.emplace(rp->path, rp);
-            }
+    bool FileIndexer::load_index_from_json(const fs::path& target, const std::unordered_map<std::string, std::shared_ptr<RootPath>>& root_paths) {
+        std::ifstream ifs(target, std::ios::binary);
+        if (!ifs.is_open()) {
+            spdlog::error("Failed to open cache file for reading: {}", target.string());
+            return false;
+        }
+        json j;
+        try {
+            ifs >> j;
+        } catch (const std::exception &e) {
+            spdlog::error("Failed to parse cache JSON {}: {}", target.string(), e.what());
+            return false;
+        }
 
-            // build temporary map then swap in under lock
-            std::unordered_map<std::string, std::shared_ptr<FileInfo>> tmp_index;
-            for (const auto &o : j) {
-                try {
-                    std::shared_ptr<FileInfo> fi = std::make_shared<FileInfo>();
-                    fi->fullpath = o.value("fullpath", std::string());
-                    std::string rp = o.value("root_path", std::string());
-                    // set regex from root_paths map
-                    if (root_paths.find(rp) == root_paths.end() || index_.find(fi->fullpath) == index_.end()) {
-                        spdlog::warn("Skipping cache entry with unknown root path or past by filter: {}", fi->fullpath);
-                        continue;
-                    }
-                    fi->root_path = root_paths[rp];
-                    fi->name = o.value("name", std::string());
-                    fi->dir = o.value("dir", std::string());
-                    fi->size = o.value("size", std::uint64_t(0));
-                    fi->mtime = o.value("mtime", std::time_t(0));
-                    fi->file_type = o.value("ftype", std::string());
-                    fi->etag = o.value("etag", std::string());
-                    fi->inode = o.value("inode", uint64_t(0));
-        
-                    fi->root_path->path_regex = boost::regex(fi->root_path->path_pattern);
-                    fi->root_path->filename_regex = boost::regex(fi->root_path->filename_pattern);
-                    fi->root_path->time_format_regex = boost::regex(fi->root_path->time_format_pattern);
-                    fi->root_path->prefix_regex = boost::regex(fi->root_path->prefix_pattern);
-                    
-                    if (o.contains("file_index")) {
-                        const auto &idx = o["file_index"];
-                        auto pfi = std::make_shared<FileIndex>();
-                        pfi->index_etag = idx.value("index_etag", std::string());
-                        pfi->last_index_time = idx.value("last_index_time", std::time_t(0));
-                        if (idx.contains("time_indexes") && idx["time_indexes"].is_array()) {
-                            for (const auto &it : idx["time_indexes"]) {
-                                TimeIndex ti;
-                                ti.timestamp = it.value("timestamp", uint64_t(0));
-                                ti.offset = it.value("offset", uint64_t(0));
-                                pfi->time_indexes.push_back(ti);
-                            }
-                        }
-                        fi->file_index = std::move(pfi);
+        std::size_t attached = 0;
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (const auto &o : j) {
+            try {
+                if (!o.contains("file_index")) continue;
+                const auto &idx = o["file_index"];
+                // the views of a CacheEntry only need to outlive attach_cached_index
+                std::string fullpath = o.value("fullpath", std::string());
+                std::string root_path = o.value("root_path", std::string());
+                std::string index_etag = idx.value("index_etag", std::string());
+                std::vector<TimeIndex> time_indexes;
+                if (idx.contains("time_indexes") && idx["time_indexes"].is_array()) {
+                    for (const auto &it : idx["time_indexes"]) {
+                        TimeIndex ti;
+                        ti.timestamp = it.value("timestamp", uint64_t(0));
+                        ti.offset = it.value("offset", uint64_t(0));
+                        time_indexes.push_back(ti);
                     }
-                    if (!fi->fullpath.empty()) tmp_index.emplace(fi->fullpath, std::move(fi));
-                } catch (const std::exception &e) {
-                    spdlog::warn("Skipping invalid cache entry: {}", e.what());
                 }
+                CacheEntry e;
+                e.fullpath = fullpath;
+                e.root_path = root_path;
+                e.inode = o.value("inode", uint64_t(0));
+                e.has_file_index = true;
+                e.index_etag = index_etag;
+                e.last_index_time = idx.value("last_index_time", std::time_t(0));
+                e.time_format = idx.value("time_format", int(TIME_FMT_NONE));
+                e.time_offset = idx.value("time_offset", uint32_t(0));
+                e.time_indexes = time_indexes.data();
+                e.time_index_count = time_indexes.size();
+                if (attach_cached_index(e, root_paths)) ++attached;
+            } catch (const std::exception &e) {
+                spdlog::warn("Skipping invalid cache entry: {}", e.what());
             }
+        }
+        spdlog::info("Loaded index cache from {}, entries={} attached={}", target.string(), j.size(), attached);
+        return true;
+    }
 
-            // swap into live index under write lock
-            {
-                std::unique_lock<std::shared_mutex> lock(mutex_);
-                index_.swap(tmp_index);
-            }
-            spdlog::info("Loaded index cache from {}, entries={}", target.string(), index_.size());
-        } catch (const std::exception &e) {
-            spdlog::error("Exception in load_index_from_cache: {}", e.what());
+    std::shared_ptr<const TrigramIndex> FileIndexer::get_trigram_index(const FileInfo& info) const {
+        if (!info.file_index) return nullptr;
+        std::shared_ptr<const IndexSnapshot> snapshot = snapshot_.load();
+        auto it = snapshot->files.find(info.fullpath);
+        if (it == snapshot->files.end() || !it->second.trigrams || it->second.trigrams->etag() != info.file_index->index_etag) return nullptr;
+        return it->second.trigrams;
+    }
+
+    std::shared_ptr<const FileInfo> FileIndexer::read_cold_index(const std::shared_ptr<const FileInfo>& info) const {
+        IndexCache cache;
+        if (!cache.open(cold_index_path(info->fullpath)) || cache.size() != 1) return nullptr;
+        CacheEntry e = cache.entry(0);
+        if (!e.has_file_index || e.inode != info->inode || e.index_etag != info->etag) return nullptr;
+        auto loaded = std::make_shared<FileInfo>(*info);
+        loaded->file_index = decode_cached_index(e);
+        return loaded;
+    }
+
+    // cold indexes are not kept once the search is done, a file past max_days is seldom searched twice
+    std::shared_ptr<const FileInfo> FileIndexer::load_cold_index(const std::shared_ptr<const FileInfo>& info) {
+        if (auto loaded = read_cold_index(info)) return loaded;
+        // concurrent searches of the file wait for one build, the entry goes with its last waiter
+        std::shared_ptr<std::mutex> build_mutex;
+        {
+            std::lock_guard<std::mutex> lock(cold_mutex_);
+            auto& slot = cold_builds_[info->fullpath];
+            if (!slot) slot = std::make_shared<std::mutex>();
+            build_mutex = slot;
+        }
+        std::shared_ptr<const FileInfo> result;
+        {
+            std::lock_guard<std::mutex> lock(*build_mutex);
+            result = read_cold_index(info);
+            if (!result) result = build_cold_index(*info, std::make_shared<FileInfo>(*info), cold_index_path(info->fullpath));
         }
+        std::lock_guard<std::mutex> lock(cold_mutex_);
+        auto it = cold_builds_.find(info->fullpath);
+        if (it != cold_builds_.end() && it->second == build_mutex && build_mutex.use_count() == 2) cold_builds_.erase(it);
+        return result;
     }
 
-    bool FileIndexer::get_file_index_by_path(const std::string& path, FileInfo& out_info) const {
-        std::shared_lock<std::shared_mutex> lock(mutex_);
-        auto it = index_.find(path);
-        if (it != index_.end()) {
-            out_info = *it->second;
-            return true;
+    std::shared_ptr<const FileInfo> FileIndexer::build_cold_index(const FileInfo& info, const std::shared_ptr<FileInfo>& loaded,
+                                                                  const std::string& path) {
+        try {
+            double d1 = util::get_micro_timestamp();
+            auto output = std::make_shared<FileIndex>();
+            FileInfo source = info;
+            source.file_index = nullptr;
+            if (source.file_type == "gzip") {
+                update_file_index_igzip(source.fullpath, source, *output);
+            } else {
+                update_file_index_txt_mmap(source.fullpath, source, *output);
+            }
+            output->index_etag = info.etag;
+            output->last_index_time = std::time(nullptr);
+            loaded->file_index = output;
+            if (!output->time_indexes.empty()) {
+                std::error_code ec;
+                fs::create_directories(fs::path(path).parent_path(), ec);
+                uint64_t checksum = 0;
+                IndexCache::write(path, {loaded}, checksum);
+            }
+            double d2 = util::get_micro_timestamp();
+            spdlog::info("Built cold index of {} entries={} time_cost={}", info.fullpath, output->time_indexes.size(), (d2-d1)/1000.0);
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to build cold index for {}: {}", info.fullpath, e.what());
+            return nullptr;
         }
-        return false;
+        return loaded;
+    }
+
+    std::shared_ptr<const FileInfo> FileIndexer::get_file_index_by_path(const std::string& path) const {
+        std::shared_ptr<const IndexSnapshot> snapshot = snapshot_.load();
+        auto it = snapshot->files.find(path);
+        return it != snapshot->files.end() ? it->second.info : nullptr;
     }
 
 } // namespace drlog
\ No newline at end of file
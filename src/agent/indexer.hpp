@@ -8,17 +8,23 @@
 #include <string_view>
 #include <thread>
 #include <atomic>
+#include <mutex>
 #include <cstdint>
 #include <memory>
+#include <filesystem>
+#include <functional>
 #include <boost/regex.hpp>
+#include "util/time_parser.hpp"
+#include "util/time_zone.hpp"
+#include "util/thread_pool.hpp"
+#include "util/resource_governor.hpp"
+#include "util/sequential_reader.hpp"
+#include "util/gzip_index.hpp"
+#include "file_watcher.hpp"
+#include "dir_scanner.hpp"
 
 namespace drlog {
 
-    struct time_format {
-        std::string format;
-        boost::regex regex_pattern;
-    };
-
     struct RootPath {
         std::string path;
         std::string prefix_pattern;
@@ -28,8 +34,27 @@ namespace drlog {
         boost::regex prefix_regex;
         boost::regex path_regex;
         boost::regex filename_regex;
-        boost::regex time_format_regex;
+        // EXCL of a path_pattern shaped "^(?!EXCL).*", used to prune excluded directories
+        boost::regex path_exclude_regex;
+        bool has_path_exclude{false};
         int max_days{30};
+        // compiled time_format_pattern, nullptr means detect the built-in layouts
+        std::shared_ptr<time_pattern> time_format;
+        // zone the log lines are written in, nullptr means the host zone
+        std::shared_ptr<const time_zone> zone;
+        // disk bytes the trigram indexes (trigram_index.hpp) of the root's files may use, 0 builds none
+        uint64_t trigram_budget{0};
+        // ID-like fields (trace_id, order_id) whose values are indexed per block: capture group 1 of
+        // each match, the whole match without one
+        std::string token_pattern;
+        boost::regex token_regex;
+        uint64_t token_pattern_hash{0};
+        bool has_token_pattern{false};
+        // look a query the token pattern matches as a whole up in the block values; lines holding
+        // its value other than as a match of the pattern are then not found, so it is opt-in
+        bool token_lookup{false};
+        // mmap keeps the files in the page cache, stream and direct leave it to the application
+        file_read_mode read_mode{file_read_mode::mmap};
     };
 
     struct TimeIndex {
@@ -37,10 +62,44 @@ namespace drlog {
         uint64_t offset;
     };
 
+    // volume of a block: its lines and bytes, and the records whose level is ERROR, WARN or INFO
+    struct BlockStats {
+        uint64_t bytes{0};
+        uint32_t lines{0};
+        uint32_t errors{0};
+        uint32_t warns{0};
+        uint32_t infos{0};
+    };
+
     struct FileIndex {
         std::string index_etag;
         std::time_t last_index_time;
+        // timestamp layout and column detected for this file, TIME_FMT_NONE until known
+        int time_format{TIME_FMT_NONE};
+        uint32_t time_offset{0};
         std::vector<TimeIndex> time_indexes;
+        // gzip only: where a search can start inflating, sorted by out_offset
+        std::vector<inflate_point> inflate_points;
+        // hash of the first head_size bytes of the (uncompressed) content, recognizes the
+        // same file under another name and a compressed copy of it
+        uint64_t head_hash{0};
+        uint32_t head_size{0};
+        // token filter (util/token_filter.hpp) of each block from one time_indexes entry to the next,
+        // the last block runs to the end of the file: block i is the words
+        // [block_filters[i], block_filters[i + 1]) of block_filter_words, no words rules nothing out.
+        // One offset per time_indexes entry, empty when the file has no filters
+        std::vector<uint32_t> block_filters;
+        std::vector<uint64_t> block_filter_words;
+        // token_filter::token_hash of the values the root's token_pattern extracts, laid out like the
+        // filters: block i is the sorted hashes [block_tokens[i], block_tokens[i + 1]) of
+        // block_token_hashes. Empty when the root has no token_pattern or a block's values are unknown
+        std::vector<uint32_t> block_tokens;
+        std::vector<uint64_t> block_token_hashes;
+        // hash of the token_pattern the values were extracted with
+        uint64_t token_pattern_hash{0};
+        // stats of each block, the last one also counts the lines from the last entry on and entry
+        // n - 1 counts only those, so a resumed index can take them back out. Empty when unknown
+        std::vector<BlockStats> block_stats;
     };
 
     struct FileInfo {
@@ -55,8 +114,17 @@ namespace drlog {
         uint64_t inode{0};
         std::shared_ptr<FileIndex> file_index;
         std::shared_ptr<RootPath> root_path;
+        // older than the root's max_days: not indexed any more, the index was evicted to a sidecar
+        // (see FileIndexer::load_cold_index); start_time and end_time keep the time range it covered,
+        // 0 and mtime when the file went cold before it was indexed
+        bool cold{false};
+        uint64_t start_time{0};
+        uint64_t end_time{0};
     };
 
+    struct CacheEntry;
+    class TrigramIndex;
+
     class FileIndexer {
     public:
         explicit FileIndexer(unsigned scan_interval_secs);
@@ -64,51 +132,164 @@ namespace drlog {
 
         // add a root path and filename regex
         void add_root(const std::string& root_path, const std::string& filename_pattern,
-            const std::string& time_format_pattern, const std::string& path_pattern, const std::string& prefix_pattern, int max_days = 30);
+            const std::string& time_format_pattern, const std::string& path_pattern, const std::string& prefix_pattern, int max_days = 30,
+            const std::string& time_zone_name = "local", uint64_t trigram_budget = 0, const std::string& token_pattern = "",
+            bool token_lookup = false, file_read_mode read_mode = file_read_mode::mmap);
         void init_indexes();
         // background scanner control
         void start();
         void stop();
 
-        // query by prefix (prefix matches beginning of fullpath)
-        std::vector<FileInfo> list_prefix(const std::string& prefix) const;
+        // query by prefix (prefix matches beginning of fullpath), from the current snapshot
+        std::vector<std::shared_ptr<const FileInfo>> list_prefix(const std::string& prefix) const;
+        // whether list_prefix(prefix) has any file, without listing them
+        bool has_prefix(const std::string& prefix) const;
 
         // set indexing interval in seconds (e.g. 60, 300)
         void set_index_interval_seconds(unsigned seconds) { index_interval_seconds_ = seconds; }
+        unsigned index_interval_seconds() const { return index_interval_seconds_; }
         // set count threshold to force index creation after N lines
         void set_index_count_threshold(std::size_t count) { index_count_threshold_ = count; }
         void set_scan_interval_seconds(unsigned seconds) { scan_interval_seconds_ = seconds; }
+        // full rescan of the roots to reconcile missed inotify events, e.g. 3600
+        void set_full_scan_interval_seconds(unsigned seconds) { full_scan_interval_seconds_ = seconds; }
+        void set_cache_compact_interval_seconds(unsigned seconds) { cache_compact_interval_seconds_ = seconds; }
+        // uncompressed bytes between the inflate points of a gzip file, 0 disables them
+        void set_gzip_checkpoint_span(uint64_t bytes) { gzip_checkpoint_span_ = bytes; }
         void set_cache_path(const std::string& path) { cache_path_ = path; }
-        bool get_file_index_by_path(const std::string& path, FileInfo& out_info) const;
-        std::time_t get_timestamp_from_log_line(const std::string &line);
-        std::time_t get_timestamp_from_log_line(const std::string_view &line);
+        // worker threads used to index changed files, 0 = thread_pool::default_threads()
+        void set_index_threads(unsigned threads) { index_threads_ = threads; }
+        // read rate, cpu share, priorities and load threshold of the indexing threads
+        void set_index_limits(const resource_governor::limits& limits) { governor_.set_limits(limits); }
+        resource_governor::stats index_throttle_stats() const { return governor_.get_stats(); }
+        const resource_governor::limits& index_limits() const { return governor_.get_limits(); }
+        // nullptr when the path is not in the current snapshot
+        std::shared_ptr<const FileInfo> get_file_index_by_path(const std::string& path) const;
+        // a copy of the cold file info with its index read from the sidecar, or built and saved there
+        // when it has none yet; nullptr when the file can not be indexed
+        std::shared_ptr<const FileInfo> load_cold_index(const std::shared_ptr<const FileInfo>& info);
+        // same as above from the sidecar only, nullptr when the file has none; never builds
+        std::shared_ptr<const FileInfo> read_cold_index(const std::shared_ptr<const FileInfo>& info) const;
+        // trigram index of the file content info was indexed from, nullptr when there is none
+        std::shared_ptr<const TrigramIndex> get_trigram_index(const FileInfo& info) const;
+        // try the file's pinned layout first, fall back to detection on a miss;
+        // the root's time_format and zone replace the built-in layouts and the host zone when set,
+        // a layout without a year takes it from today
+        std::time_t get_timestamp_from_log_line(const std::string_view &line, const std::shared_ptr<RootPath> &root, const FileIndex &file_index,
+            const civil_date &today);
+        // same as above, and pins the layout on the first detected timestamp
+        std::time_t detect_timestamp_from_log_line(const std::string_view &line, const std::shared_ptr<RootPath> &root, FileIndex &file_index,
+            const civil_date &today);
 
     private:
         void scan_loop();
-        void scan_root(const std::shared_ptr<RootPath> rp);
+        void scan_roots();
+        void scan_file(const std::shared_ptr<RootPath>& rp, const std::string& path);
+        void update_file_info(const std::shared_ptr<RootPath>& rp, const std::string& path, const struct stat& st);
+        thread_pool* worker_pool();
+        void apply_file_changes(const FileChanges& changes);
+        void reset_watcher();
         void update_file_index();
-        void update_file_index_txt(const std::string& path, const FileInfo& file_info, std::vector<TimeIndex>& outputs);
-        void update_file_index_txt_mmap(const std::string& path, const FileInfo& file_info, std::vector<TimeIndex>& outputs);
-        void update_file_index_gzip(const std::string& path, const FileInfo& file_info, std::vector<TimeIndex>& outputs);
-        void update_file_index_igzip(const std::string& path, const FileInfo& file_info, std::vector<TimeIndex>& outputs);
+        void update_one_file_index(const std::shared_ptr<FileInfo>& info);
+        static std::string file_type_of(const std::string& filename);
+        static uint64_t head_fingerprint(const std::string& head);
+        static bool read_head(const std::string& path, const std::string& file_type, std::size_t size, std::string& out);
+        void detach_file_info(const std::shared_ptr<FileInfo>& info);
+        std::shared_ptr<FileIndex> find_renamed_index(const FileInfo& info);
+        bool map_compressed_copy(const FileInfo& info, FileIndex& output);
+        void update_file_index_txt(const std::string& path, const FileInfo& file_info, FileIndex& output);
+        void update_file_index_txt_mmap(const std::string& path, const FileInfo& file_info, FileIndex& output);
+        void update_file_index_gzip(const std::string& path, const FileInfo& file_info, FileIndex& output);
+        void update_file_index_igzip(const std::string& path, const FileInfo& file_info, FileIndex& output);
+        void update_trigram_indexes();
+        std::string trigram_path(const std::string& fullpath) const;
         void save_index_to_cache();
+        std::vector<std::shared_ptr<FileInfo>> snapshot_index() const;
+        void publish_snapshot();
+        bool write_index_cache(const std::vector<std::shared_ptr<FileInfo>>& snapshot);
+        bool append_index_journal(const std::vector<std::shared_ptr<FileInfo>>& snapshot);
         void load_index_from_cache();
+        bool load_index_from_json(const std::filesystem::path& target, const std::unordered_map<std::string, std::shared_ptr<RootPath>>& root_paths);
+        bool attach_cached_index(const CacheEntry& e, const std::unordered_map<std::string, std::shared_ptr<RootPath>>& root_paths);
+        static std::shared_ptr<FileIndex> decode_cached_index(const CacheEntry& e);
         void remove_unused_indexes();
+        void evict_cold_indexes();
+        std::string cold_index_path(const std::string& fullpath) const;
+        // index the file into loaded and write its sidecar at path, nullptr on failure
+        std::shared_ptr<const FileInfo> build_cold_index(const FileInfo& info, const std::shared_ptr<FileInfo>& loaded,
+                                                         const std::string& path);
 
     private:
         mutable std::shared_mutex mutex_;
         std::unordered_map<std::string, std::shared_ptr<FileInfo>> index_; // key = fullpath
+        // indexed files that left index_ recently, a rename or a compressed copy reuses their index
+        struct DetachedFile {
+            std::time_t detached_at;
+            std::shared_ptr<FileInfo> info;
+        };
+        static constexpr std::time_t DETACHED_TTL_SECONDS = 600;
+        static constexpr std::size_t HEAD_FINGERPRINT_SIZE = 4096;
+        static constexpr uint64_t HEAD_FINGERPRINT_SEED = 0x6865616466707274ULL;
+        std::unordered_map<uint64_t, DetachedFile> detached_; // key = inode
 
         std::vector<std::shared_ptr<RootPath>> roots_;
 
         std::thread worker_;
         std::atomic<bool> running_;
         unsigned scan_interval_seconds_;
-        std::vector<time_format> time_formats_;
+        unsigned full_scan_interval_seconds_{3600};
+        std::time_t last_full_scan_{0};
+        std::unique_ptr<FileWatcher> watcher_;
+        DirScanner dir_scanner_;
         // indexing policy: time interval and count threshold
         unsigned index_interval_seconds_;      // default interval
         std::size_t index_count_threshold_;  // default count threshold
         std::string cache_path_{"cache/"};
-        int updated_index_count_{0};
+        std::atomic<int> updated_index_count_{0};
+        // what the base cache plus its journal hold, saves journal the difference to index_
+        struct PersistedIndex {
+            uint64_t inode;
+            std::shared_ptr<const FileIndex> index;
+        };
+        static constexpr std::size_t MIN_JOURNAL_COMPACT_SIZE = 4 * 1024 * 1024;
+        std::unordered_map<std::string, PersistedIndex> persisted_; // key = fullpath
+        bool cache_compact_pending_{true};  // a journal is only appended after this process wrote its base
+        std::time_t last_cache_compact_{0};
+        std::size_t cache_base_size_{0};
+        std::size_t journal_size_{0};
+        unsigned cache_compact_interval_seconds_{3600};
+        unsigned index_threads_{0};
+        uint64_t gzip_checkpoint_span_{8 * 1024 * 1024};
+        std::unique_ptr<thread_pool> index_pool_;
+        resource_governor governor_;
+        // uncompressed bytes of a gzip file between two throttle() calls
+        static constexpr std::size_t GOVERN_SPAN = 1024 * 1024;
+        // trigram indexes of files that stopped changing, text files count once unchanged this long
+        static constexpr std::time_t TRIGRAM_IDLE_SECONDS = 3600;
+        std::unordered_map<std::string, std::shared_ptr<const TrigramIndex>> trigrams_; // key = fullpath
+        // files whose index did not fit the root's budget, by etag; retried once a sidecar is dropped
+        std::unordered_map<std::string, std::string> trigram_rejected_; // key = fullpath
+        bool trigram_dir_swept_{false};
+        // one build of a cold index per file at a time, searches of other files build theirs alongside
+        std::mutex cold_mutex_;  // guards cold_builds_, and the sidecar sweep of evict_cold_indexes
+        std::unordered_map<std::string, std::shared_ptr<std::mutex>> cold_builds_; // key = fullpath
+        // what the searchers see of index_ and trigrams_: immutable once published and replaced
+        // as a whole after a batch of changes, so readers take no lock and copy no FileInfo
+        struct IndexSnapshot {
+            struct Entry {
+                std::shared_ptr<const FileInfo> info;
+                std::shared_ptr<const TrigramIndex> trigrams;
+            };
+            std::unordered_map<std::string_view, Entry> files; // key = info->fullpath
+            std::vector<std::shared_ptr<const FileInfo>> sorted; // by fullpath, a prefix is a range of it
+            std::vector<std::shared_ptr<RootPath>> roots;
+        };
+        void visit_prefix(const IndexSnapshot& snapshot, const std::string& prefix,
+            const std::function<bool(const std::shared_ptr<const FileInfo>&)>& visit) const;
+        // a long indexing pass publishes the files done so far this often
+        static constexpr double SNAPSHOT_INTERVAL_MICROS = 1000000.0;
+        std::atomic<std::shared_ptr<const IndexSnapshot>> snapshot_;
+        std::mutex snapshot_mutex_;  // keeps concurrent publishers in order
+        std::atomic<double> last_snapshot_time_{0};
     };
 }   // namespace drlog
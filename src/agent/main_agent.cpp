@@ -127,6 +127,14 @@ int main(int argc, char* argv[]) {
     unsigned short port = 8113;
     unsigned threads = 1;
     unsigned scan_interval = 60;
+    unsigned index_threads = 0;     // 0 = half the cores
+    unsigned search_threads = 0;    // files and chunks scanned at once by all searches, 0 = half the cores
+    unsigned search_requests = 0;   // searches run at once off the http threads, 0 = half the cores
+    unsigned full_scan_interval = 3600;
+    unsigned cache_compact_interval = 3600;
+    unsigned gzip_checkpoint_span_mb = 8;
+    // what the indexing threads may take from the host, 0 = no limit
+    drlog::resource_governor::limits index_limits;
     std::string log_path = "logs/";
     std::string log_level = "info";
     std::string cache_path = "cache/";
@@ -141,6 +149,18 @@ int main(int argc, char* argv[]) {
         if (s.contains("port")) port = static_cast<unsigned short>(s["port"].get<int>());
         if (s.contains("threads")) threads = s["threads"].get<unsigned>();
         if (s.contains("scan_interval")) scan_interval = s["scan_interval"].get<unsigned>();
+        if (s.contains("index_threads")) index_threads = s["index_threads"].get<unsigned>();
+        if (s.contains("search_threads")) search_threads = s["search_threads"].get<unsigned>();
+        if (s.contains("search_requests")) search_requests = s["search_requests"].get<unsigned>();
+        if (s.contains("full_scan_interval")) full_scan_interval = s["full_scan_interval"].get<unsigned>();
+        if (s.contains("cache_compact_interval")) cache_compact_interval = s["cache_compact_interval"].get<unsigned>();
+        if (s.contains("gzip_checkpoint_span_mb")) gzip_checkpoint_span_mb = s["gzip_checkpoint_span_mb"].get<unsigned>();
+        if (s.contains("index_max_read_mb")) index_limits.max_read_mb_per_sec = s["index_max_read_mb"].get<double>();
+        if (s.contains("index_max_cpu_share")) index_limits.max_cpu_share = s["index_max_cpu_share"].get<double>();
+        if (s.contains("index_nice")) index_limits.nice = s["index_nice"].get<int>();
+        if (s.contains("index_io_class")) index_limits.io_class = s["index_io_class"].get<int>();
+        if (s.contains("index_io_level")) index_limits.io_level = s["index_io_level"].get<int>();
+        if (s.contains("index_max_load")) index_limits.max_load = s["index_max_load"].get<double>();
         if (s.contains("logpath")) log_path = s["logpath"].get<std::string>();
         if (s.contains("loglevel")) log_level = s["loglevel"].get<std::string>();
         if (s.contains("cache_path")) cache_path = s["cache_path"].get<std::string>();
@@ -193,6 +213,13 @@ int main(int argc, char* argv[]) {
     indexer->set_index_interval_seconds(300);      // default 300s
     indexer->set_index_count_threshold(50000);     // default 50000 lines
     indexer->set_cache_path(cache_path);
+    indexer->set_index_threads(index_threads);
+    indexer->set_full_scan_interval_seconds(full_scan_interval);
+    indexer->set_cache_compact_interval_seconds(cache_compact_interval);
+    indexer->set_gzip_checkpoint_span(static_cast<uint64_t>(gzip_checkpoint_span_mb) * 1024 * 1024);
+    indexer->set_index_limits(index_limits);
+    spdlog::info("Index limits: read {}MB/s, cpu share {}, nice {}, io class {}/{}, max load {}", index_limits.max_read_mb_per_sec,
+        index_limits.max_cpu_share, index_limits.nice, index_limits.io_class, index_limits.io_level, index_limits.max_load);
 
     // Load multiple paths from config: expecting "paths": [ { "path": "...", "namepattern": "...", ... }, ... ]
     if (cfg.contains("paths") && cfg["paths"].is_array()) {
@@ -204,15 +231,36 @@ int main(int argc, char* argv[]) {
             //regex pattern to match the path, use check the request prefix, e.g. "^/var/log/.+/.+", prefix must be "/var/log/xxx/xxx"
             std::string path_pattern = ""; 
             std::string prefix_pattern = "";
+            std::string time_zone = "local";
             int max_days = 30;
+            // disk for the trigram indexes of files that stopped changing, 0 builds none
+            uint64_t trigram_budget_mb = 0;
+            // regex of ID-like fields whose values are indexed per block, group 1 is the value if present
+            std::string token_pattern = "";
+            // whether queries of a whole token_pattern value skip the blocks without it, off by default
+            // as a value appearing outside a pattern match is then missed
+            bool token_lookup = false;
+            // mmap, or stream/direct to keep rotated logs out of the page cache
+            std::string read_mode_name = "mmap";
             if (p.contains("maxdays")) max_days = p["maxdays"].get<int>();
+            if (p.contains("trigram_budget_mb")) trigram_budget_mb = p["trigram_budget_mb"].get<uint64_t>();
             if (p.contains("prefixpattern")) prefix_pattern = p["prefixpattern"].get<std::string>();
             if (p.contains("namepattern")) name_pattern = p["namepattern"].get<std::string>();
             if (p.contains("time_format_pattern")) time_format_pattern = p["time_format_pattern"].get<std::string>();
             if (p.contains("pathpattern")) path_pattern = p["pathpattern"].get<std::string>();
-            indexer->add_root(root, name_pattern, time_format_pattern, path_pattern, prefix_pattern, max_days);
-            spdlog::info("Added root path: {} with name pattern: {}, path pattern: {}, prefix pattern: {}, max days: {}", 
-                root, name_pattern, path_pattern, prefix_pattern, max_days);
+            if (p.contains("timezone")) time_zone = p["timezone"].get<std::string>();
+            if (p.contains("token_pattern")) token_pattern = p["token_pattern"].get<std::string>();
+            if (p.contains("token_lookup")) token_lookup = p["token_lookup"].get<bool>();
+            if (p.contains("read_mode")) read_mode_name = p["read_mode"].get<std::string>();
+            drlog::file_read_mode read_mode = drlog::file_read_mode::mmap;
+            if (!drlog::parse_read_mode(read_mode_name, read_mode)) {
+                spdlog::warn("Unknown read mode '{}' for root {}, using mmap", read_mode_name, root);
+            }
+            indexer->add_root(root, name_pattern, time_format_pattern, path_pattern, prefix_pattern, max_days, time_zone,
+                trigram_budget_mb * 1024 * 1024, token_pattern, token_lookup, read_mode);
+            spdlog::info("Added root path: {} with name pattern: {}, path pattern: {}, prefix pattern: {}, max days: {}, time format: {}, timezone: {}, trigram budget: {}MB, token pattern: {}, token lookup: {}, read mode: {}", 
+                root, name_pattern, path_pattern, prefix_pattern, max_days, time_format_pattern, time_zone, trigram_budget_mb, token_pattern,
+                token_lookup, drlog::read_mode_name(read_mode));
             std::cout << "Added root path: " << root 
                 << " with name pattern: " << name_pattern 
                 << ", path pattern: " << path_pattern 
@@ -228,10 +276,12 @@ int main(int argc, char* argv[]) {
     server.init(address, port, threads);
     server.set_max_request_body_size(100 * 1024 * 1024);
     // Register the request handlers
-    std::shared_ptr<drlog::AgentHandler> handler = std::make_shared<drlog::AgentHandler>(indexer);
+    std::shared_ptr<drlog::AgentHandler> handler = std::make_shared<drlog::AgentHandler>(indexer, search_threads, search_requests);
     bst::request_handler::register_route("/hello", std::bind(&drlog::AgentHandler::hello, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     bst::request_handler::register_route("/log/list", std::bind(&drlog::AgentHandler::list, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)); 
     bst::request_handler::register_route("/log/search", std::bind(&drlog::AgentHandler::search, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    bst::request_handler::register_route("/log/histogram", std::bind(&drlog::AgentHandler::histogram, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    bst::request_handler::register_route("/index/metrics", std::bind(&drlog::AgentHandler::metrics, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     
     run_announce_task(registry_address, registry_agent_address);
 
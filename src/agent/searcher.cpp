@@ -3,16 +3,31 @@
 #include <regex>
 #include <string>
 #include <zlib.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <spdlog/spdlog.h>
 #include <iostream>
 #include "searchers/simple_searcher.hpp"
 #include "searchers/boolean_searcher.hpp"
 #include "searchers/regex_searcher.hpp"
 #include "util/igzip.hpp"
+#include "util/line_scanner.hpp"
+#include "util/sequential_reader.hpp"
+#include "util/mapped_region.hpp"
+#include "util/token_filter.hpp"
+#include "util/util.hpp"
+#include "trigram_index.hpp"
+#include <unordered_map>
+#include <optional>
+#include <algorithm>
+#include <mutex>
 
 namespace drlog {
 
-    #define MAX_CARRY_SIZE (1024 * 1024 * 100)
     #define MAX_BATCH_MATCHES (500)
     // Execute searchers on lines in context
     bool LogSearcher::exec_searchers(std::shared_ptr<SearchContext> ctx) {
@@ -21,18 +36,8 @@ namespace drlog {
             return false;
         }
         int matched_count = 0;
-        std::vector<matched_word> matched;
         for(auto &line : ctx->log_lines) {
-            bool be_matched = true;
-            for(auto &qs : ctx->searchers) {
-                std::vector<matched_word>().swap(matched);
-                bool besucc = qs.searcher->search_line(line.line, matched, false);
-                if(!besucc) {
-                    be_matched = false;
-                    break;
-                }
-            }
-            if(be_matched) {
+            if(match_line(ctx, line.line)) {
                 matched_count++;
                 ctx->matched_lines.emplace_back(std::move(line));
             }
@@ -44,14 +49,95 @@ namespace drlog {
             ctx->path,ctx->log_lines.size(), matched_count, ctx->matched_lines.size());
         return true;
     }
+
+    // the same for the records of a mapped file, only the matched ones are copied
+    bool LogSearcher::exec_view_searchers(std::shared_ptr<SearchContext> ctx) {
+        if(!ctx || ctx->searchers.empty()) {
+            spdlog::error("Search context or searchers is not valid");
+            return false;
+        }
+        int matched_count = 0;
+        std::vector<char> candidates;
+        bool decided = filter_views(ctx, candidates);
+        for(std::size_t i = 0; i < ctx->log_views.size(); ++i) {
+            const auto &view = ctx->log_views[i];
+            if(candidates[i] && (decided || match_line(ctx, view.line))) {
+                matched_count++;
+                LogLine ll;
+                ll.timestamp = view.timestamp;
+                ll.line.assign(view.line.data(), view.line.size());
+                ctx->matched_lines.emplace_back(std::move(ll));
+            }
+            if(ctx->matched_lines.size() >= ctx->req->max_results) {
+                break;
+            }
+        }
+        spdlog::debug("File '{}',search {} lines, matched {} lines, total matched {} lines", 
+            ctx->path,ctx->log_views.size(), matched_count, ctx->matched_lines.size());
+        return true;
+    }
+
+    // a literal is searched once over the bytes from the first view to the end of the last, which
+    // is far cheaper than once per view for the rare queries of a log search. A hit inside a view
+    // keeps it, the views before the hit are dropped, and the search goes on from the next view.
+    // The views of a batch never span a skipped gap, so no skipped page is touched
+    bool LogSearcher::filter_views(std::shared_ptr<SearchContext> ctx, std::vector<char>& candidates) {
+        const auto& views = ctx->log_views;
+        candidates.assign(views.size(), 1);
+        if (views.empty()) return true;
+        const char* end = views.back().line.data() + views.back().line.size();
+        bool decided = true;
+        for (auto& qs : ctx->searchers) {
+            const substring_finder* finder = qs.searcher->literal_finder();
+            if (!finder) {
+                decided = false;
+                continue;
+            }
+            const std::size_t length = finder->needle().size();
+            const char* from = views.front().line.data();
+            std::size_t i = 0;
+            while (i < views.size()) {
+                std::size_t pos = finder->find(from, static_cast<std::size_t>(end - from));
+                if (pos == substring_finder::npos) {
+                    std::fill(candidates.begin() + i, candidates.end(), 0);
+                    break;
+                }
+                const char* hit = from + pos;
+                while (i < views.size() && hit + length > views[i].line.data() + views[i].line.size()) {
+                    candidates[i++] = 0;
+                }
+                if (i == views.size()) break;
+                if (hit >= views[i].line.data()) {
+                    // within view i
+                    ++i;
+                    from = i < views.size() ? views[i].line.data() : end;
+                } else {
+                    // across a line break or in the lines left out before view i
+                    from = views[i].line.data();
+                }
+            }
+        }
+        return decided;
+    }
+
+    // whether every query matches the line
+    bool LogSearcher::match_line(std::shared_ptr<SearchContext> ctx, std::string_view line) {
+        std::vector<matched_word> matched;
+        for(auto &qs : ctx->searchers) {
+            if(!qs.searcher->search_line(line, matched, false)) {
+                return false;
+            }
+        }
+        return true;
+    }
    
-    bool LogSearcher::parse_line(std::shared_ptr<SearchContext> ctx,std::string &line) {
+    bool LogSearcher::parse_line(std::shared_ptr<SearchContext> ctx, std::string_view line) {
         if(!indexer_) {
             spdlog::error("Indexer is not initialized");
             return false;
         }
         //get timestamp of line
-        std::time_t ts = indexer_->get_timestamp_from_log_line(line);
+        std::time_t ts = indexer_->get_timestamp_from_log_line(line, ctx->index_file_info->root_path, *ctx->index_file_info->file_index, ctx->today);
         if(ts == 0) {
             //this not a new log line
             if(!ctx->tmp_line.line.empty()) {
@@ -62,34 +148,180 @@ namespace drlog {
             }
         }
         else {
-            if(ts < ctx->start_time) {
+            // any new log line ends the one before, in range or not, as in parse_line_view
+            end_record(ctx);
+            if(static_cast<uint64_t>(ts) < ctx->start_time || static_cast<uint64_t>(ts) > ctx->end_time) {
                 // timestamp out of range, skip
                 return true;
             }
-            if(!ctx->tmp_line.line.empty()) {
-                // have one full log line, append it
-                LogLine ll;
-                ll.line.swap(ctx->tmp_line.line);
-                ll.timestamp = ctx->tmp_line.timestamp;
-                ctx->log_lines.emplace_back(std::move(ll));
+            ctx->tmp_line.line.assign(line.data(), line.size());
+            ctx->tmp_line.timestamp = ts;
+        }
+        return true;
+    }
+
+    // a record ends at a gap of skipped blocks, the lines after it belong to other records
+    void LogSearcher::end_record(std::shared_ptr<SearchContext> ctx) {
+        if(ctx->tmp_line.line.empty()) {
+            return;
+        }
+        LogLine ll;
+        ll.line.swap(ctx->tmp_line.line);
+        ll.timestamp = ctx->tmp_line.timestamp;
+        ctx->log_lines.emplace_back(std::move(ll));
+    }
+
+    // the records of a mapped file are contiguous, a continuation line extends the view of its record
+    bool LogSearcher::parse_line_view(std::shared_ptr<SearchContext> ctx, std::string_view line) {
+        if(!indexer_) {
+            spdlog::error("Indexer is not initialized");
+            return false;
+        }
+        std::time_t ts = indexer_->get_timestamp_from_log_line(line, ctx->index_file_info->root_path, *ctx->index_file_info->file_index, ctx->today);
+        LogView& record = ctx->tmp_view;
+        if(ts == 0) {
+            if(!record.line.empty()) {
+                record.line = std::string_view(record.line.data(), static_cast<std::size_t>(line.data() + line.size() - record.line.data()));
             }
-            if(ts > ctx->end_time) {
-                // timestamp out of range, skip
+            return true;
+        }
+        // a line out of the time range ends the record too, its continuation lines are not appended
+        if(!record.line.empty()) {
+            ctx->log_views.push_back(record);
+            record = LogView{};
+        }
+        if(static_cast<uint64_t>(ts) < ctx->start_time || static_cast<uint64_t>(ts) > ctx->end_time) {
+            return true;
+        }
+        record.line = line;
+        record.timestamp = ts;
+        return true;
+    }
+
+    bool LogSearcher::search_file_txt_mmap(std::shared_ptr<SearchContext> ctx) {
+        std::shared_ptr<SearchRequest> req = ctx->req;
+        const std::string &path = ctx->path;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) return false;
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        const uint64_t file_size = static_cast<uint64_t>(st.st_size);
+        if(ctx->index_start_pos >= file_size) {
+            close(fd);
+            ctx->error_msg = "Index start position is out of file range";
+            ctx->status = 1;
+            return true;
+        }
+        if(ctx->index_end_pos >= file_size) {
+            close(fd);
+            ctx->error_msg = "Index end position is out of file range";
+            ctx->status = 1;
+            return true;
+        }
+        // to the end of the file, the record at index_end_pos may run past it
+        mapped_region region;
+        bool mapped = region.map(fd, ctx->index_start_pos, static_cast<std::size_t>(file_size - ctx->index_start_pos));
+        close(fd);
+        if (!mapped) {
+            spdlog::debug("Failed to map file {}, reading it", path);
+            return false;
+        }
+        region.advise(ctx->skip_blocks ? MADV_NORMAL : MADV_SEQUENTIAL);
+
+        const char* data = region.data();
+        const char* end = data + region.size();
+        const uint64_t base = ctx->index_start_pos;
+        // newlines are found a window at a time, a line may span two windows
+        const std::size_t SCAN_WINDOW = 1024*1024;
+        std::vector<uint32_t> newlines;
+        const char* line_start = data;
+        const char* window = data;
+        bool done = false;
+        // a record holding zero pages of a truncated file is dropped, with everything after it
+        auto flush_batch = [&]() {
+            if (region.truncated()) {
+                spdlog::warn("File {} was truncated while searching it, stopping at {}", path, base + (line_start - data));
+                ctx->tmp_view = LogView{};
+                ctx->log_views.clear();
+                return false;
+            }
+            if (!exec_view_searchers(ctx)) {
+                spdlog::error("Failed to execute searchers for file {}", path);
+                ctx->error_msg = "Failed to execute searchers for file";
+                ctx->status = 1;
+                return false;
+            }
+            ctx->log_views.clear();
+            return !enough_matches(ctx);
+        };
+        // false once the search is done
+        auto handle_line = [&](std::string_view line) {
+            uint64_t offset = base + static_cast<uint64_t>(line.data() - data);
+            if (ctx->skip_blocks && skip_line(ctx, offset)) {
+                // a record ends at a gap, its views stay contiguous
+                if (!ctx->tmp_view.line.empty()) {
+                    ctx->log_views.push_back(ctx->tmp_view);
+                    ctx->tmp_view = LogView{};
+                }
+                // a batch is searched from its first view to its last, it must not span the gap
+                if (!ctx->log_views.empty() && !flush_batch()) return false;
+                if (ctx->range_pos == ctx->ranges.size() || offset + line.size() + 1 > ctx->index_end_pos) return false;
+                // jump over the gap, its pages are never touched
+                uint64_t next = ctx->ranges[ctx->range_pos].first;
+                if (next > offset && next - base <= region.size()) {
+                    line_start = data + (next - base);
+                    window = line_start;
+                }
                 return true;
             }
-            ctx->tmp_line.line.swap(line);
-            ctx->tmp_line.timestamp = ts;
-            std::string().swap(line);
+            if (!parse_line_view(ctx, line)) return false;
+            if (offset + line.size() + 1 > ctx->index_end_pos) return false;
+            if (ctx->log_views.size() >= MAX_BATCH_MATCHES) return flush_batch();
+            return true;
+        };
+        while (!done && window < end) {
+            std::size_t window_size = std::min<std::size_t>(SCAN_WINDOW, static_cast<std::size_t>(end - window));
+            const char* scanned = window;
+            newlines.clear();
+            line_scanner::find_newlines(scanned, window_size, newlines);
+            for (uint32_t nl : newlines) {
+                const char* line_end = scanned + nl;
+                std::string_view line(line_start, static_cast<std::size_t>(line_end - line_start));
+                line_start = line_end + 1;
+                if (!handle_line(line)) {
+                    done = true;
+                    break;
+                }
+                // a jump moved the window
+                if (window != scanned) break;
+            }
+            if (window == scanned) window += window_size;
+            if (region.truncated()) done = true;
         }
+        // the unterminated last line
+        if (!done && line_start < end) {
+            handle_line(std::string_view(line_start, static_cast<std::size_t>(end - line_start)));
+        }
+        if (!ctx->tmp_view.line.empty()) {
+            ctx->log_views.push_back(ctx->tmp_view);
+            ctx->tmp_view = LogView{};
+        }
+        if (!ctx->log_views.empty() && !enough_matches(ctx)) flush_batch();
+        ctx->log_views.clear();
         return true;
     }
 
     void LogSearcher::search_file_txt(std::shared_ptr<SearchContext> ctx) {
-        std::shared_ptr<FileInfo> file_index = ctx->index_file_info;
+        std::shared_ptr<const FileInfo> file_index = ctx->index_file_info;
         std::shared_ptr<SearchRequest> req = ctx->req;
         const std::string &path = ctx->path;
-        std::ifstream ifs(path, std::ios::in);
-        if (!ifs.is_open())
+        // stream and direct roots read the range without leaving it in the page cache
+        const file_read_mode read_mode = file_index->root_path ? file_index->root_path->read_mode : file_read_mode::mmap;
+        sequential_reader reader(read_mode == file_read_mode::mmap ? 64*1024 : 1024*1024);
+        if (!reader.open(path, read_mode))
         {
             spdlog::error("Failed to open file {} for reading", path);
             ctx->error_msg = "Failed to open file for reading";
@@ -97,8 +329,7 @@ namespace drlog {
             return;
         }
         //get file lenth
-        ifs.seekg(0, std::ios::end);
-        uint64_t file_size = ifs.tellg();
+        uint64_t file_size = reader.size();
         if(ctx->index_start_pos >= file_size) {
             ctx->error_msg = "Index start position is out of file range";
             ctx->status = 1;
@@ -109,29 +340,66 @@ namespace drlog {
             ctx->status = 1;
             return;
         }
-        ifs.seekg(static_cast<std::streamoff>(ctx->index_start_pos));
-        std::string line;
+        reader.seek(ctx->index_start_pos);
+        line_buffer lines;
+        lines.set_base_offset(ctx->index_start_pos);
         try {
             //read lines until end_pos
-            while (std::getline(ifs,line)) {
-                //match the commands
-                bool besucc = parse_line(ctx, line);
-                if(!besucc) break;
-                if(ifs.tellg() > ctx->index_end_pos) break;
-                if(ctx->log_lines.size() >= MAX_BATCH_MATCHES)
-                {
-                    //search the lines
-                    besucc = exec_searchers(ctx);
-                    std::vector<LogLine>().swap(ctx->log_lines);
-                    if(!besucc) {
-                        spdlog::error("Failed to execute searchers for file {}", path);
-                        ctx->error_msg = "Failed to execute searchers for file";
-                        ctx->status = 1;
-                        break;
+            bool done = false;
+            bool eof = false;
+            while (!done && !eof) {
+                ssize_t n = reader.read();
+                if (n < 0) {
+                    spdlog::error("Failed to read file {}: {}", path, std::strerror(errno));
+                    ctx->error_msg = "Failed to read file";
+                    ctx->status = 1;
+                    return;
+                }
+                if (n > 0) lines.append(reader.data(), static_cast<std::size_t>(n));
+                eof = n == 0;
+                std::string_view line;
+                uint64_t offset = 0;
+                while (lines.next(line, offset) || (eof && lines.tail(line, offset))) {
+                    if (ctx->skip_blocks && skip_line(ctx, offset)) {
+                        end_record(ctx);
+                        if (ctx->range_pos == ctx->ranges.size() || offset + line.size() + 1 > ctx->index_end_pos) {
+                            done = true;
+                            break;
+                        }
+                        // seek over a gap that reaches past what is buffered
+                        uint64_t next = ctx->ranges[ctx->range_pos].first;
+                        if (next > lines.base_offset() + lines.pending()) {
+                            reader.seek(next);
+                            lines.clear();
+                            lines.set_base_offset(next);
+                            eof = false;
+                            break;
+                        }
+                        continue;
                     }
-                    if (ctx->matched_lines.size() >= req->max_results) {
+                    //match the commands
+                    bool besucc = parse_line(ctx, line);
+                    if(!besucc || offset + line.size() + 1 > ctx->index_end_pos) {
+                        done = true;
                         break;
                     }
+                    if(ctx->log_lines.size() >= MAX_BATCH_MATCHES)
+                    {
+                        //search the lines
+                        besucc = exec_searchers(ctx);
+                        std::vector<LogLine>().swap(ctx->log_lines);
+                        if(!besucc) {
+                            spdlog::error("Failed to execute searchers for file {}", path);
+                            ctx->error_msg = "Failed to execute searchers for file";
+                            ctx->status = 1;
+                            done = true;
+                            break;
+                        }
+                        if (enough_matches(ctx)) {
+                            done = true;
+                            break;
+                        }
+                    }
                 }
            }
            if(!ctx->tmp_line.line.empty()) {
@@ -162,40 +430,11 @@ namespace drlog {
             ctx->status = 1;
             return;
         }
-        ifs.close();
-    }
-
-    void LogSearcher::get_lines_gzip(std::string &carry,std::vector<std::string> &lines,size_t pos)
-    {
-        std::string line;
-        while (pos < carry.size()) {
-            size_t nl = carry.find('\n', pos);
-            // No newline found or reached end of file
-            if (nl == std::string::npos) {
-                break;
-            }
-            line = carry.substr(pos, nl - pos);
-            lines.emplace_back(std::move(line));
-            pos = nl + 1;
-        }
-        
-        // Remove processed parts
-        if (pos > 0 && pos < carry.size()) {
-            carry = carry.substr(pos);
-            return;
-        }
-        if(pos >= carry.size()) {
-            std::string().swap(carry);
-            return;
-        }
-        if(carry.size() > MAX_CARRY_SIZE) {
-            spdlog::error("Carry size {} is too large", carry.size());
-            return;
-        }
+        reader.close();
     }
 
     void LogSearcher::search_file_gzip(std::shared_ptr<SearchContext> ctx) {
-        std::shared_ptr<FileInfo> file_index = ctx->index_file_info;
+        std::shared_ptr<const FileInfo> file_index = ctx->index_file_info;
         const std::string &path = ctx->path;
         std::shared_ptr<SearchRequest> req = ctx->req;
         // Open gzip file
@@ -211,7 +450,7 @@ namespace drlog {
             const int BUF_SIZE = 8192;
             const int MAX_LINE_SIZE = 4*1024*1024;
             std::vector<char> buffer(BUF_SIZE);
-            std::string carry;
+            line_buffer lines; // lines from index_start_pos on, plus the partial tail
             uint64_t total_uncompressed = 0;
             
             // Precisely position to start position
@@ -254,7 +493,7 @@ namespace drlog {
                         gzclose(gz);
                         return;
                     }
-                    carry.append(buffer.data() + (n - extra_bytes), static_cast<size_t>(extra_bytes));
+                    lines.append(buffer.data() + (n - extra_bytes), static_cast<size_t>(extra_bytes));
                 }
             }
 
@@ -275,20 +514,15 @@ namespace drlog {
                     break;
                 }
                 
-                carry.append(buffer.data(), n);
-                if(carry.size() > MAX_LINE_SIZE) {
-                    spdlog::debug("Carry buffer exceeded max line size for {}, give up", path);
-                    std::string().swap(carry);
-                    break;
-                }
+                lines.append(buffer.data(), n);
 
                 total_uncompressed += static_cast<uint64_t>(n);
                 
-                // Get lines from carry
-                std::vector<std::string> lines;
-                get_lines_gzip(carry,lines,0);
+                // Get lines from the buffer
+                std::string_view line;
+                uint64_t line_offset = 0;
                 bool befaild = false;
-                for(auto &line : lines) {
+                while (lines.next(line, line_offset)) {
                     bool besucc = parse_line(ctx, line);
                     if(!besucc) {
                         befaild = true;
@@ -314,7 +548,10 @@ namespace drlog {
                     spdlog::error("Failed to parse line for file {}", path);
                     break;
                 }
-                std::vector<std::string>().swap(lines);
+                if(lines.pending() > MAX_LINE_SIZE) {
+                    spdlog::debug("Carry buffer exceeded max line size for {}, give up", path);
+                    break;
+                }
                 // Check if exceeded end position
                 if (total_uncompressed >= ctx->index_end_pos) {
                     break;
@@ -351,33 +588,55 @@ namespace drlog {
     }
 
     void LogSearcher::search_file_igzip(std::shared_ptr<SearchContext> ctx) {
-        std::shared_ptr<FileInfo> file_index = ctx->index_file_info;
+        std::shared_ptr<const FileInfo> file_index = ctx->index_file_info;
         const std::string &path = ctx->path;
         std::shared_ptr<SearchRequest> req = ctx->req;
-        // Open gzip file
+        // Open gzip file, at the last inflate point before the start position when there is one
         igzip_state igzs;
-        int ret = igzip::igzopen(path.c_str(), "rb",&igzs);
+        const inflate_point* point = nullptr;
+        if (file_index->file_index) point = gzip_index_reader::find_point(file_index->file_index->inflate_points, ctx->index_start_pos);
+        int ret = point ? igzip::igzopen_at(path.c_str(), *point, &igzs) : igzip::igzopen(path.c_str(), "rb", &igzs);
+        if (ret != 0 && point) {
+            spdlog::warn("Failed to resume igzip file {} at {}: {}, inflating from the start", path, point->out_offset, ret);
+            point = nullptr;
+            ret = igzip::igzopen(path.c_str(), "rb", &igzs);
+        }
         if (ret != 0) {
             spdlog::error("Failed to open igzip file {} for reading", path);
             ctx->error_msg = "Failed to open igzip file for reading";
             ctx->status = 1;
             return;
         }
+        // stdio has no O_DIRECT, stream and direct roots drop the compressed pages behind the read position
+        const bool drop_cache = file_index->root_path && file_index->root_path->read_mode != file_read_mode::mmap;
+        uint64_t dropped_offset = 0;
+        std::size_t reads = 0;
+        auto start_dropping = [&]() {
+            if (!drop_cache || !igzs.in_file) return;
+            sequential_reader::advise_sequential(fileno(igzs.in_file));
+            off_t pos = ftello(igzs.in_file);
+            dropped_offset = pos > 0 ? static_cast<uint64_t>(pos) : 0;
+        };
+        auto drop_read = [&]() {
+            // every 128 reads, about 1 MiB of output
+            if (!drop_cache || !igzs.in_file || ++reads % 128 != 0) return;
+            off_t pos = ftello(igzs.in_file);
+            if (pos > 0) sequential_reader::drop_behind(fileno(igzs.in_file), dropped_offset, static_cast<uint64_t>(pos));
+        };
+        start_dropping();
         try {
             // Set up buffer
             const int BUF_SIZE = 8192;
             const int MAX_LINE_SIZE = 4*1024*1024;
             std::vector<uint8_t> buffer(BUF_SIZE);
-            std::string carry;
-            uint64_t total_uncompressed = 0;
+            line_buffer lines; // lines from index_start_pos on, plus the partial tail
+            lines.set_base_offset(ctx->index_start_pos);
+            uint64_t total_uncompressed = point ? point->out_offset : 0;
             
             // Precisely position to start position
             while (total_uncompressed < ctx->index_start_pos) {
-                // Calculate remaining bytes to skip
-                uint64_t remaining = ctx->index_start_pos - total_uncompressed;
-                // Read size not exceeding buffer size and remaining bytes
-                int read_size = std::min(BUF_SIZE, static_cast<int>(remaining));
                 int n = igzip::igzread(&igzs, buffer);
+                drop_read();
                 if (n < 0) {
                     spdlog::error("Error reading gzip file {}: {}", path, n);
                     ctx->error_msg = "Error reading gzip file";
@@ -392,13 +651,7 @@ namespace drlog {
                     return;
                 }
                 total_uncompressed += static_cast<uint64_t>(n);
-                // If we didn't read enough bytes, file might have ended
-                if (n < read_size) {
-                    ctx->error_msg = "Index start position is out of file range";
-                    ctx->status = 1;
-                    igzip::igzclose(&igzs);
-                    return;
-                }
+                // a short read is not the end of the stream, n == 0 is
                 if(total_uncompressed > ctx->index_start_pos) {
                     //append the leftover bytes after positioning
                     uint64_t extra_bytes = total_uncompressed - ctx->index_start_pos;
@@ -409,13 +662,14 @@ namespace drlog {
                         igzip::igzclose(&igzs);
                         return;
                     }
-                    carry.append((char *)buffer.data() + (n - extra_bytes), static_cast<size_t>(extra_bytes));
+                    lines.append((char *)buffer.data() + (n - extra_bytes), static_cast<size_t>(extra_bytes));
                 }
             }
             
             // Read and process file content until end position
             while (total_uncompressed < ctx->index_end_pos) {
                 int n = igzip::igzread(&igzs, buffer);
+                drop_read();
                 if (n < 0) {
                     spdlog::error("Error reading gzip file {}: {}", path, n);
                     ctx->error_msg = "Error reading gzip file";
@@ -428,20 +682,19 @@ namespace drlog {
                     break;
                 }
                 
-                carry.append((char *)buffer.data(), n);
-                if(carry.size() > MAX_LINE_SIZE) {
-                    spdlog::debug("Carry buffer exceeded max line size for {}, give up", path);
-                    std::string().swap(carry);
-                    break;
-                }
+                lines.append((char *)buffer.data(), n);
 
                 total_uncompressed += static_cast<uint64_t>(n);
                 
-                // Get lines from carry
-                std::vector<std::string> lines;
-                get_lines_gzip(carry,lines,0);
+                // Get lines from the buffer
+                std::string_view line;
+                uint64_t line_offset = 0;
                 bool befaild = false;
-                for(auto &line : lines) {
+                while (lines.next(line, line_offset)) {
+                    if (ctx->skip_blocks && skip_line(ctx, line_offset)) {
+                        end_record(ctx);
+                        continue;
+                    }
                     bool besucc = parse_line(ctx, line);
                     if(!besucc) {
                         befaild = true;
@@ -467,11 +720,35 @@ namespace drlog {
                     spdlog::error("Failed to parse line for file {}", path);
                     break;
                 }
-                std::vector<std::string>().swap(lines);
+                if(lines.pending() > MAX_LINE_SIZE) {
+                    spdlog::debug("Carry buffer exceeded max line size for {}, give up", path);
+                    break;
+                }
                 // Check if exceeded end position
                 if (total_uncompressed >= ctx->index_end_pos) {
                     break;
                 }
+                // inflate a gap only up to the last inflate point before the next block to search
+                if (ctx->skip_blocks && skip_line(ctx, lines.base_offset()) && ctx->range_pos < ctx->ranges.size()) {
+                    end_record(ctx);
+                    const inflate_point* next_point = gzip_index_reader::find_point(file_index->file_index->inflate_points,
+                        ctx->ranges[ctx->range_pos].first);
+                    if (next_point && next_point->out_offset > total_uncompressed) {
+                        igzip::igzclose(&igzs);
+                        ret = igzip::igzopen_at(path.c_str(), *next_point, &igzs);
+                        if (ret != 0) {
+                            spdlog::error("Failed to resume igzip file {} at {}: {}", path, next_point->out_offset, ret);
+                            ctx->error_msg = "Failed to resume igzip file";
+                            ctx->status = 1;
+                            return;
+                        }
+                        start_dropping();
+                        // the partial line buffered lies in the gap
+                        lines.clear();
+                        lines.set_base_offset(next_point->out_offset);
+                        total_uncompressed = next_point->out_offset;
+                    }
+                }
             }
             if(!ctx->tmp_line.line.empty()) {
                     LogLine ll;
@@ -506,9 +783,132 @@ namespace drlog {
 
 
     void LogSearcher::search_file(std::shared_ptr<SearchContext> ctx) {
+        std::vector<uint64_t> cuts = split_range(ctx);
+        if (cuts.empty()) {
+            search_file_range(ctx);
+        } else {
+            search_file_chunks(ctx, cuts);
+        }
+    }
+
+    // time index entries start with a timestamped line, a multi-line record never spans two chunks
+    std::vector<uint64_t> LogSearcher::split_range(std::shared_ptr<SearchContext> ctx) {
+        std::vector<uint64_t> cuts;
+        if (!scan_pool_ || scan_pool_->size() < 2 || ctx->index_file_info->file_type == "gzip") return cuts;
+        const auto& entries = ctx->index_file_info->file_index->time_indexes;
+        // bytes of [index_start_pos, end) that are scanned, only the selected ranges with skip_blocks
+        std::size_t range = 0;
+        uint64_t covered = 0;
+        auto scanned_below = [&](uint64_t end) {
+            if (!ctx->skip_blocks) return end - ctx->index_start_pos;
+            for (; range < ctx->ranges.size() && ctx->ranges[range].second <= end; ++range) {
+                covered += ctx->ranges[range].second - ctx->ranges[range].first;
+            }
+            uint64_t partial = range < ctx->ranges.size() && ctx->ranges[range].first < end ? end - ctx->ranges[range].first : 0;
+            return covered + partial;
+        };
+        const uint64_t total = scanned_below(ctx->index_end_pos);
+        if (total < PARALLEL_MIN_BYTES) return cuts;
+        range = 0;
+        covered = 0;
+        const uint64_t target = std::max<uint64_t>(CHUNK_MIN_BYTES, total / (scan_pool_->size() * 2));
+        uint64_t last = 0;
+        for (std::size_t i = ctx->index_start_block + 1; i < ctx->index_end_block && i < entries.size(); ++i) {
+            const uint64_t offset = entries[i].offset;
+            if (offset <= ctx->index_start_pos || offset >= ctx->index_end_pos) continue;
+            const uint64_t scanned = scanned_below(offset);
+            if (scanned - last >= target && total - scanned >= CHUNK_MIN_BYTES / 2) {
+                cuts.push_back(offset);
+                last = scanned;
+            }
+        }
+        return cuts;
+    }
+
+    // the chunks after the first run on scan_pool_, the first one on the calling thread; their matches are joined in
+    // file order and cut at max_results, as a single scan would return them
+    void LogSearcher::search_file_chunks(std::shared_ptr<SearchContext> ctx, const std::vector<uint64_t>& cuts) {
+        const std::size_t n = cuts.size() + 1;
+        auto stop_from = std::make_shared<std::atomic<std::size_t>>(n);
+        std::vector<std::shared_ptr<SearchContext>> parts;
+        for (std::size_t i = 0; i < n; ++i) {
+            auto part = std::make_shared<SearchContext>();
+            part->path = ctx->path;
+            part->req = ctx->req;
+            part->start_time = ctx->start_time;
+            part->end_time = ctx->end_time;
+            part->today = ctx->today;
+            part->index_start_time = ctx->index_start_time;
+            part->index_end_time = ctx->index_end_time;
+            part->index_start_pos = i == 0 ? ctx->index_start_pos : cuts[i - 1];
+            // a scan stops after the line holding index_end_pos, here the last line before the next cut
+            part->index_end_pos = i == n - 1 ? ctx->index_end_pos : cuts[i] - 1;
+            part->index_start_block = ctx->index_start_block;
+            part->index_end_block = ctx->index_end_block;
+            part->ranges = ctx->ranges;
+            part->skip_blocks = ctx->skip_blocks;
+            part->index_file_info = ctx->index_file_info;
+            part->searchers = ctx->searchers;
+            part->parent = ctx;
+            part->chunk = i;
+            part->stop_from = stop_from;
+            parts.push_back(std::move(part));
+        }
+
+        std::mutex mutex;
+        std::vector<bool> finished(n, false);
+        const std::size_t max_results = ctx->req->max_results;
+        auto run = [&](std::size_t i) {
+            if (!enough_matches(parts[i])) search_file_range(parts[i]);
+            std::lock_guard<std::mutex> lock(mutex);
+            finished[i] = true;
+            // once the finished chunks at the front hold max_results lines, the ones after are not needed
+            std::size_t matched = 0;
+            for (std::size_t j = 0; j < n && finished[j]; ++j) {
+                matched += parts[j]->matched_lines.size();
+                if (matched >= max_results) {
+                    if (j + 1 < stop_from->load()) stop_from->store(j + 1);
+                    break;
+                }
+            }
+        };
+        double d1 = util::get_micro_timestamp();
+        {
+            task_group group(*scan_pool_);
+            for (std::size_t i = 1; i < n; ++i) {
+                group.run([&run, i] { run(i); });
+            }
+            run(0);
+            group.wait();
+        }
+        double d2 = util::get_micro_timestamp();
+
+        for (std::size_t i = 0; i < n && i < stop_from->load(); ++i) {
+            auto& part = parts[i];
+            if (part->status != 0) {
+                ctx->status = part->status;
+                ctx->error_msg = part->error_msg;
+                break;
+            }
+            for (auto& line : part->matched_lines) {
+                if (ctx->matched_lines.size() >= max_results) break;
+                ctx->matched_lines.emplace_back(std::move(line));
+            }
+        }
+        spdlog::debug("File '{}' scanned in {} chunks, matched {} lines, time_cost={}", ctx->path, n, ctx->matched_lines.size(), (d2-d1)/1000.0);
+    }
+
+    bool LogSearcher::enough_matches(std::shared_ptr<SearchContext> ctx) {
+        return ctx->matched_lines.size() >= ctx->req->max_results || (ctx->stop_from && ctx->chunk >= ctx->stop_from->load());
+    }
+
+    void LogSearcher::search_file_range(std::shared_ptr<SearchContext> ctx) {
         std::string type = ctx->index_file_info->file_type;
         if (type == "gzip") {
             search_file_igzip(ctx);
+        } else if (ctx->index_file_info->root_path && ctx->index_file_info->root_path->read_mode == file_read_mode::mmap &&
+                   search_file_txt_mmap(ctx)) {
+            return;
         } else {
             search_file_txt(ctx);
         }
@@ -547,6 +947,8 @@ namespace drlog {
             return false;
         }
 
+        ctx->index_start_block = static_cast<std::size_t>(start_idx);
+        ctx->index_end_block = static_cast<std::size_t>(end_idx);
         ctx->index_start_time = time_indexes[start_idx].timestamp;
         ctx->index_start_pos = time_indexes[start_idx].offset;
         ctx->index_end_time = time_indexes[end_idx].timestamp;
@@ -556,6 +958,137 @@ namespace drlog {
         return true;
     }
 
+    // cut the trigram chunks that rule out a query out of ranges, returns how many were cut
+    static std::size_t cut_trigram_chunks(const TrigramIndex& trigrams, const std::vector<QuerySearcher>& searchers,
+        std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+        std::size_t chunk = 0;
+        // the posting lists of a literal are intersected once for all chunks
+        std::unordered_map<std::string, std::vector<bool>> literal_chunks;
+        auto probe = [&](std::string_view literal) {
+            auto it = literal_chunks.find(std::string(literal));
+            if (it == literal_chunks.end()) {
+                it = literal_chunks.emplace(std::string(literal), std::vector<bool>()).first;
+                trigrams.candidate_chunks(literal, it->second);
+            }
+            return static_cast<bool>(it->second[chunk]);
+        };
+        std::vector<std::pair<uint64_t, uint64_t>> kept;
+        std::size_t cut = 0;
+        const std::size_t count = trigrams.chunk_count();
+        for (const auto& r : ranges) {
+            for (chunk = trigrams.chunk_of(r.first); chunk < count; ++chunk) {
+                // chunks and blocks both start at record starts
+                const uint64_t begin = std::max(r.first, trigrams.chunk_start(chunk));
+                if (begin >= r.second) break;
+                const uint64_t end = chunk + 1 < count ? std::min(r.second, trigrams.chunk_start(chunk + 1)) : r.second;
+                bool may_match = true;
+                for (const auto& qs : searchers) {
+                    if (!qs.searcher->may_match_literals(probe)) {
+                        may_match = false;
+                        break;
+                    }
+                }
+                if (!may_match) {
+                    ++cut;
+                    continue;
+                }
+                if (!kept.empty() && kept.back().second == begin) kept.back().second = end;
+                else kept.emplace_back(begin, end);
+            }
+        }
+        ranges = std::move(kept);
+        return cut;
+    }
+
+    // narrow the index range to the blocks whose token filters and, on token_lookup roots, token
+    // values may hold what every query needs, and within them to the chunks of the file's trigram
+    // index that may
+    void LogSearcher::select_blocks(std::shared_ptr<SearchContext> ctx) {
+        const FileIndex& idx = *ctx->index_file_info->file_index;
+        const std::size_t n = idx.time_indexes.size();
+        if (n < 2) return;
+        const bool with_filters = idx.block_filters.size() == n;
+        const RootPath* root = ctx->index_file_info->root_path.get();
+        const bool with_tokens = idx.block_tokens.size() == n && root && root->token_lookup &&
+                                 idx.token_pattern_hash == root->token_pattern_hash;
+        std::shared_ptr<const TrigramIndex> trigrams = indexer_->get_trigram_index(*ctx->index_file_info);
+        if (!with_filters && !with_tokens && !trigrams) return;
+        const uint64_t* words = nullptr;
+        std::size_t count = 0;
+        auto probe = [&](uint64_t token) { return token_filter::may_contain(words, count, token); };
+        // a literal the token pattern matches as a whole is a value, looked up in the block's sorted
+        // values; the value of each literal is extracted once
+        std::unordered_map<std::string, std::optional<uint64_t>> literal_values;
+        const uint64_t* values = nullptr;
+        const uint64_t* values_end = nullptr;
+        auto value_probe = [&](std::string_view literal) {
+            auto it = literal_values.find(std::string(literal));
+            if (it == literal_values.end()) {
+                std::optional<uint64_t> value;
+                boost::cmatch m;
+                if (boost::regex_match(literal.data(), literal.data() + literal.size(), m, root->token_regex)) {
+                    const auto& v = m.size() > 1 && m[1].matched ? m[1] : m[0];
+                    if (v.length() > 0) value = token_filter::token_hash(v.first, static_cast<std::size_t>(v.length()));
+                }
+                it = literal_values.emplace(std::string(literal), value).first;
+            }
+            return !it->second || std::binary_search(values, values_end, *it->second);
+        };
+        // the line at index_end_pos is searched too, it belongs to block index_end_block
+        const std::size_t last = std::min(ctx->index_end_block, n - 2);
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        std::size_t skipped = 0;
+        for (std::size_t i = ctx->index_start_block; i <= last; ++i) {
+            bool may_match = true;
+            if (with_filters) {
+                words = idx.block_filter_words.data() + idx.block_filters[i];
+                count = idx.block_filters[i + 1] - idx.block_filters[i];
+                for (const auto& qs : ctx->searchers) {
+                    if (!qs.searcher->may_match(probe)) {
+                        may_match = false;
+                        break;
+                    }
+                }
+            }
+            if (may_match && with_tokens) {
+                values = idx.block_token_hashes.data() + idx.block_tokens[i];
+                values_end = idx.block_token_hashes.data() + idx.block_tokens[i + 1];
+                for (const auto& qs : ctx->searchers) {
+                    if (!qs.searcher->may_match_literals(value_probe)) {
+                        may_match = false;
+                        break;
+                    }
+                }
+            }
+            if (!may_match) {
+                ++skipped;
+                continue;
+            }
+            // the last block runs to the end of the file
+            uint64_t begin = idx.time_indexes[i].offset;
+            uint64_t end = i + 2 < n ? idx.time_indexes[i + 1].offset : UINT64_MAX;
+            if (!ranges.empty() && ranges.back().second == begin) ranges.back().second = end;
+            else ranges.emplace_back(begin, end);
+        }
+        const std::size_t cut = trigrams && !ranges.empty() ? cut_trigram_chunks(*trigrams, ctx->searchers, ranges) : 0;
+        if (skipped == 0 && cut == 0) return;
+        spdlog::debug("Token filters and values of path '{}' rule out {} of {} blocks, trigrams {} chunks", ctx->path, skipped,
+            last + 1 - ctx->index_start_block, cut);
+        ctx->skip_blocks = true;
+        ctx->ranges = std::move(ranges);
+        if (ctx->ranges.empty()) return;
+        ctx->index_start_pos = ctx->ranges.front().first;
+        ctx->index_end_pos = std::min(ctx->index_end_pos, ctx->ranges.back().second);
+    }
+
+    // true when the line at offset lies in a block select_blocks ruled out, moves range_pos to the
+    // first range that ends after offset
+    bool LogSearcher::skip_line(std::shared_ptr<SearchContext> ctx, uint64_t offset) {
+        const auto& ranges = ctx->ranges;
+        while (ctx->range_pos < ranges.size() && ranges[ctx->range_pos].second <= offset) ++ctx->range_pos;
+        return ctx->range_pos == ranges.size() || offset < ranges[ctx->range_pos].first;
+    }
+
     bool LogSearcher::build_searchers(std::shared_ptr<SearchContext> ctx) {
         if(!ctx || !ctx->req) {
             spdlog::warn("Search context or request is null");
@@ -624,15 +1157,20 @@ namespace drlog {
             result.error_msg = "Indexer is not valid";
             return;
         }
-        // Iterate target paths
-        for (const auto &p : req.paths) {
+        // prepare every file first, the ones that cannot be searched get their error right away
+        auto shared_req = std::make_shared<SearchRequest>(req);
+        std::vector<std::shared_ptr<SearchContext>> ctxs(req.paths.size());
+        std::vector<std::shared_ptr<FileMatches>> matches(req.paths.size());
+        std::vector<std::pair<uint64_t, std::size_t>> costs;
+        const civil_date today = civil_date::today();
+        for (std::size_t i = 0; i < req.paths.size(); ++i) {
+            const std::string& p = req.paths[i];
             std::shared_ptr<SearchContext> ctx = std::make_shared<SearchContext>();
-            ctx->req = std::make_shared<SearchRequest>(req);
+            ctx->req = shared_req;
             ctx->path = p;
             ctx->start_time = req.start_time;
             ctx->end_time = req.end_time;
-            FileInfo fi;
-            FileMatches fm;
+            ctx->today = today;
             bool besucc = build_searchers(ctx);
             if(!besucc) {
                 spdlog::warn("Failed to build searchers for path '{}'", p);
@@ -640,35 +1178,103 @@ namespace drlog {
                 result.error_msg = "Failed to build searchers patterns";
                 return;
             }
-            bool befind = indexer_->get_file_index_by_path(p, fi);
-            if (!befind || !fi.file_index) {
-                fm.path = p;
-                fm.status = 1;
-                fm.error_msg = "File not found in index list";
-                result.matches.push_back(std::make_shared<FileMatches>(std::move(fm)));
+            matches[i] = std::make_shared<FileMatches>();
+            matches[i]->path = p;
+            std::shared_ptr<const FileInfo> fi = indexer_->get_file_index_by_path(p);
+            if (!fi || (!fi->cold && !fi->file_index)) {
+                matches[i]->status = 1;
+                matches[i]->error_msg = "File not found in index list";
                 spdlog::warn("Path '{}' not found in index list", p);
                 continue;
             }
-            ctx->index_file_info = std::make_shared<FileInfo>(fi);
+            // a cold file may have to be indexed first, its index is loaded by its scan task; until
+            // then the time range it keeps and its size stand in for the blocks
+            if (fi->cold) {
+                if (!timestamp_covers(fi->start_time, fi->end_time, req.start_time, req.end_time)) {
+                    matches[i]->status = 1;
+                    matches[i]->error_msg = "Time range not covered by index";
+                    spdlog::warn("Path '{}' has no index", p);
+                    continue;
+                }
+                ctx->index_file_info = std::move(fi);
+                ctxs[i] = ctx;
+                const uint64_t size = ctx->index_file_info->size;
+                costs.emplace_back(ctx->index_file_info->file_type == "gzip" ? size * GZIP_COST_FACTOR : size, i);
+                continue;
+            }
+            ctx->index_file_info = std::move(fi);
             if (!find_index_pos(ctx)) {
-                fm.path = p;
-                fm.status = 1;
-                fm.error_msg = "Time range not covered by index";
-                result.matches.push_back(std::make_shared<FileMatches>(std::move(fm)));
+                matches[i]->status = 1;
+                matches[i]->error_msg = "Time range not covered by index";
                 spdlog::warn("Path '{}' has no index", p);
                 continue;
             }
-            search_file(ctx);
-            fm.path = p;
+            select_blocks(ctx);
+            ctxs[i] = ctx;
+            costs.emplace_back(scan_cost(ctx), i);
+        }
+        // the most expensive files start first, so the last one to finish is a short one
+        std::sort(costs.begin(), costs.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        auto scan = [this, &ctxs, &matches](std::size_t i) {
+            std::shared_ptr<SearchContext>& ctx = ctxs[i];
+            FileMatches& fm = *matches[i];
+            if (ctx->index_file_info->cold) {
+                ctx->index_file_info = indexer_->load_cold_index(ctx->index_file_info);
+                if (!ctx->index_file_info || !ctx->index_file_info->file_index) {
+                    fm.status = 1;
+                    fm.error_msg = "File not found in index list";
+                    spdlog::warn("Path '{}' not found in index list", fm.path);
+                    ctx.reset();
+                    return;
+                }
+                if (!find_index_pos(ctx)) {
+                    fm.status = 1;
+                    fm.error_msg = "Time range not covered by index";
+                    spdlog::warn("Path '{}' has no index", fm.path);
+                    ctx.reset();
+                    return;
+                }
+                select_blocks(ctx);
+            }
+            if (!ctx->skip_blocks || !ctx->ranges.empty()) {
+                search_file(ctx);
+            }
             fm.status = ctx->status;
             fm.error_msg = ctx->error_msg;
             fm.lines = std::move(ctx->matched_lines);
-            result.matches.push_back(std::make_shared<FileMatches>(std::move(fm)));
             if(ctx->status != 0)
-                spdlog::warn("Search failed for path '{}': {}", p, ctx->error_msg);
-            spdlog::info("Search completed for path '{}', matched {} lines", p, fm.lines.size());
+                spdlog::warn("Search failed for path '{}': {}", fm.path, ctx->error_msg);
+            spdlog::info("Search completed for path '{}', matched {} lines", fm.path, fm.lines.size());
+            // the mapped file and the searchers are released as soon as the file is done
+            ctx.reset();
+        };
+        if (scan_pool_) {
+            task_group group(*scan_pool_);
+            for (const auto& cost : costs) {
+                group.run([&scan, i = cost.second] { scan(i); });
+            }
+            group.wait();
+        } else {
+            for (const auto& cost : costs) scan(cost.second);
         }
+        result.matches = std::move(matches);
     }
+
+    uint64_t LogSearcher::scan_cost(std::shared_ptr<SearchContext> ctx) {
+        if (ctx->skip_blocks && ctx->ranges.empty()) return 0;
+        uint64_t bytes = ctx->index_end_pos > ctx->index_start_pos ? ctx->index_end_pos - ctx->index_start_pos : 0;
+        if (ctx->skip_blocks) {
+            // the last range runs to UINT64_MAX, select_blocks clamps only index_end_pos
+            bytes = 0;
+            for (const auto& range : ctx->ranges) {
+                const uint64_t begin = std::max(range.first, ctx->index_start_pos);
+                const uint64_t end = std::min(range.second, ctx->index_end_pos);
+                if (end > begin) bytes += end - begin;
+            }
+        }
+        return ctx->index_file_info->file_type == "gzip" ? bytes * GZIP_COST_FACTOR : bytes;
+    }
+
     bool LogSearcher::timestamp_covers(uint64_t idx_satrt, uint64_t idx_end, uint64_t start_time, uint64_t end_time) {
         return (idx_satrt <= end_time && idx_end >= start_time);
     }
@@ -1,9 +1,13 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 #include <memory>
+#include <utility>
+#include <atomic>
 #include "indexer.hpp"
+#include "util/work_stealing_pool.hpp"
 #include "searchers/base_searcher.hpp"
 
 namespace drlog {
@@ -13,6 +17,12 @@ namespace drlog {
         std::string line;
     };
 
+    // a record of a mapped file, a view into the mapping
+    struct LogView {
+        uint64_t timestamp{0};
+        std::string_view line;
+    };
+
     struct FileMatches {
         std::string path;
         std::vector<LogLine> lines;
@@ -51,38 +61,80 @@ namespace drlog {
         std::shared_ptr<SearchRequest> req;
         uint64_t start_time;
         uint64_t end_time;
+        // the date lines of a layout without a year are placed against, taken when the search starts
+        civil_date today;
         uint64_t index_start_time;
         uint64_t index_end_time;
         uint64_t index_start_pos;
         uint64_t index_end_pos;
+        // time index entries of index_start_pos and index_end_pos
+        std::size_t index_start_block{0};
+        std::size_t index_end_block{0};
+        // [start, end) offsets of the blocks and trigram chunks that may match, in file order;
+        // with skip_blocks set the lines outside them are not searched
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        std::size_t range_pos{0};
+        bool skip_blocks{false};
         LogLine tmp_line;
         std::vector<LogLine> log_lines;
         std::vector<LogLine> matched_lines;
-        std::shared_ptr<FileInfo> index_file_info;
+        // the same as tmp_line and log_lines for a mapped file, its records are matched in place
+        LogView tmp_view;
+        std::vector<LogView> log_views;
+        std::shared_ptr<const FileInfo> index_file_info;
         std::shared_ptr<SearchContext> sub;
         std::shared_ptr<SearchContext> parent;
         std::vector<QuerySearcher> searchers;
+        // the chunk of a file scanned in parallel (search_file_chunks); the chunks from *stop_from on
+        // are not needed any more once the ones before them matched max_results lines
+        std::size_t chunk{0};
+        std::shared_ptr<std::atomic<std::size_t>> stop_from;
         int status{0}; // 0=ok, other=error
         std::string error_msg;
     };
 
     class LogSearcher {
     public:
-        explicit LogSearcher(const std::shared_ptr<FileIndexer> indexer) : indexer_(indexer) {};
+        // scan_pool scans the files, and the chunks of large text files, in parallel; nullptr scans them
+        // one after another on the calling thread
+        explicit LogSearcher(const std::shared_ptr<FileIndexer> indexer, work_stealing_pool* scan_pool = nullptr)
+            : indexer_(indexer), scan_pool_(scan_pool) {};
         ~LogSearcher() {};
         void search(const SearchRequest& req, SearchResult& result);
     private:
         bool build_searchers(std::shared_ptr<SearchContext> ctx);
         bool find_index_pos(std::shared_ptr<SearchContext> ctx);
+        void select_blocks(std::shared_ptr<SearchContext> ctx);
+        bool skip_line(std::shared_ptr<SearchContext> ctx, uint64_t offset);
         void search_file(std::shared_ptr<SearchContext> ctx);
+        void search_file_range(std::shared_ptr<SearchContext> ctx);
+        // offsets the range of a large text file is cut at for search_file_chunks, empty to scan it whole
+        std::vector<uint64_t> split_range(std::shared_ptr<SearchContext> ctx);
+        void search_file_chunks(std::shared_ptr<SearchContext> ctx, const std::vector<uint64_t>& cuts);
+        bool enough_matches(std::shared_ptr<SearchContext> ctx);
+        // bytes the search of the file reads, inflated bytes weigh GZIP_COST_FACTOR times more
+        uint64_t scan_cost(std::shared_ptr<SearchContext> ctx);
         void search_file_txt(std::shared_ptr<SearchContext> ctx);
+        // false when the file could not be mapped and nothing was searched
+        bool search_file_txt_mmap(std::shared_ptr<SearchContext> ctx);
         void search_file_gzip(std::shared_ptr<SearchContext> ctx);
         void search_file_igzip(std::shared_ptr<SearchContext> ctx);
-        void get_lines_gzip(std::string &carry,std::vector<std::string> &lines,size_t pos);
         bool timestamp_covers(uint64_t idx_satrt, uint64_t idx_end, uint64_t start_time, uint64_t end_time);
-        bool parse_line(std::shared_ptr<SearchContext> ctx, std::string &line);
+        bool parse_line(std::shared_ptr<SearchContext> ctx, std::string_view line);
+        void end_record(std::shared_ptr<SearchContext> ctx);
+        bool parse_line_view(std::shared_ptr<SearchContext> ctx, std::string_view line);
+        bool match_line(std::shared_ptr<SearchContext> ctx, std::string_view line);
         bool exec_searchers(std::shared_ptr<SearchContext> ctx);
+        bool exec_view_searchers(std::shared_ptr<SearchContext> ctx);
+        // clears candidates[i] for the views a literal query cannot match, true when every query is
+        // a literal one and the rest match
+        bool filter_views(std::shared_ptr<SearchContext> ctx, std::vector<char>& candidates);
     private:
         std::shared_ptr<FileIndexer> indexer_;
+        work_stealing_pool* scan_pool_;
+        // a range is split from PARALLEL_MIN_BYTES on, into chunks of CHUNK_MIN_BYTES or more
+        static constexpr uint64_t PARALLEL_MIN_BYTES = 64 * 1024 * 1024;
+        static constexpr uint64_t CHUNK_MIN_BYTES = 16 * 1024 * 1024;
+        static constexpr uint64_t GZIP_COST_FACTOR = 3;
     };
 } // namespace drlog
\ No newline at end of file
@@ -2,6 +2,10 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
+#include <cstdint>
+#include <string_view>
+#include "util/substring_finder.hpp"
 
 namespace drlog {
     enum SearchType {
@@ -21,7 +25,23 @@ namespace drlog {
         base_searcher(SearchType type) : search_type_(type) {}
         virtual ~base_searcher() = default;
         virtual bool build_pattern(const std::string& pattern) = 0;
-        virtual bool  search_line(const std::string& line,std::vector<matched_word> &matched, bool with_res = false) = 0;
+        virtual bool  search_line(std::string_view line,std::vector<matched_word> &matched, bool with_res = false) = 0;
+        // false when no line of a block can match, given probe(hash) is false for the tokens
+        // (util/token_filter.hpp) the block does not have
+        using token_probe = std::function<bool(uint64_t)>;
+        virtual bool may_match([[maybe_unused]] const token_probe& probe) const {
+            return true;
+        }
+        // the same given probe(literal) is false for the byte strings a block does not contain
+        using literal_probe = std::function<bool(std::string_view)>;
+        virtual bool may_match_literals([[maybe_unused]] const literal_probe& probe) const {
+            return true;
+        }
+        // the string every matching line contains, when that alone decides the match; the caller
+        // may run it over a whole buffer of lines instead of line by line
+        virtual const substring_finder* literal_finder() const {
+            return nullptr;
+        }
         SearchType get_search_type() const {
             return search_type_;
         }
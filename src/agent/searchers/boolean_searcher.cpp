@@ -216,7 +216,7 @@ namespace drlog {
         }
     }
 
-    bool boolean_searcher::search_line(const std::string& line, std::vector<matched_word>& matched, bool with_res) {
+    bool boolean_searcher::search_line(std::string_view line, std::vector<matched_word>& matched, bool with_res) {
         if(with_res) {
             std::vector<matched_word>().swap(matched); // Clear matched if with_res is true
         }
@@ -227,7 +227,7 @@ namespace drlog {
             switch (node->type) {
                 case boolean_node::Type::WORD: {
                     size_t pos = line.find(node->word);
-                    if (pos != std::string::npos) {
+                    if (pos != std::string_view::npos) {
                         if(with_res) {
                             out.emplace_back(node->word, pos);
                         }
@@ -268,4 +268,40 @@ namespace drlog {
 
         return match_node(pattern_, matched);
     }
+
+    bool boolean_searcher::may_match_node(const std::shared_ptr<boolean_node>& node, const std::function<bool(const boolean_node&)>& word_may_match) const {
+        if (!node) return false;
+        switch (node->type) {
+            case boolean_node::Type::WORD:
+                return word_may_match(*node);
+            case boolean_node::Type::NOT:
+                // lines without the word match, a filter cannot rule that out
+                return true;
+            case boolean_node::Type::AND:
+                for (const auto& child : node->children) {
+                    if (!may_match_node(child, word_may_match)) return false;
+                }
+                return true;
+            case boolean_node::Type::OR:
+                for (const auto& child : node->children) {
+                    if (may_match_node(child, word_may_match)) return true;
+                }
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    bool boolean_searcher::may_match(const token_probe& probe) const {
+        return may_match_node(pattern_, [&](const boolean_node& word) {
+            for (uint64_t token : word.tokens) {
+                if (!probe(token)) return false;
+            }
+            return true;
+        });
+    }
+
+    bool boolean_searcher::may_match_literals(const literal_probe& probe) const {
+        return may_match_node(pattern_, [&](const boolean_node& word) { return probe(word.word); });
+    }
 } // namespace drlog
\ No newline at end of file
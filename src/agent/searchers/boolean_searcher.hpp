@@ -3,6 +3,7 @@
 #include <string>
 #include <memory>
 #include "base_searcher.hpp"
+#include "util/token_filter.hpp"
 
 namespace drlog {
     // boolean_node: structure for boolean search logic
@@ -11,12 +12,16 @@ namespace drlog {
 
         // Only used when type == WORD
         std::string word;
+        // tokens every line containing word has
+        std::vector<uint64_t> tokens;
 
         // Used when type == NOT / AND / OR
         std::vector<std::shared_ptr<boolean_node>> children;
 
         boolean_node(Type t) : type(t) {}
-        boolean_node(const std::string& w) : type(Type::WORD), word(w) {}
+        boolean_node(const std::string& w) : type(Type::WORD), word(w) {
+            token_filter::required_tokens(word, tokens);
+        }
     };
 
 
@@ -26,8 +31,12 @@ namespace drlog {
         ~boolean_searcher();
         // Parse the pattern string and build the boolean_pattern structure
         bool build_pattern(const std::string& pattern);
-        bool  search_line(const std::string& line,std::vector<matched_word> &matched, bool with_res = false);
+        bool  search_line(std::string_view line,std::vector<matched_word> &matched, bool with_res = false);
+        bool may_match(const token_probe& probe) const;
+        bool may_match_literals(const literal_probe& probe) const;
     private:
+        // evaluate the pattern with word_may_match standing in for the words
+        bool may_match_node(const std::shared_ptr<boolean_node>& node, const std::function<bool(const boolean_node&)>& word_may_match) const;
         //print search pattern to log debug
         void print_search_pattern(const std::string &pattern, std::shared_ptr<boolean_node> node, int depth = 0);
         std::shared_ptr<boolean_node> pattern_;
@@ -1,8 +1,13 @@
 #pragma once
 #include <boost/regex.hpp>
 #include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
 #include <spdlog/spdlog.h>
 #include "base_searcher.hpp"
+#include "util/token_filter.hpp"
 
 namespace drlog {
     class regex_searcher : public base_searcher { 
@@ -13,16 +18,23 @@ namespace drlog {
             bool build_pattern(const std::string& pattern){
                 try{
                     pattern_ = std::make_shared<boost::regex>(pattern);
+                    required_literals(pattern, literals_);
+                    tokens_.clear();
+                    std::vector<uint64_t> tokens;
+                    for (const auto& literal : literals_) {
+                        token_filter::required_tokens(literal, tokens);
+                        tokens_.insert(tokens_.end(), tokens.begin(), tokens.end());
+                    }
                     return true;
                 }catch(const boost::regex_error& e){
                     spdlog::error("Error building regex pattern: {}", e.what());
                 }
                 return false; 
             }
-            bool search_line(const std::string& line,std::vector<matched_word> &matched, bool with_res = false){
+            bool search_line(std::string_view line,std::vector<matched_word> &matched, bool with_res = false){
                 try{
-                    boost::smatch results;
-                    if (boost::regex_search(line, results, *pattern_)) {
+                    boost::cmatch results;
+                    if (boost::regex_search(line.data(), line.data() + line.size(), results, *pattern_)) {
                         if(with_res) {
                             matched.clear();
                             for (int i = 0; i < results.size(); ++i) {
@@ -38,7 +50,113 @@ namespace drlog {
                 }
                 return false;
             }
+            bool may_match(const token_probe& probe) const {
+                for (uint64_t token : tokens_) {
+                    if (!probe(token)) return false;
+                }
+                return true;
+            }
+            bool may_match_literals(const literal_probe& probe) const {
+                for (const auto& literal : literals_) {
+                    if (!probe(literal)) return false;
+                }
+                return true;
+            }
         private:
+            // strings of 3 or more bytes every match contains, taken from the top level sequence of
+            // the pattern; groups and classes end a literal, a top level alternation, an option
+            // setting or an escape that is hard to read yields none
+            static void required_literals(const std::string& pattern, std::vector<std::string>& out) {
+                out.clear();
+                std::vector<std::string> found;
+                std::string run;
+                auto flush = [&] {
+                    if (run.size() >= 3 && std::find(found.begin(), found.end(), run) == found.end()) found.push_back(run);
+                    run.clear();
+                };
+                int depth = 0;
+                const std::size_t n = pattern.size();
+                for (std::size_t i = 0; i < n; ++i) {
+                    const char c = pattern[i];
+                    if (c == '\\') {
+                        if (i + 1 >= n) return;
+                        const char e = pattern[++i];
+                        if (!std::isalnum(static_cast<unsigned char>(e))) {
+                            if (depth == 0) run.push_back(e);
+                            continue;
+                        }
+                        // \d, \w, \b and the like stand for one character or none, the rest take arguments
+                        if (std::isdigit(static_cast<unsigned char>(e)) || std::string_view("xcpPNkgoQEuUlL").find(e) != std::string_view::npos) return;
+                        if (depth == 0) flush();
+                        continue;
+                    }
+                    if (c == '[') {
+                        if (depth == 0) flush();
+                        // skip the class, a ] right after [ or [^ is a member
+                        std::size_t j = i + 1;
+                        if (j < n && pattern[j] == '^') ++j;
+                        if (j < n && pattern[j] == ']') ++j;
+                        for (; j < n && pattern[j] != ']'; ++j) {
+                            if (pattern[j] == '\\') ++j;
+                            else if (pattern[j] == '[' && j + 1 < n && (pattern[j + 1] == ':' || pattern[j + 1] == '.' || pattern[j + 1] == '=')) {
+                                const std::size_t close = pattern.find(std::string{pattern[j + 1], ']'}, j + 2);
+                                if (close == std::string::npos) return;
+                                j = close + 1;
+                            }
+                        }
+                        if (j >= n) return;
+                        i = j;
+                        continue;
+                    }
+                    if (c == '(') {
+                        // (?i), (?x) and named or conditional groups may change what follows
+                        if (i + 2 < n && pattern[i + 1] == '?' && std::string_view(":=!<>").find(pattern[i + 2]) == std::string_view::npos) return;
+                        if (depth == 0) flush();
+                        ++depth;
+                        continue;
+                    }
+                    if (c == ')') {
+                        --depth;
+                        continue;
+                    }
+                    if (depth > 0) continue;
+                    switch (c) {
+                        case '|':
+                            return;
+                        case '*':
+                        case '?':
+                        case '{':
+                            // the last character may be absent
+                            if (!run.empty()) run.pop_back();
+                            flush();
+                            if (c == '{') {
+                                const std::size_t close = pattern.find('}', i);
+                                if (close == std::string::npos) return;
+                                i = close;
+                            }
+                            // lazy and possessive forms
+                            if (i + 1 < n && (pattern[i + 1] == '?' || pattern[i + 1] == '+')) ++i;
+                            break;
+                        case '+':
+                            // the last character repeats, nothing follows it directly
+                            flush();
+                            if (i + 1 < n && (pattern[i + 1] == '?' || pattern[i + 1] == '+')) ++i;
+                            break;
+                        case '.':
+                        case '^':
+                        case '$':
+                            flush();
+                            break;
+                        default:
+                            run.push_back(c);
+                    }
+                }
+                flush();
+                out = std::move(found);
+            }
+
             std::shared_ptr<boost::regex> pattern_;
+            std::vector<std::string> literals_;
+            std::vector<uint64_t> tokens_;
     };
 } // namespace drlog
\ No newline at end of file
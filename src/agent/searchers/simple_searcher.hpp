@@ -3,6 +3,7 @@
 #include <memory>
 #include <spdlog/spdlog.h>
 #include "base_searcher.hpp"
+#include "util/token_filter.hpp"
 
 namespace drlog {
     class simple_searcher : public base_searcher { 
@@ -12,11 +13,13 @@ namespace drlog {
             // Parse the pattern string and build the boolean_pattern structure
             bool build_pattern(const std::string& pattern){
                 pattern_ = pattern;
+                finder_ = substring_finder(pattern_);
+                token_filter::required_tokens(pattern_, tokens_);
                 return true;
             }
-            bool search_line(const std::string& line,std::vector<matched_word> &matched, bool with_res = false){
-                size_t pos = line.find(pattern_);
-                if (pos != std::string::npos) {
+            bool search_line(std::string_view line,std::vector<matched_word> &matched, bool with_res = false){
+                size_t pos = finder_.find(line);
+                if (pos != substring_finder::npos) {
                     if(with_res) {
                         matched.clear();
                         matched.emplace_back(pattern_, pos);
@@ -25,7 +28,21 @@ namespace drlog {
                 }
                 return false;
             }
+            bool may_match(const token_probe& probe) const {
+                for (uint64_t token : tokens_) {
+                    if (!probe(token)) return false;
+                }
+                return true;
+            }
+            bool may_match_literals(const literal_probe& probe) const {
+                return probe(pattern_);
+            }
+            const substring_finder* literal_finder() const {
+                return &finder_;
+            }
         private:
             std::string pattern_;
+            substring_finder finder_;
+            std::vector<uint64_t> tokens_;
     };
 } // namespace drlog
\ No newline at end of file
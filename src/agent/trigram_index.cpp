@@ -0,0 +1,405 @@
+#include "trigram_index.hpp"
+#include "src/util/util.hpp"
+#include "util/igzip.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace drlog {
+    namespace fs = std::filesystem;
+
+    namespace {
+        constexpr char TRIGRAM_MAGIC[8] = {'D', 'R', 'L', 'O', 'G', 'T', 'R', 'I'};
+        constexpr uint64_t TRIGRAM_SEED = 0x64726c6f67747269ULL;
+        constexpr uint32_t TRIGRAM_SPACE = 1u << 24;
+
+        struct trigram_header {
+            char magic[8];
+            uint32_t version;
+            uint32_t etag_size;
+            uint64_t chunk_count;
+            uint64_t trigram_count;
+            uint64_t postings_size;
+            uint64_t checksum;          // MurMurHash64 of everything after the header
+        };
+
+        struct table_entry {
+            uint32_t trigram;
+            uint32_t offset;            // start of its postings, they end where the next trigram's start
+        };
+
+        static_assert(sizeof(trigram_header) == TrigramIndex::HEADER_SIZE && sizeof(table_entry) == 8, "records must keep 8 byte alignment");
+
+        inline uint64_t align8(uint64_t v) {
+            return (v + 7) & ~uint64_t(7);
+        }
+
+        inline void put_varint(std::string& out, uint32_t v) {
+            while (v >= 0x80) {
+                out.push_back(static_cast<char>(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back(static_cast<char>(v));
+        }
+
+        // cuts a stream fed in order into chunks and keeps the chunk list of every trigram. A chunk
+        // starts at a record start, so a record (a timestamped line and its continuation lines) lies
+        // in one chunk: once a chunk is full, the head of each next line is held back until one
+        // turns out to start a record
+        class trigram_collector {
+        public:
+            struct posting {
+                uint32_t last_chunk{0};
+                std::string chunks;     // varint deltas, the first one from 0
+            };
+
+            explicit trigram_collector(const TrigramIndex::record_start_fn& record_start)
+                : record_start_(record_start), seen_(TRIGRAM_SPACE / 64, 0) {
+                chunk_starts_.push_back(0);
+            }
+
+            void add(const char* data, std::size_t size) {
+                const char* p = data;
+                const char* end = data + size;
+                while (p < end) {
+                    if (holding_) {
+                        const std::size_t room = MAX_HELD - held_.size();
+                        const std::size_t span = std::min(room, static_cast<std::size_t>(end - p));
+                        const char* nl = static_cast<const char*>(std::memchr(p, '\n', span));
+                        const char* stop = nl ? nl : p + span;
+                        held_.append(p, stop);
+                        offset_ += static_cast<uint64_t>(stop - p);
+                        p = stop;
+                        // the line goes on in the next call
+                        if (!nl && held_.size() < MAX_HELD) break;
+                        release_held();
+                    }
+                    p = scan(p, end);
+                }
+            }
+
+            void finish() {
+                if (holding_) release_held();
+                end_chunk();
+            }
+            const std::vector<uint64_t>& chunk_starts() const { return chunk_starts_; }
+            std::unordered_map<uint32_t, posting>& postings() { return postings_; }
+
+        private:
+            // a timestamp sits in the first bytes of its line
+            static constexpr std::size_t MAX_HELD = 4096;
+
+            // the trigrams of data up to the line after a full chunk, returns where it stopped
+            const char* scan(const char* data, const char* end) {
+                const unsigned char* begin = reinterpret_cast<const unsigned char*>(data);
+                const unsigned char* stop = reinterpret_cast<const unsigned char*>(end);
+                for (const unsigned char* p = begin; p < stop; ++p) {
+                    if (*p == '\n') {
+                        run_ = 0;
+                        const uint64_t next = offset_ + static_cast<uint64_t>(p - begin) + 1;
+                        if (next - chunk_starts_.back() >= TrigramIndex::CHUNK_SIZE) {
+                            offset_ = next;
+                            held_start_ = next;
+                            holding_ = true;
+                            return reinterpret_cast<const char*>(p + 1);
+                        }
+                        continue;
+                    }
+                    add_byte(*p);
+                }
+                offset_ += static_cast<uint64_t>(stop - begin);
+                return end;
+            }
+
+            // a new chunk starts at the held line when it starts a record
+            void release_held() {
+                if (record_start_(held_)) {
+                    end_chunk();
+                    chunk_starts_.push_back(held_start_);
+                }
+                for (char c : held_) add_byte(static_cast<unsigned char>(c));
+                held_.clear();
+                holding_ = false;
+            }
+
+            void add_byte(unsigned char c) {
+                window_ = ((window_ << 8) | c) & (TRIGRAM_SPACE - 1);
+                if (run_ < 2) {
+                    ++run_;
+                    return;
+                }
+                uint64_t& w = seen_[window_ >> 6];
+                const uint64_t bit = uint64_t(1) << (window_ & 63);
+                if (!(w & bit)) {
+                    w |= bit;
+                    added_.push_back(window_);
+                }
+            }
+
+            void end_chunk() {
+                const uint32_t chunk = static_cast<uint32_t>(chunk_starts_.size() - 1);
+                for (uint32_t t : added_) {
+                    posting& p = postings_[t];
+                    put_varint(p.chunks, p.chunks.empty() ? chunk : chunk - p.last_chunk);
+                    p.last_chunk = chunk;
+                    seen_[t >> 6] &= ~(uint64_t(1) << (t & 63));
+                }
+                added_.clear();
+            }
+
+            const TrigramIndex::record_start_fn& record_start_;
+            std::vector<uint64_t> seen_;
+            std::vector<uint32_t> added_;
+            std::vector<uint64_t> chunk_starts_;
+            std::unordered_map<uint32_t, posting> postings_;
+            uint64_t offset_{0};
+            uint32_t window_{0};
+            uint32_t run_{0};
+            bool holding_{false};
+            uint64_t held_start_{0};
+            std::string held_;
+        };
+
+        bool read_text(const std::string& path, trigram_collector& collector) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return false;
+            struct stat st {};
+            if (fstat(fd, &st) != 0) {
+                ::close(fd);
+                return false;
+            }
+            std::size_t length = static_cast<std::size_t>(st.st_size);
+            if (length == 0) {
+                ::close(fd);
+                return true;
+            }
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (mapped == MAP_FAILED) return false;
+            madvise(mapped, length, MADV_SEQUENTIAL);
+            collector.add(static_cast<const char*>(mapped), length);
+            munmap(mapped, length);
+            return true;
+        }
+
+        bool read_gzip(const std::string& path, trigram_collector& collector) {
+            igzip_state igzs;
+            if (igzip::igzopen(path.c_str(), "rb", &igzs) != 0) return false;
+            std::vector<uint8_t> buf(256 * 1024);
+            int n = 0;
+            while ((n = igzip::igzread(&igzs, buf)) > 0) {
+                collector.add(reinterpret_cast<const char*>(buf.data()), static_cast<std::size_t>(n));
+            }
+            igzip::igzclose(&igzs);
+            return n == 0;
+        }
+    }
+
+    TrigramIndex::~TrigramIndex() {
+        close();
+    }
+
+    void TrigramIndex::close() {
+        if (data_) munmap(const_cast<char*>(data_), length_);
+        data_ = nullptr;
+        length_ = 0;
+        etag_size_ = 0;
+        chunks_ = nullptr;
+        chunk_count_ = 0;
+        table_ = nullptr;
+        trigram_count_ = 0;
+        postings_ = nullptr;
+        postings_size_ = 0;
+    }
+
+    bool TrigramIndex::build(const FileInfo& info, const std::string& path, const record_start_fn& record_start,
+                             uint64_t max_size, uint64_t& size) {
+        size = 0;
+        if (!info.file_index) return false;
+        const std::string& etag = info.file_index->index_etag;
+        trigram_collector collector(record_start);
+        bool ok = info.file_type == "gzip" ? read_gzip(info.fullpath, collector) : read_text(info.fullpath, collector);
+        if (!ok) {
+            spdlog::warn("Failed to read {} for its trigram index", info.fullpath);
+            return false;
+        }
+        collector.finish();
+        auto& postings = collector.postings();
+        const std::vector<uint64_t>& chunk_starts = collector.chunk_starts();
+        std::vector<uint32_t> trigrams;
+        trigrams.reserve(postings.size());
+        uint64_t postings_size = 0;
+        for (const auto& kv : postings) {
+            trigrams.push_back(kv.first);
+            postings_size += kv.second.chunks.size();
+        }
+        size = sizeof(trigram_header) + align8(etag.size()) + chunk_starts.size() * sizeof(uint64_t) +
+            trigrams.size() * sizeof(table_entry) + postings_size;
+        if (size > max_size || postings_size > UINT32_MAX) return false;
+        std::sort(trigrams.begin(), trigrams.end());
+
+        std::string body = etag;
+        body.resize(align8(body.size()), '\0');
+        body.append(reinterpret_cast<const char*>(chunk_starts.data()), chunk_starts.size() * sizeof(uint64_t));
+        const std::size_t table_offset = body.size();
+        body.resize(table_offset + trigrams.size() * sizeof(table_entry));
+        uint32_t offset = 0;
+        for (std::size_t i = 0; i < trigrams.size(); ++i) {
+            table_entry e {trigrams[i], offset};
+            std::memcpy(&body[table_offset + i * sizeof(table_entry)], &e, sizeof(e));
+            offset += static_cast<uint32_t>(postings[trigrams[i]].chunks.size());
+        }
+        for (uint32_t t : trigrams) {
+            std::string& chunks = postings[t].chunks;
+            body.append(chunks);
+            std::string().swap(chunks);
+        }
+
+        trigram_header h {};
+        std::memcpy(h.magic, TRIGRAM_MAGIC, sizeof(TRIGRAM_MAGIC));
+        h.version = VERSION;
+        h.etag_size = static_cast<uint32_t>(etag.size());
+        h.chunk_count = chunk_starts.size();
+        h.trigram_count = trigrams.size();
+        h.postings_size = postings_size;
+        h.checksum = util::MurMurHash64(body.data(), body.size(), TRIGRAM_SEED);
+
+        const std::string tmp = path + ".tmp";
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            spdlog::error("Failed to open trigram index temp file for writing: {}", tmp);
+            return false;
+        }
+        ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        ofs.write(body.data(), static_cast<std::streamsize>(body.size()));
+        ofs.close();
+        if (!ofs) {
+            spdlog::error("Failed to write trigram index temp file {}", tmp);
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            return false;
+        }
+        std::error_code ec;
+        fs::rename(tmp, path, ec);
+        if (ec) {
+            spdlog::error("Failed to move trigram index temp file {} to {}: {}", tmp, path, ec.message());
+            return false;
+        }
+        return true;
+    }
+
+    bool TrigramIndex::open(const std::string& path, std::string_view etag) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st {};
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(trigram_header)) {
+            ::close(fd);
+            return false;
+        }
+        std::size_t length = static_cast<std::size_t>(st.st_size);
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            spdlog::warn("Failed to mmap trigram index {}", path);
+            return false;
+        }
+        data_ = static_cast<const char*>(mapped);
+        length_ = length;
+
+        trigram_header h;
+        std::memcpy(&h, data_, sizeof(h));
+        const uint64_t chunks_offset = sizeof(h) + align8(h.etag_size);
+        const uint64_t table_offset = chunks_offset + h.chunk_count * sizeof(uint64_t);
+        if (std::memcmp(h.magic, TRIGRAM_MAGIC, sizeof(TRIGRAM_MAGIC)) != 0 || h.version != VERSION || h.chunk_count == 0 ||
+            table_offset + h.trigram_count * sizeof(table_entry) + h.postings_size != length_) {
+            close();
+            return false;
+        }
+        // a sidecar of an earlier version of the file is rebuilt
+        if (std::string_view(data_ + sizeof(h), h.etag_size) != etag) {
+            close();
+            return false;
+        }
+        if (util::MurMurHash64(data_ + sizeof(h), length_ - sizeof(h), TRIGRAM_SEED) != h.checksum) {
+            spdlog::warn("Trigram index {} checksum mismatch, ignoring it", path);
+            close();
+            return false;
+        }
+        etag_size_ = h.etag_size;
+        chunks_ = data_ + chunks_offset;
+        chunk_count_ = h.chunk_count;
+        table_ = data_ + table_offset;
+        trigram_count_ = h.trigram_count;
+        postings_ = table_ + trigram_count_ * sizeof(table_entry);
+        postings_size_ = h.postings_size;
+        // lookups touch a few table pages and postings each
+        madvise(const_cast<char*>(data_), length_, MADV_RANDOM);
+        return true;
+    }
+
+    uint64_t TrigramIndex::chunk_start(std::size_t i) const {
+        return reinterpret_cast<const uint64_t*>(chunks_)[i];
+    }
+
+    std::size_t TrigramIndex::chunk_of(uint64_t offset) const {
+        const uint64_t* begin = reinterpret_cast<const uint64_t*>(chunks_);
+        const uint64_t* it = std::upper_bound(begin, begin + chunk_count_, offset);
+        return it == begin ? 0 : static_cast<std::size_t>(it - begin - 1);
+    }
+
+    std::string_view TrigramIndex::postings(uint32_t trigram) const {
+        const table_entry* begin = reinterpret_cast<const table_entry*>(table_);
+        const table_entry* end = begin + trigram_count_;
+        const table_entry* it = std::lower_bound(begin, end, trigram,
+            [](const table_entry& e, uint32_t t) { return e.trigram < t; });
+        if (it == end || it->trigram != trigram) return {};
+        const std::size_t last = it + 1 < end ? (it + 1)->offset : postings_size_;
+        if (it->offset > last || last > postings_size_) return {};
+        return std::string_view(postings_ + it->offset, last - it->offset);
+    }
+
+    void TrigramIndex::candidate_chunks(std::string_view literal, std::vector<bool>& out) const {
+        out.assign(chunk_count_, true);
+        std::vector<uint32_t> trigrams;
+        for (std::size_t i = 0; i + 3 <= literal.size(); ++i) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(literal.data() + i);
+            // a literal across lines never matches, not worth ruling out here
+            if (p[0] == '\n' || p[1] == '\n' || p[2] == '\n') continue;
+            trigrams.push_back(static_cast<uint32_t>(p[0]) << 16 | static_cast<uint32_t>(p[1]) << 8 | p[2]);
+        }
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+        std::vector<bool> has;
+        for (uint32_t trigram : trigrams) {
+            std::string_view list = postings(trigram);
+            has.assign(chunk_count_, false);
+            uint64_t chunk = 0;
+            uint32_t v = 0;
+            int shift = 0;
+            for (char ch : list) {
+                const unsigned char c = static_cast<unsigned char>(ch);
+                if (shift < 32) v |= static_cast<uint32_t>(c & 0x7f) << shift;
+                shift += 7;
+                if (c & 0x80) continue;
+                chunk += v;
+                if (chunk < chunk_count_) has[chunk] = true;
+                v = 0;
+                shift = 0;
+            }
+            bool any = false;
+            for (std::size_t i = 0; i < chunk_count_; ++i) {
+                out[i] = out[i] && has[i];
+                any = any || out[i];
+            }
+            if (!any) return;
+        }
+    }
+}   // namespace drlog
@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include "indexer.hpp"
+
+namespace drlog {
+
+    // posting lists of the byte trigrams of a file that no longer changes. The file is cut at record
+    // starts (timestamped lines, where time index blocks start too) into chunks of about CHUNK_SIZE
+    // bytes, far smaller than the time index blocks so a literal of a few trigrams rules most of them
+    // out; trigrams spanning a newline are left out.
+    // Written once next to the index cache and mmap'd read-only: header, etag, chunk offsets,
+    // a sorted (trigram, postings offset) table and the chunk lists as varint deltas.
+    class TrigramIndex {
+    public:
+        static constexpr uint32_t VERSION = 1;
+        static constexpr std::size_t HEADER_SIZE = 48;
+        static constexpr uint64_t CHUNK_SIZE = 16 * 1024;
+
+        TrigramIndex() = default;
+        ~TrigramIndex();
+        TrigramIndex(const TrigramIndex&) = delete;
+        TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+        // whether a line starts a record, the file's pinned time layout decides
+        using record_start_fn = std::function<bool(std::string_view)>;
+        // build the index of info's content (text or gzip) and write it to path through a temp file;
+        // false if reading fails or the index would exceed max_size bytes, size receives its size
+        static bool build(const FileInfo& info, const std::string& path, const record_start_fn& record_start,
+                          uint64_t max_size, uint64_t& size);
+        // map a sidecar, false if it is missing, corrupt or was built for another etag
+        bool open(const std::string& path, std::string_view etag);
+        // etag of the file content it was built from
+        std::string_view etag() const { return std::string_view(data_ ? data_ + HEADER_SIZE : nullptr, etag_size_); }
+        std::size_t size() const { return length_; }
+        std::size_t chunk_count() const { return chunk_count_; }
+        // chunk i runs from chunk_start(i) to chunk_start(i + 1), the last one to the end of the file
+        uint64_t chunk_start(std::size_t i) const;
+        // chunk holding offset
+        std::size_t chunk_of(uint64_t offset) const;
+        // out[i] is false when chunk i lacks a trigram of literal; every chunk may hold a literal shorter than 3 bytes
+        void candidate_chunks(std::string_view literal, std::vector<bool>& out) const;
+
+    private:
+        void close();
+        // postings of trigram, empty when no chunk has it
+        std::string_view postings(uint32_t trigram) const;
+
+        const char* data_{nullptr};
+        std::size_t length_{0};
+        std::size_t etag_size_{0};
+        const char* chunks_{nullptr};
+        std::size_t chunk_count_{0};
+        const char* table_{nullptr};
+        std::size_t trigram_count_{0};
+        const char* postings_{nullptr};
+        std::size_t postings_size_{0};
+    };
+}   // namespace drlog
@@ -17,6 +17,24 @@ namespace drlog {
         std::string agent_id;
     };
 
+    // counts of a histogram bucket summed over agents
+    struct volume_bucket {
+        uint64_t lines{0};
+        uint64_t bytes{0};
+        uint64_t errors{0};
+        uint64_t warns{0};
+        uint64_t infos{0};
+    };
+
+    // the histogram one agent returned, in its own step
+    struct agent_histogram {
+        std::string address;
+        uint64_t step{0};
+        uint64_t files{0};
+        uint64_t unindexed{0};
+        std::map<uint64_t, volume_bucket> buckets;
+    };
+
     struct agent_file_indexes {
         std::string prefix;
         uint64_t last_updated;
@@ -411,6 +411,124 @@ namespace drlog {
         }
     }
 
+    net::awaitable<void> GTHandler::histogram(std::shared_ptr<http::request<http::string_body>> req,
+            std::shared_ptr<http::response<http::string_body>> res,
+            std::shared_ptr<bst::request_context> ctx) {
+        try {
+            if (req->method() != http::verb::get) {
+                res->result(http::status::method_not_allowed);
+                spdlog::warn("Method not allowed, only GET is allowed, url: {}", std::string(req->target()));
+                co_return;
+            }
+            auto prefix = util::url_decode(ctx->get_param("prefix"));
+            auto start_param = ctx->get_param("start_time");
+            auto end_param = ctx->get_param("end_time");
+            auto step_param = ctx->get_param("step");
+            if (prefix.empty() || start_param.empty() || end_param.empty()) {
+                res->result(http::status::bad_request);
+                spdlog::warn("Prefix, start_time and end_time parameters are required, url: {}", std::string(req->target()));
+                co_return;
+            }
+            std::vector<std::shared_ptr<agent_info>> agents = agent_manager_->get_active_agents();
+            if (agents.empty()) {
+                res->result(http::status::service_unavailable);
+                spdlog::warn("No active agents available to serve the request, url: {}", std::string(req->target()));
+                co_return;
+            }
+            std::string query = "prefix=" + util::url_encode(prefix) + "&start_time=" + util::url_encode(start_param) +
+                "&end_time=" + util::url_encode(end_param);
+            if (!step_param.empty()) query += "&step=" + util::url_encode(step_param);
+            std::vector<agent_histogram> histograms;
+            co_await get_agent_histograms(query, agents, histograms, ctx);
+            uint64_t step = 0;
+            for (const auto& h : histograms) step = std::max(step, h.step);
+            if (step == 0) {
+                res->result(http::status::bad_gateway);
+                spdlog::warn("No agent returned a histogram for prefix: {}, url: {}", prefix, std::string(req->target()));
+                co_return;
+            }
+            //agents with another index interval answer in other steps, their buckets go into the largest one.
+            //A bucket only lies within one of the largest when its step divides it, other agents are left out
+            std::map<uint64_t, volume_bucket> buckets;
+            uint64_t files = 0, unindexed = 0;
+            nlohmann::json skipped = nlohmann::json::array();
+            for (const auto& h : histograms) {
+                if (h.step == 0 || step % h.step != 0) {
+                    spdlog::warn("Histogram step {} of agent {} does not divide step {}, leaving it out, url: {}",
+                        h.step, h.address, step, std::string(req->target()));
+                    skipped.push_back(h.address);
+                    continue;
+                }
+                files += h.files;
+                unindexed += h.unindexed;
+                for (const auto& [time, b] : h.buckets) {
+                    volume_bucket& out = buckets[time - time % step];
+                    out.lines += b.lines;
+                    out.bytes += b.bytes;
+                    out.errors += b.errors;
+                    out.warns += b.warns;
+                    out.infos += b.infos;
+                }
+            }
+            //output
+            //{"status":0,"error_msg":"","step":300,"files":2,"unindexed":0,"skipped_agents":[],
+            //"buckets":[{"time":0,"lines":0,"bytes":0,"error":0,"warn":0,"info":0},{...}]}
+            nlohmann::json jres;
+            jres["status"] = 0;
+            jres["error_msg"] = "";
+            jres["step"] = step;
+            jres["files"] = files;
+            jres["unindexed"] = unindexed;
+            jres["skipped_agents"] = skipped;
+            jres["buckets"] = nlohmann::json::array();
+            for (const auto& [time, b] : buckets) {
+                nlohmann::json jb;
+                jb["time"] = time;
+                jb["lines"] = b.lines;
+                jb["bytes"] = b.bytes;
+                jb["error"] = b.errors;
+                jb["warn"] = b.warns;
+                jb["info"] = b.infos;
+                jres["buckets"].push_back(jb);
+            }
+            std::string res_body_j = jres.dump();
+            std::string res_body_c;
+            std::string content_encoding;
+            auto& headers = req->base();
+            auto it = headers.find(boost::beast::http::field::accept_encoding);
+            if (it != headers.end()) {
+                auto accept_encoding = it->value();
+                compress_body(res_body_j,accept_encoding,res_body_c,content_encoding);
+            }
+            if(content_encoding == "gzip") {
+                res->set(http::field::content_encoding, "gzip");
+                res->body() = std::move(res_body_c);
+            } else {
+                res->body() = std::move(res_body_j);
+            }
+            res->set(http::field::content_type, "application/json");
+            res->result(http::status::ok);
+            res->prepare_payload();
+            spdlog::debug("Histogram request served for prefix: {}, url: {}", prefix, std::string(req->target()));
+            co_return;
+        } catch ( nlohmann::json::exception& e) {
+            // best-effort 500
+            res->result(http::status::internal_server_error);
+            spdlog::error("JSON error in histogram handler: {}", e.what());
+            co_return;
+        } catch (const std::exception& e) {
+            // best-effort 500
+            res->result(http::status::internal_server_error);
+            spdlog::error("Internal server error in histogram handler: {}", e.what());
+            co_return;
+        } catch (...) {
+            // best-effort 500
+            res->result(http::status::internal_server_error);
+            spdlog::error("Unknown internal server error in histogram handler");
+            co_return;
+        }
+    }
+
     void GTHandler::compress_body(const std::string& input,const std::string& accept_encoding,
             std::string& output,std::string& content_encoding) {
         if(input.size() < 1024) {
@@ -513,6 +631,82 @@ namespace drlog {
         co_return;
     }
 
+    net::awaitable<void> GTHandler::get_agent_histograms(const std::string &query, std::vector<std::shared_ptr<agent_info>> agents,
+        std::vector<agent_histogram>& out_histograms, std::shared_ptr<bst::request_context> ctx) {
+        auto executor = co_await net::this_coro::executor;
+        const size_t max_tasks_per_coroutine = 10;
+        size_t total_agents = agents.size();
+        size_t num_coroutines = (total_agents + max_tasks_per_coroutine - 1) / max_tasks_per_coroutine;
+
+        std::vector<net::awaitable<void>> coroutines;
+        std::mutex out_mutex; // Mutex to protect the outputs
+
+        for (size_t i = 0; i < num_coroutines; ++i) {
+            size_t start_index = i * max_tasks_per_coroutine;
+            size_t end_index = std::min(start_index + max_tasks_per_coroutine, total_agents);
+
+            coroutines.push_back(net::co_spawn(executor,[this, &agents, start_index, end_index, &query, &out_histograms, &out_mutex]() -> net::awaitable<void> {
+                for (size_t j = start_index; j < end_index; ++j) {
+                    const auto& agent = agents[j];
+                    std::string url = "http://" + agent->address + "/log/histogram?" + query;
+                    try {
+                        bst::http_client_async client;
+                        bst::request req;
+                        bst::response res;
+                        req.url = url;
+                        req.headers["Accept-Encoding"] = "gzip";
+                        client.set_request_timeout(10);
+
+                        int status = co_await client.get(req, res);
+                        if (status != 200) {
+                            spdlog::warn("Failed to get histogram from agent: {}, status: {}", url, status);
+                            continue;
+                        }
+                        std::string res_body;
+                        auto it_ce = res.headers.find("Content-Encoding");
+                        if(it_ce != res.headers.end()) {
+                            decompress_body(res.body, it_ce->second, res_body);
+                        } else {
+                            res_body = std::move(res.body);
+                        }
+                        nlohmann::json jbody = nlohmann::json::parse(res_body, nullptr, false);
+                        if (jbody.is_discarded() || !jbody.contains("buckets") || !jbody["buckets"].is_array()) {
+                            spdlog::warn("Invalid histogram from agent: {}", url);
+                            continue;
+                        }
+                        agent_histogram h;
+                        h.address = agent->address;
+                        h.step = jbody.value("step", uint64_t(0));
+                        h.files = jbody.value("files", uint64_t(0));
+                        h.unindexed = jbody.value("unindexed", uint64_t(0));
+                        for (const auto& item : jbody["buckets"]) {
+                            volume_bucket& b = h.buckets[item.value("time", uint64_t(0))];
+                            b.lines += item.value("lines", uint64_t(0));
+                            b.bytes += item.value("bytes", uint64_t(0));
+                            b.errors += item.value("error", uint64_t(0));
+                            b.warns += item.value("warn", uint64_t(0));
+                            b.infos += item.value("info", uint64_t(0));
+                        }
+                        std::lock_guard<std::mutex> lock(out_mutex);
+                        out_histograms.push_back(std::move(h));
+                    } catch ( const nlohmann::json::exception& e) {
+                        spdlog::error("JSON error processing agent {}: {}", url, e.what());
+                    } catch (const std::exception& e) {
+                        spdlog::error("Error processing agent {}: {}", url, e.what());
+                    } catch (...) {
+                        spdlog::error("Unknown error processing agent: {}", url);
+                    }
+                }
+                co_return;
+            },net::use_awaitable));
+        }
+
+        for (auto& coroutine : coroutines) {
+            co_await std::move(coroutine);
+        }
+        co_return;
+    }
+
     net::awaitable<void> GTHandler::get_agent_search(const std::string &prefix,
         const nlohmann::json &jreq_body,std::shared_ptr<bst::request_context> ctx) {
         auto p_indexes = ctx->get<std::shared_ptr<std::vector<agent_file_index>>>("indexes");
@@ -34,6 +34,10 @@ namespace drlog {
             std::shared_ptr<http::response<http::string_body>> res,
             std::shared_ptr<bst::request_context> ctx);
 
+        net::awaitable<void> histogram(std::shared_ptr<http::request<http::string_body>> req,
+            std::shared_ptr<http::response<http::string_body>> res,
+            std::shared_ptr<bst::request_context> ctx);
+
         net::awaitable<void> announce(std::shared_ptr<http::request<http::string_body>> req,
             std::shared_ptr<http::response<http::string_body>> res,
             std::shared_ptr<bst::request_context> ctx);
@@ -55,6 +59,8 @@ namespace drlog {
             std::string& output);
         net::awaitable<void> get_agent_log_lists(const std::string &prefix,std::vector<std::shared_ptr<agent_info>> agents,
             std::vector<agent_file_index>& out_indexes, std::shared_ptr<bst::request_context> ctx);
+        net::awaitable<void> get_agent_histograms(const std::string &query, std::vector<std::shared_ptr<agent_info>> agents,
+            std::vector<agent_histogram>& out_histograms, std::shared_ptr<bst::request_context> ctx);
         net::awaitable<void> get_agent_search(const std::string &prefix,
             const nlohmann::json &jreq_body,std::shared_ptr<bst::request_context> ctx);
     private:
@@ -71,6 +71,7 @@ int main(int argc, char* argv[]) {
     bst::request_handler::register_route("/hello", std::bind(&drlog::GTHandler::hello, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     bst::request_handler::register_route("/log/list", std::bind(&drlog::GTHandler::list, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     bst::request_handler::register_route("/log/search", std::bind(&drlog::GTHandler::search, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    bst::request_handler::register_route("/log/histogram", std::bind(&drlog::GTHandler::histogram, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     bst::request_handler::register_route("/agent/announce", std::bind(&drlog::GTHandler::announce, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     bst::request_handler::register_route("/agent/list", std::bind(&drlog::GTHandler::agent_list, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     bst::request_handler::register_route("/web", std::bind(&drlog::GTHandler::web, handler, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), true);
@@ -0,0 +1,146 @@
+#include "gzip_index.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace drlog {
+    static constexpr std::size_t WINDOW_SIZE = 32 * 1024;
+    static constexpr std::size_t IN_BUF_SIZE = 64 * 1024;
+
+    gzip_index_reader::gzip_index_reader(uint64_t span) : span_(span) {
+    }
+
+    gzip_index_reader::~gzip_index_reader() {
+        close();
+    }
+
+    int gzip_index_reader::open(const char* filename) {
+        close();
+        in_file_ = fopen(filename, "rb");
+        if (!in_file_) {
+            return -101; // Failed to open file
+        }
+        std::memset(&strm_, 0, sizeof(strm_));
+        // gzip wrapper only, the header is consumed before the first block
+        if (inflateInit2(&strm_, 15 + 16) != Z_OK) {
+            close();
+            return -1003;
+        }
+        strm_init_ = true;
+        finished_ = false;
+        in_buffer_.resize(IN_BUF_SIZE);
+        history_.assign(WINDOW_SIZE, 0);
+        last_point_out_ = 0;
+        points_.clear();
+        return 0; // Success
+    }
+
+    int gzip_index_reader::read(std::vector<uint8_t>& buf) {
+        if (!strm_init_ || !in_file_) {
+            return -1001; // Invalid state
+        }
+        if (buf.empty()) {
+            return -1002; // Invalid buffer or length
+        }
+        std::size_t produced = 0;
+        // Z_BLOCK may return at a block boundary before writing anything
+        while (produced == 0 && !finished_) {
+            if (strm_.avail_in == 0) {
+                strm_.next_in = in_buffer_.data();
+                strm_.avail_in = static_cast<uInt>(fread(in_buffer_.data(), 1, in_buffer_.size(), in_file_));
+                if (ferror(in_file_)) {
+                    return -102; // Error reading file
+                }
+                if (strm_.avail_in == 0) {
+                    finished_ = true; // truncated stream, return what was inflated
+                    break;
+                }
+            }
+            strm_.next_out = buf.data();
+            strm_.avail_out = static_cast<uInt>(buf.size());
+            int ret = inflate(&strm_, Z_BLOCK);
+            if (ret == Z_NEED_DICT) {
+                return Z_DATA_ERROR; // not a gzip stream
+            }
+            if (ret < 0 && ret != Z_BUF_ERROR) {
+                return ret; // zlib error
+            }
+            produced = buf.size() - strm_.avail_out;
+
+            // keep the last 32 KiB of output for the windows
+            std::size_t keep = std::min(produced, WINDOW_SIZE);
+            std::size_t pos = static_cast<std::size_t>((strm_.total_out - keep) % WINDOW_SIZE);
+            const uint8_t* src = buf.data() + produced - keep;
+            std::size_t first = std::min(keep, WINDOW_SIZE - pos);
+            std::memcpy(history_.data() + pos, src, first);
+            std::memcpy(history_.data(), src + first, keep - first);
+
+            if (ret == Z_STREAM_END) {
+                finished_ = true;
+            } else if (span_ > 0 && (strm_.data_type & 128) && !(strm_.data_type & 64) &&
+                       strm_.total_out - last_point_out_ >= span_) {
+                // end of a block that is not the last one
+                add_point();
+            }
+        }
+        return static_cast<int>(produced);
+    }
+
+    void gzip_index_reader::add_point() {
+        inflate_point point;
+        point.out_offset = strm_.total_out;
+        point.in_offset = strm_.total_in;
+        point.bits = static_cast<uint32_t>(strm_.data_type & 7);
+
+        // unroll the ring, oldest byte first
+        std::size_t have = static_cast<std::size_t>(std::min<uint64_t>(strm_.total_out, WINDOW_SIZE));
+        std::vector<uint8_t> window(have);
+        std::size_t start = static_cast<std::size_t>((strm_.total_out - have) % WINDOW_SIZE);
+        std::size_t first = std::min(have, WINDOW_SIZE - start);
+        std::memcpy(window.data(), history_.data() + start, first);
+        std::memcpy(window.data() + first, history_.data(), have - first);
+
+        uLongf packed_size = compressBound(static_cast<uLong>(have));
+        point.window.resize(packed_size);
+        if (compress2(reinterpret_cast<Bytef*>(&point.window[0]), &packed_size, window.data(), static_cast<uLong>(have), Z_BEST_SPEED) != Z_OK) {
+            return;
+        }
+        point.window.resize(packed_size);
+        last_point_out_ = strm_.total_out;
+        points_.push_back(std::move(point));
+    }
+
+    void gzip_index_reader::close() {
+        if (strm_init_) inflateEnd(&strm_);
+        strm_init_ = false;
+        if (in_file_) fclose(in_file_);
+        in_file_ = nullptr;
+    }
+
+    bool gzip_index_reader::unpack_window(const inflate_point& point, std::vector<uint8_t>& out) {
+        out.resize(WINDOW_SIZE);
+        uLongf size = static_cast<uLongf>(out.size());
+        if (uncompress(out.data(), &size, reinterpret_cast<const Bytef*>(point.window.data()), static_cast<uLong>(point.window.size())) != Z_OK) {
+            return false;
+        }
+        out.resize(size);
+        return true;
+    }
+
+    uint64_t gzip_index_reader::trailer_size(const char* filename) {
+        FILE* f = fopen(filename, "rb");
+        if (!f) return 0;
+        unsigned char isize[4] = {0};
+        bool ok = fseeko(f, -4, SEEK_END) == 0 && fread(isize, 1, 4, f) == 4;
+        fclose(f);
+        if (!ok) return 0;
+        return static_cast<uint64_t>(isize[0]) | (static_cast<uint64_t>(isize[1]) << 8) |
+               (static_cast<uint64_t>(isize[2]) << 16) | (static_cast<uint64_t>(isize[3]) << 24);
+    }
+
+    const inflate_point* gzip_index_reader::find_point(const std::vector<inflate_point>& points, uint64_t offset) {
+        auto it = std::upper_bound(points.begin(), points.end(), offset,
+            [](uint64_t off, const inflate_point& p) { return off < p.out_offset; });
+        if (it == points.begin()) return nullptr;
+        return &*(it - 1);
+    }
+} // namespace drlog
@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <zlib.h>
+
+namespace drlog {
+    // a deflate block boundary of a gzip stream, inflation can start there without the data before it
+    struct inflate_point {
+        uint64_t out_offset{0};     // uncompressed offset of the point
+        uint64_t in_offset{0};      // compressed offset of the first whole byte after the point
+        uint32_t bits{0};           // 0-7 high bits of the byte before in_offset that still belong to the point
+        std::string window;         // the 32 KiB of output before out_offset, zlib compressed
+    };
+
+    // reads the first member of a gzip file with zlib, stopping at every deflate block boundary
+    // to record an inflate_point once span bytes of output passed since the last one, 0 records none
+    class gzip_index_reader {
+    public:
+        explicit gzip_index_reader(uint64_t span);
+        ~gzip_index_reader();
+        gzip_index_reader(const gzip_index_reader&) = delete;
+        gzip_index_reader& operator=(const gzip_index_reader&) = delete;
+
+        // same return codes as igzip::igzopen / igzip::igzread
+        int open(const char* filename);
+        int read(std::vector<uint8_t>& buf);
+        void close();
+        std::vector<inflate_point>& points() { return points_; }
+        // the compressed input, nullptr when not open
+        FILE* file() const { return in_file_; }
+
+        // decompress the window of a point into out
+        static bool unpack_window(const inflate_point& point, std::vector<uint8_t>& out);
+        // uncompressed size modulo 2^32 from the trailer of the last member, 0 if unreadable
+        static uint64_t trailer_size(const char* filename);
+        // last point at or before offset, nullptr if inflation has to start at the beginning
+        static const inflate_point* find_point(const std::vector<inflate_point>& points, uint64_t offset);
+
+    private:
+        void add_point();
+
+        uint64_t span_;
+        FILE* in_file_{nullptr};
+        z_stream strm_ {};
+        bool strm_init_{false};
+        bool finished_{false};
+        std::vector<uint8_t> in_buffer_;
+        std::vector<uint8_t> history_;    // ring of the last 32 KiB of output
+        uint64_t last_point_out_{0};
+        std::vector<inflate_point> points_;
+    };
+} // namespace drlog
@@ -34,6 +34,54 @@ namespace drlog
         return 0; // Success
     }
     
+    int igzip::igzopen_at(const char* filename, const inflate_point& point, igzip_state* igz) {
+        if(!igz) {
+            return -1001; // Invalid state pointer
+        }
+        igz->in_file = nullptr;
+        std::vector<uint8_t> window;
+        if (!gzip_index_reader::unpack_window(point, window)) {
+            return -103; // Corrupt inflate point
+        }
+        igz->in_file = fopen(filename, "rb");
+        if (!igz->in_file) {
+            return -101; // Failed to open file
+        }
+        igz->in_buf_size = GZIP_DEFAULT_BUF_SIZE;
+        igz->in_buffer.resize(igz->in_buf_size);
+        isal_inflate_init(&igz->state);
+        igz->state.crc_flag = ISAL_DEFLATE;  // raw deflate from a block boundary, no trailer check
+        // the point may start inside a byte, its high bits are fed through the bit buffer
+        if (fseeko(igz->in_file, static_cast<off_t>(point.in_offset - (point.bits ? 1 : 0)), SEEK_SET) != 0) {
+            fclose(igz->in_file);
+            igz->in_file = nullptr;
+            return -102; // Error reading file
+        }
+        if (point.bits) {
+            int c = fgetc(igz->in_file);
+            if (c == EOF) {
+                fclose(igz->in_file);
+                igz->in_file = nullptr;
+                return -102; // Error reading file
+            }
+            igz->state.read_in = static_cast<uint64_t>(c) >> (8 - point.bits);
+            igz->state.read_in_length = static_cast<int32_t>(point.bits);
+        }
+        if (!window.empty() && isal_inflate_set_dict(&igz->state, window.data(), static_cast<uint32_t>(window.size())) != ISAL_DECOMP_OK) {
+            fclose(igz->in_file);
+            igz->in_file = nullptr;
+            return -103; // Corrupt inflate point
+        }
+        igz->state.next_in = igz->in_buffer.data();
+        igz->state.avail_in = fread(igz->in_buffer.data(), 1, igz->in_buf_size, igz->in_file);
+        if(ferror(igz->in_file)) {
+            fclose(igz->in_file);
+            igz->in_file = nullptr;
+            return -102; // Error reading file
+        }
+        return 0; // Success
+    }
+
     int igzip::igzread(igzip_state* igz, std::vector<uint8_t> &buf) {
         if(!igz || !igz->in_file) {
             return -1001; // // Invalid state pointer
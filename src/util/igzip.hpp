@@ -1,5 +1,6 @@
 
 #include "libs/igzip/igzip_lib.h"
+#include "gzip_index.hpp"
 #include <vector>
 #include <stdio.h>
 
@@ -13,7 +14,7 @@ namespace drlog {
         char *filename;
         char *mode;
 
-        igzip_state(){
+        igzip_state() : in_buf_size(0), in_file(nullptr), filename(nullptr), mode(nullptr) {
         }
 
         ~igzip_state()  {
@@ -32,6 +33,8 @@ namespace drlog {
         igzip(/* args */){};
         ~igzip(){};
         static int igzopen(const char* filename, const char* mode, igzip_state* igz);
+        // open positioned at an inflate point, the first igzread returns the output from point.out_offset on
+        static int igzopen_at(const char* filename, const inflate_point& point, igzip_state* igz);
         static int igzread(igzip_state* igz, std::vector<uint8_t> &buf);
         static int igzclose(igzip_state* igz);
     };
@@ -0,0 +1,146 @@
+#include "line_scanner.hpp"
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DRLOG_X86_KERNELS 1
+#endif
+
+namespace drlog {
+    namespace {
+        using scan_fn = void (*)(const char*, std::size_t, std::vector<uint32_t>&);
+
+        void scan_memchr(const char* data, std::size_t size, std::vector<uint32_t>& out) {
+            const char* p = data;
+            const char* end = data + size;
+            while (p < end) {
+                const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+                if (!nl) break;
+                out.push_back(static_cast<uint32_t>(nl - data));
+                p = nl + 1;
+            }
+        }
+
+        // one set bit per newline in the block starting at pos
+        inline void emit_mask(uint64_t mask, uint32_t pos, std::vector<uint32_t>& out) {
+            while (mask) {
+                out.push_back(pos + static_cast<uint32_t>(__builtin_ctzll(mask)));
+                mask &= mask - 1;
+            }
+        }
+
+#ifdef DRLOG_X86_KERNELS
+        void scan_sse2(const char* data, std::size_t size, std::vector<uint32_t>& out) {
+            const __m128i nl = _mm_set1_epi8('\n');
+            std::size_t i = 0;
+            for (; i + 64 <= size; i += 64) {
+                const __m128i* p = reinterpret_cast<const __m128i*>(data + i);
+                uint64_t m0 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p), nl)));
+                uint64_t m1 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 1), nl)));
+                uint64_t m2 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 2), nl)));
+                uint64_t m3 = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 3), nl)));
+                emit_mask(m0 | (m1 << 16) | (m2 << 32) | (m3 << 48), static_cast<uint32_t>(i), out);
+            }
+            for (; i + 16 <= size; i += 16) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                emit_mask(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl))), static_cast<uint32_t>(i), out);
+            }
+            for (; i < size; ++i) {
+                if (data[i] == '\n') out.push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        __attribute__((target("avx2")))
+        void scan_avx2(const char* data, std::size_t size, std::vector<uint32_t>& out) {
+            const __m256i nl = _mm256_set1_epi8('\n');
+            std::size_t i = 0;
+            for (; i + 64 <= size; i += 64) {
+                const __m256i* p = reinterpret_cast<const __m256i*>(data + i);
+                uint64_t lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(p), nl)));
+                uint64_t hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(p + 1), nl)));
+                emit_mask(lo | (hi << 32), static_cast<uint32_t>(i), out);
+            }
+            for (; i + 32 <= size; i += 32) {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                emit_mask(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl))), static_cast<uint32_t>(i), out);
+            }
+            for (; i < size; ++i) {
+                if (data[i] == '\n') out.push_back(static_cast<uint32_t>(i));
+            }
+        }
+#endif
+
+        struct scan_kernel {
+            scan_fn fn;
+            const char* name;
+        };
+
+        scan_kernel pick_kernel() {
+#ifdef DRLOG_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return {scan_avx2, "avx2"};
+            if (__builtin_cpu_supports("sse2")) return {scan_sse2, "sse2"};
+#endif
+            return {scan_memchr, "memchr"};
+        }
+
+        const scan_kernel& kernel() {
+            static const scan_kernel k = pick_kernel();
+            return k;
+        }
+    }
+
+    void line_scanner::find_newlines(const char* data, std::size_t size, std::vector<uint32_t>& out) {
+        kernel().fn(data, size, out);
+    }
+
+    const char* line_scanner::kernel_name() {
+        return kernel().name;
+    }
+
+    void line_buffer::append(const char* data, std::size_t size) {
+        if (consumed_ > 0) {
+            // move the tail to the front, the newlines left are all behind it
+            buffer_.erase(0, consumed_);
+            base_offset_ += consumed_;
+            std::size_t kept = 0;
+            for (std::size_t i = next_newline_; i < newlines_.size(); ++i) {
+                newlines_[kept++] = newlines_[i] - static_cast<uint32_t>(consumed_);
+            }
+            newlines_.resize(kept);
+            next_newline_ = 0;
+            consumed_ = 0;
+        }
+        const std::size_t start = buffer_.size();
+        buffer_.append(data, size);
+        const std::size_t first = newlines_.size();
+        line_scanner::find_newlines(buffer_.data() + start, size, newlines_);
+        for (std::size_t i = first; i < newlines_.size(); ++i) {
+            newlines_[i] += static_cast<uint32_t>(start);
+        }
+    }
+
+    bool line_buffer::next(std::string_view& line, uint64_t& offset) {
+        if (next_newline_ >= newlines_.size()) return false;
+        const std::size_t nl = newlines_[next_newline_++];
+        line = std::string_view(buffer_.data() + consumed_, nl - consumed_);
+        offset = base_offset_ + consumed_;
+        consumed_ = nl + 1;
+        return true;
+    }
+
+    bool line_buffer::tail(std::string_view& line, uint64_t& offset) {
+        if (next_newline_ < newlines_.size() || consumed_ >= buffer_.size()) return false;
+        line = std::string_view(buffer_.data() + consumed_, buffer_.size() - consumed_);
+        offset = base_offset_ + consumed_;
+        consumed_ = buffer_.size();
+        return true;
+    }
+
+    void line_buffer::clear() {
+        base_offset_ += buffer_.size();
+        std::string().swap(buffer_);
+        consumed_ = 0;
+        newlines_.clear();
+        next_newline_ = 0;
+    }
+} // namespace drlog
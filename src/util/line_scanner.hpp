@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace drlog {
+    // finds the newlines of a buffer 32 (avx2) or 16 (sse2) bytes at a time,
+    // the kernel is picked once from the running cpu, memchr elsewhere
+    class line_scanner {
+    public:
+        // append the offset of every '\n' in data[0, size) to out; size must fit in 32 bits
+        static void find_newlines(const char* data, std::size_t size, std::vector<uint32_t>& out);
+        static const char* kernel_name();
+    };
+
+    // splits a stream of chunks into lines, the unterminated tail is kept for the next chunk.
+    // lines are views into the buffer and stay valid until the next append()
+    class line_buffer {
+    public:
+        // add a chunk at stream offset base_offset() + pending() and find its newlines
+        void append(const char* data, std::size_t size);
+        // next complete line without its '\n', offset is its position in the stream
+        bool next(std::string_view& line, uint64_t& offset);
+        // take the unterminated tail once next() is exhausted, for the last line of a stream
+        bool tail(std::string_view& line, uint64_t& offset);
+        // bytes not yet returned by next()
+        std::size_t pending() const { return buffer_.size() - consumed_; }
+        // drop everything buffered, the stream offset moves past it
+        void clear();
+        // stream offset of the first buffered byte
+        uint64_t base_offset() const { return base_offset_ + consumed_; }
+        // stream offset of the first byte appended to an empty buffer
+        void set_base_offset(uint64_t offset) { base_offset_ = offset; }
+
+    private:
+        std::string buffer_;
+        std::size_t consumed_{0};
+        uint64_t base_offset_{0};
+        std::vector<uint32_t> newlines_;
+        std::size_t next_newline_{0};
+    };
+} // namespace drlog
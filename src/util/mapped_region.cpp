@@ -0,0 +1,123 @@
+#include "mapped_region.hpp"
+#include <atomic>
+#include <mutex>
+#include <csignal>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+namespace drlog {
+    namespace {
+        // the address range of a mapped region, read by the signal handler without locks
+        struct guard_slot {
+            std::atomic<uintptr_t> begin{0};
+            std::atomic<uintptr_t> end{0};
+            std::atomic<bool> truncated{false};
+            std::atomic<bool> used{false};
+        };
+        guard_slot guards[mapped_region::MAX_GUARDS];
+        struct sigaction previous_action {};
+        uintptr_t page_size = 4096;
+        std::once_flag install_once;
+        bool installed = false;
+
+        // a fault inside a guarded region is a page past the end of a truncated file: map a zero page
+        // over it and let the read go on. Any other fault goes to the handler that was there before
+        void on_sigbus(int sig, siginfo_t* info, void* context) {
+            const uintptr_t addr = reinterpret_cast<uintptr_t>(info->si_addr);
+            for (auto& slot : guards) {
+                const uintptr_t begin = slot.begin.load(std::memory_order_acquire);
+                if (begin == 0 || addr < begin || addr >= slot.end.load(std::memory_order_acquire)) continue;
+                void* page = reinterpret_cast<void*>(addr & ~(page_size - 1));
+                if (mmap(page, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+                    slot.truncated.store(true, std::memory_order_release);
+                    return;
+                }
+                break;
+            }
+            if ((previous_action.sa_flags & SA_SIGINFO) && previous_action.sa_sigaction) {
+                previous_action.sa_sigaction(sig, info, context);
+            } else if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN) {
+                previous_action.sa_handler(sig);
+            } else {
+                // the faulting access runs again and takes the default action
+                signal(SIGBUS, SIG_DFL);
+            }
+        }
+
+        void install_handler() {
+            page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+            struct sigaction action {};
+            action.sa_sigaction = on_sigbus;
+            action.sa_flags = SA_SIGINFO;
+            sigemptyset(&action.sa_mask);
+            if (sigaction(SIGBUS, &action, &previous_action) != 0) {
+                spdlog::warn("Failed to install the SIGBUS handler of mapped files: {}", std::strerror(errno));
+                return;
+            }
+            installed = true;
+        }
+
+        int acquire_slot() {
+            for (int i = 0; i < mapped_region::MAX_GUARDS; ++i) {
+                bool expected = false;
+                if (guards[i].used.compare_exchange_strong(expected, true)) return i;
+            }
+            return -1;
+        }
+    }
+
+    mapped_region::~mapped_region() {
+        unmap();
+    }
+
+    bool mapped_region::map(int fd, uint64_t offset, std::size_t length) {
+        unmap();
+        std::call_once(install_once, install_handler);
+        if (!installed || length == 0) return false;
+        slot_ = acquire_slot();
+        if (slot_ < 0) return false;
+        const uint64_t aligned = offset / page_size * page_size;
+        length_ = length + static_cast<std::size_t>(offset - aligned);
+        void* base = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(aligned));
+        if (base == MAP_FAILED) {
+            guards[slot_].used.store(false);
+            slot_ = -1;
+            return false;
+        }
+        base_ = base;
+        data_ = static_cast<const char*>(base_) + (offset - aligned);
+        size_ = length;
+        guard_slot& slot = guards[slot_];
+        slot.truncated.store(false);
+        slot.end.store(reinterpret_cast<uintptr_t>(base_) + length_, std::memory_order_release);
+        slot.begin.store(reinterpret_cast<uintptr_t>(base_), std::memory_order_release);
+        return true;
+    }
+
+    void mapped_region::unmap() {
+        if (slot_ >= 0) {
+            guard_slot& slot = guards[slot_];
+            slot.begin.store(0, std::memory_order_release);
+            slot.end.store(0, std::memory_order_release);
+            slot.used.store(false);
+            slot_ = -1;
+        }
+        if (base_) {
+            munmap(base_, length_);
+            base_ = nullptr;
+        }
+        data_ = nullptr;
+        size_ = 0;
+        length_ = 0;
+    }
+
+    void mapped_region::advise(int advice) {
+        if (base_) madvise(base_, length_, advice);
+    }
+
+    bool mapped_region::truncated() const {
+        return slot_ >= 0 && guards[slot_].truncated.load(std::memory_order_acquire);
+    }
+} // namespace drlog
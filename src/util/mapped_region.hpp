@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace drlog {
+    // a read-only mapping of part of a file that survives the file being truncated meanwhile (a
+    // copytruncate rotation): the pages past the new end read as zeros instead of raising SIGBUS,
+    // and truncated() turns true. The thread reading the mapping has to stop trusting its data then
+    class mapped_region {
+    public:
+        mapped_region() = default;
+        ~mapped_region();
+        mapped_region(const mapped_region&) = delete;
+        mapped_region& operator=(const mapped_region&) = delete;
+
+        // map [offset, offset + length) of fd; false when it cannot be mapped, or when MAX_GUARDS
+        // regions are mapped already and it could not be guarded
+        bool map(int fd, uint64_t offset, std::size_t length);
+        void unmap();
+        // madvise(2) over the whole region
+        void advise(int advice);
+        // the byte at offset
+        const char* data() const { return data_; }
+        std::size_t size() const { return size_; }
+        bool truncated() const;
+
+        static constexpr int MAX_GUARDS = 256;
+
+    private:
+        void* base_{nullptr};
+        std::size_t length_{0};
+        const char* data_{nullptr};
+        std::size_t size_{0};
+        int slot_{-1};
+    };
+} // namespace drlog
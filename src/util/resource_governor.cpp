@@ -0,0 +1,134 @@
+#include "resource_governor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <ctime>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <spdlog/spdlog.h>
+#include "util.hpp"
+
+namespace drlog {
+    namespace {
+        // cpu time of the calling thread and the wall time it was taken at, per governed thread
+        struct thread_state {
+            bool governed{false};
+            double cpu_start{0};
+            double wall_start{0};
+        };
+        thread_local thread_state this_thread;
+
+        double thread_cpu_micros() {
+            struct timespec ts {};
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+        }
+
+        void sleep_micros(double us) {
+            std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(us)));
+        }
+
+        // no glibc wrapper for ioprio_set
+        constexpr int IOPRIO_WHO_PROCESS = 1;
+        constexpr int IOPRIO_CLASS_SHIFT = 13;
+    }
+
+    void resource_governor::govern_this_thread() {
+        if (this_thread.governed) return;
+        this_thread.governed = true;
+        this_thread.cpu_start = thread_cpu_micros();
+        this_thread.wall_start = util::get_micro_timestamp();
+        // on linux both apply to the calling thread only
+        const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+        if (limits_.nice != 0) {
+            errno = 0;
+            int current = getpriority(PRIO_PROCESS, tid);
+            if (errno == 0 && setpriority(PRIO_PROCESS, tid, current + limits_.nice) != 0) {
+                spdlog::warn("Failed to set nice {} of thread {}: {}", limits_.nice, tid, std::strerror(errno));
+            }
+        }
+        if (limits_.io_class > 0) {
+            int level = limits_.io_class == 3 ? 0 : std::clamp(limits_.io_level, 0, 7);
+            if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, (limits_.io_class << IOPRIO_CLASS_SHIFT) | level) != 0) {
+                spdlog::warn("Failed to set io class {} of thread {}: {}", limits_.io_class, tid, std::strerror(errno));
+            }
+        }
+    }
+
+    void resource_governor::throttle(std::size_t bytes) {
+        if (!this_thread.governed) return;
+        read_bytes_ += bytes;
+        wait_for_load();
+        wait_for_rate(bytes);
+        wait_for_cpu();
+    }
+
+    // the load average changes slowly, it is read at most once a second by any thread
+    void resource_governor::wait_for_load() {
+        if (limits_.max_load <= 0) return;
+        double begin = util::get_micro_timestamp();
+        bool paused = false;
+        while (true) {
+            double now = util::get_micro_timestamp();
+            double checked = load_checked_at_.load();
+            if (now - checked >= LOAD_CHECK_MICROS && load_checked_at_.compare_exchange_strong(checked, now)) {
+                double load[1] = {0};
+                load_high_ = getloadavg(load, 1) == 1 && load[0] > limits_.max_load;
+            }
+            // a long pause lets one chunk through, the index has to make progress at some point
+            if (!load_high_ || now - begin >= LOAD_PAUSE_MAX_MICROS) break;
+            paused = true;
+            sleep_micros(LOAD_CHECK_MICROS);
+        }
+        if (paused) {
+            load_pauses_++;
+            load_wait_us_ += static_cast<uint64_t>(util::get_micro_timestamp() - begin);
+        }
+    }
+
+    // every byte is paid for at the configured rate, up to RATE_BURST_MICROS of unused time is credited
+    void resource_governor::wait_for_rate(std::size_t bytes) {
+        if (limits_.max_read_mb_per_sec <= 0) return;
+        const double cost = bytes / (limits_.max_read_mb_per_sec * 1024 * 1024) * 1000000.0;
+        double now = util::get_micro_timestamp();
+        double start = 0;
+        {
+            std::lock_guard<std::mutex> lock(rate_mutex_);
+            rate_next_ = std::max(rate_next_, now - RATE_BURST_MICROS) + cost;
+            start = rate_next_;
+        }
+        if (start > now) {
+            sleep_micros(start - now);
+            rate_wait_us_ += static_cast<uint64_t>(start - now);
+        }
+    }
+
+    // over a window of CPU_WINDOW_MICROS of cpu time, sleep until it is max_cpu_share of the wall time
+    void resource_governor::wait_for_cpu() {
+        if (limits_.max_cpu_share <= 0 || limits_.max_cpu_share >= 1) return;
+        const double cpu = thread_cpu_micros() - this_thread.cpu_start;
+        if (cpu < CPU_WINDOW_MICROS) return;
+        const double wall = util::get_micro_timestamp() - this_thread.wall_start;
+        const double wait = cpu / limits_.max_cpu_share - wall;
+        if (wait > 0) {
+            sleep_micros(wait);
+            cpu_wait_us_ += static_cast<uint64_t>(wait);
+        }
+        this_thread.cpu_start = thread_cpu_micros();
+        this_thread.wall_start = util::get_micro_timestamp();
+    }
+
+    resource_governor::stats resource_governor::get_stats() const {
+        stats s;
+        s.read_bytes = read_bytes_.load();
+        s.rate_wait_ms = rate_wait_us_.load() / 1000.0;
+        s.cpu_wait_ms = cpu_wait_us_.load() / 1000.0;
+        s.load_wait_ms = load_wait_us_.load() / 1000.0;
+        s.load_pauses = load_pauses_.load();
+        return s;
+    }
+} // namespace drlog
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace drlog {
+    // keeps background work to a predictable share of the host: a read rate shared by all governed
+    // threads, a cpu share per thread, the nice and io priority of the threads and a pause while the
+    // host load is high. Only threads that called govern_this_thread() are throttled, so the same
+    // readers run at full speed on behalf of a search
+    class resource_governor {
+    public:
+        struct limits {
+            double max_read_mb_per_sec{0};  // shared by all governed threads, 0 = unlimited
+            double max_cpu_share{0};        // of one core per thread, 0 or 1 = unlimited
+            int nice{0};                    // added to the thread's nice value, 0 = unchanged
+            int io_class{0};                // 1 realtime, 2 best effort, 3 idle, 0 = unchanged
+            int io_level{4};                // 0 (highest) to 7 within class 1 and 2
+            double max_load{0};             // 1 minute load average to pause at, 0 = never
+        };
+        struct stats {
+            uint64_t read_bytes{0};
+            double rate_wait_ms{0};
+            double cpu_wait_ms{0};
+            double load_wait_ms{0};
+            uint64_t load_pauses{0};
+        };
+
+        void set_limits(const limits& l) { limits_ = l; }
+        const limits& get_limits() const { return limits_; }
+        // apply the priorities to the calling thread once and throttle it from now on
+        void govern_this_thread();
+        // bytes the calling thread read since its last call, sleeps while it is over a limit
+        void throttle(std::size_t bytes);
+        stats get_stats() const;
+
+    private:
+        void wait_for_load();
+        void wait_for_rate(std::size_t bytes);
+        void wait_for_cpu();
+
+        static constexpr double LOAD_CHECK_MICROS = 1000000.0;
+        static constexpr double LOAD_PAUSE_MAX_MICROS = 60 * 1000000.0;
+        static constexpr double RATE_BURST_MICROS = 1000000.0;
+        static constexpr double CPU_WINDOW_MICROS = 100000.0;
+
+        limits limits_;
+        std::mutex rate_mutex_;
+        double rate_next_{0};  // when the bytes granted so far are paid for
+        std::atomic<double> load_checked_at_{0};
+        std::atomic<bool> load_high_{false};
+        std::atomic<uint64_t> read_bytes_{0};
+        std::atomic<uint64_t> rate_wait_us_{0};
+        std::atomic<uint64_t> cpu_wait_us_{0};
+        std::atomic<uint64_t> load_wait_us_{0};
+        std::atomic<uint64_t> load_pauses_{0};
+    };
+} // namespace drlog
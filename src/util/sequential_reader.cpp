@@ -0,0 +1,122 @@
+#include "sequential_reader.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <spdlog/spdlog.h>
+
+namespace drlog {
+    bool parse_read_mode(const std::string& name, file_read_mode& mode) {
+        if (name == "mmap") mode = file_read_mode::mmap;
+        else if (name == "stream") mode = file_read_mode::stream;
+        else if (name == "direct") mode = file_read_mode::direct;
+        else return false;
+        return true;
+    }
+
+    const char* read_mode_name(file_read_mode mode) {
+        switch (mode) {
+            case file_read_mode::stream: return "stream";
+            case file_read_mode::direct: return "direct";
+            default: return "mmap";
+        }
+    }
+
+    sequential_reader::sequential_reader(std::size_t window)
+        : window_((window + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN) {
+        if (window_ == 0) window_ = DIRECT_ALIGN;
+    }
+
+    sequential_reader::~sequential_reader() {
+        close();
+        std::free(buffer_);
+    }
+
+    bool sequential_reader::open(const std::string& path, file_read_mode mode) {
+        close();
+        mode_ = mode;
+        int flags = O_RDONLY;
+        if (mode_ == file_read_mode::direct) flags |= O_DIRECT;
+        fd_ = ::open(path.c_str(), flags);
+        if (fd_ == -1 && mode_ == file_read_mode::direct && errno == EINVAL) {
+            spdlog::debug("No O_DIRECT for {}, streaming it", path);
+            mode_ = file_read_mode::stream;
+            fd_ = ::open(path.c_str(), O_RDONLY);
+        }
+        if (fd_ == -1) return false;
+        struct stat st {};
+        if (fstat(fd_, &st) != 0) {
+            close();
+            return false;
+        }
+        size_ = static_cast<uint64_t>(st.st_size);
+        if (!buffer_ && posix_memalign(reinterpret_cast<void**>(&buffer_), DIRECT_ALIGN, window_) != 0) {
+            buffer_ = nullptr;
+            close();
+            return false;
+        }
+        if (mode_ == file_read_mode::stream) advise_sequential(fd_);
+        seek(0);
+        return true;
+    }
+
+    void sequential_reader::close() {
+        if (fd_ != -1) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        data_ = nullptr;
+    }
+
+    void sequential_reader::seek(uint64_t offset) {
+        pos_ = offset;
+        dropped_ = offset;
+    }
+
+    ssize_t sequential_reader::read() {
+        if (fd_ == -1) return -1;
+        if (mode_ == file_read_mode::direct) {
+            // offset and length of an O_DIRECT read are block aligned, the bytes before pos_ are skipped
+            const uint64_t aligned = pos_ / DIRECT_ALIGN * DIRECT_ALIGN;
+            const std::size_t skip = static_cast<std::size_t>(pos_ - aligned);
+            ssize_t n = pread(fd_, buffer_, window_, static_cast<off_t>(aligned));
+            if (n < 0 && errno == EINVAL && fall_back_to_stream()) return read();
+            if (n < 0) return -1;
+            if (static_cast<std::size_t>(n) <= skip) return 0;
+            data_ = buffer_ + skip;
+            pos_ += static_cast<uint64_t>(n) - skip;
+            return n - static_cast<ssize_t>(skip);
+        }
+        ssize_t n = pread(fd_, buffer_, window_, static_cast<off_t>(pos_));
+        if (n <= 0) return n;
+        data_ = buffer_;
+        pos_ += static_cast<uint64_t>(n);
+        if (mode_ == file_read_mode::stream) drop_behind(fd_, dropped_, pos_);
+        return n;
+    }
+
+    // some filesystems accept O_DIRECT at open and reject the reads
+    bool sequential_reader::fall_back_to_stream() {
+        int flags = fcntl(fd_, F_GETFL);
+        if (flags == -1 || fcntl(fd_, F_SETFL, flags & ~O_DIRECT) != 0) return false;
+        mode_ = file_read_mode::stream;
+        advise_sequential(fd_);
+        return true;
+    }
+
+    void sequential_reader::advise_sequential(int fd) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    void sequential_reader::drop_behind(int fd, uint64_t& from, uint64_t to) {
+        // a partial last page is dropped once the next read completes it
+        static const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        const uint64_t begin = from / page * page;
+        const uint64_t end = to / page * page;
+        if (end <= begin) return;
+        posix_fadvise(fd, static_cast<off_t>(begin), static_cast<off_t>(end - begin), POSIX_FADV_DONTNEED);
+        from = end;
+    }
+} // namespace drlog
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace drlog {
+    // how a root's files are read by the indexer and by searches
+    enum class file_read_mode {
+        mmap,    // map the file, pages stay in the page cache
+        stream,  // sequential reads that drop the pages behind them from the page cache
+        direct,  // O_DIRECT into an aligned buffer, the page cache is bypassed
+    };
+    // "mmap", "stream" or "direct"
+    bool parse_read_mode(const std::string& name, file_read_mode& mode);
+    const char* read_mode_name(file_read_mode mode);
+
+    // reads a file front to back a window at a time. stream mode hints sequential access and drops
+    // what was read from the page cache, direct mode falls back to stream where the filesystem has
+    // no O_DIRECT; mmap mode reads through the page cache without hints
+    class sequential_reader {
+    public:
+        explicit sequential_reader(std::size_t window = 4 * 1024 * 1024);
+        ~sequential_reader();
+        sequential_reader(const sequential_reader&) = delete;
+        sequential_reader& operator=(const sequential_reader&) = delete;
+
+        bool open(const std::string& path, file_read_mode mode);
+        void close();
+        // the next read() returns the data from offset on
+        void seek(uint64_t offset);
+        // next window of the file into data(), 0 at the end, -1 on error
+        ssize_t read();
+        const char* data() const { return data_; }
+        // size at open
+        uint64_t size() const { return size_; }
+        file_read_mode mode() const { return mode_; }
+
+        // the same hints for a file read by other means, e.g. the stdio stream of a gzip file
+        static void advise_sequential(int fd);
+        // drop the whole pages of [from, to) from the page cache, from moves to the first one kept
+        static void drop_behind(int fd, uint64_t& from, uint64_t to);
+
+    private:
+        bool fall_back_to_stream();
+
+        static constexpr std::size_t DIRECT_ALIGN = 4096;
+
+        int fd_{-1};
+        file_read_mode mode_{file_read_mode::mmap};
+        uint64_t size_{0};
+        uint64_t pos_{0};
+        uint64_t dropped_{0};  // pages before it were dropped
+        std::size_t window_;
+        char* buffer_{nullptr};
+        const char* data_{nullptr};
+    };
+} // namespace drlog
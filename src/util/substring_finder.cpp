@@ -0,0 +1,105 @@
+#include "substring_finder.hpp"
+#include <cstring>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DRLOG_X86_KERNELS 1
+#endif
+
+namespace drlog {
+    namespace {
+        // needle_size >= 1 and <= size
+        using find_fn = std::size_t (*)(const char*, std::size_t, const char*, std::size_t);
+
+        // memchr for the first byte, then a compare; the fastest on a few dozen bytes
+        std::size_t find_scalar(const char* data, std::size_t size, const char* needle, std::size_t needle_size) {
+            return std::string_view(data, size).find(std::string_view(needle, needle_size));
+        }
+
+        // the candidates of one block, lowest position first
+        inline bool verify(uint32_t mask, const char* block, const char* needle, std::size_t needle_size, std::size_t& pos) {
+            while (mask) {
+                const unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+                if (needle_size <= 2 || std::memcmp(block + bit + 1, needle + 1, needle_size - 2) == 0) {
+                    pos = bit;
+                    return true;
+                }
+                mask &= mask - 1;
+            }
+            return false;
+        }
+
+#ifdef DRLOG_X86_KERNELS
+        // the block of 16 positions at data + i
+        inline uint32_t candidates_sse2(const char* data, std::size_t i, std::size_t needle_size, __m128i first, __m128i last) {
+            const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + needle_size - 1));
+            return static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last))));
+        }
+
+        std::size_t find_sse2(const char* data, std::size_t size, const char* needle, std::size_t needle_size) {
+            // a short line is not worth the setup
+            if (size < needle_size + 15) return find_scalar(data, size, needle, needle_size);
+            const __m128i first = _mm_set1_epi8(needle[0]);
+            const __m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+            const std::size_t positions = size - needle_size + 1;
+            std::size_t pos = 0;
+            for (std::size_t i = 0; i < positions; i += 16) {
+                // the last block overlaps the one before, its candidates there failed already
+                if (i + 16 > positions) i = positions - 16;
+                const uint32_t mask = candidates_sse2(data, i, needle_size, first, last);
+                if (mask && verify(mask, data + i, needle, needle_size, pos)) return i + pos;
+            }
+            return substring_finder::npos;
+        }
+
+        __attribute__((target("avx2")))
+        std::size_t find_avx2(const char* data, std::size_t size, const char* needle, std::size_t needle_size) {
+            if (size < needle_size + 31) return find_sse2(data, size, needle, needle_size);
+            const __m256i first = _mm256_set1_epi8(needle[0]);
+            const __m256i last = _mm256_set1_epi8(needle[needle_size - 1]);
+            const std::size_t positions = size - needle_size + 1;
+            std::size_t pos = 0;
+            for (std::size_t i = 0; i < positions; i += 32) {
+                if (i + 32 > positions) i = positions - 32;
+                const __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                const __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + needle_size - 1));
+                const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last))));
+                if (mask && verify(mask, data + i, needle, needle_size, pos)) return i + pos;
+            }
+            return substring_finder::npos;
+        }
+#endif
+
+        struct find_kernel {
+            find_fn fn;
+            const char* name;
+        };
+
+        find_kernel pick_kernel() {
+#ifdef DRLOG_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return {find_avx2, "avx2"};
+            if (__builtin_cpu_supports("sse2")) return {find_sse2, "sse2"};
+#endif
+            return {find_scalar, "scalar"};
+        }
+
+        const find_kernel& kernel() {
+            static const find_kernel k = pick_kernel();
+            return k;
+        }
+    }
+
+    std::size_t substring_finder::find(const char* data, std::size_t size) const {
+        if (needle_.empty()) return 0;
+        if (needle_.size() > size) return npos;
+        return kernel().fn(data, size, needle_.data(), needle_.size());
+    }
+
+    const char* substring_finder::kernel_name() {
+        return kernel().name;
+    }
+} // namespace drlog
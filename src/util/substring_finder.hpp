@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+namespace drlog {
+    // finds a fixed string in a buffer 32 (avx2) or 16 (sse2) positions at a time: the first and the
+    // last byte of the needle are compared at every position of a block, and only the positions where
+    // both agree are compared in full. The kernel is picked once from the running cpu, string_view::find elsewhere
+    class substring_finder {
+    public:
+        static constexpr std::size_t npos = std::string_view::npos;
+
+        substring_finder() = default;
+        explicit substring_finder(std::string needle) : needle_(std::move(needle)) {}
+        const std::string& needle() const { return needle_; }
+        // position of the first occurrence in data[0, size), npos without one; an empty needle is at 0
+        std::size_t find(const char* data, std::size_t size) const;
+        std::size_t find(std::string_view text) const { return find(text.data(), text.size()); }
+        static const char* kernel_name();
+
+    private:
+        std::string needle_;
+    };
+} // namespace drlog
@@ -0,0 +1,67 @@
+#include "thread_pool.hpp"
+#include <spdlog/spdlog.h>
+
+namespace drlog {
+    thread_pool::thread_pool(std::size_t threads) {
+        if (threads == 0) threads = 1;
+        workers_.reserve(threads);
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this]{ worker_loop(); });
+        }
+    }
+
+    thread_pool::~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        task_cv_.notify_all();
+        for (auto& t : workers_) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    void thread_pool::submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back(std::move(task));
+        }
+        task_cv_.notify_one();
+    }
+
+    void thread_pool::wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_cv_.wait(lock, [this]{ return tasks_.empty() && running_ == 0; });
+    }
+
+    std::size_t thread_pool::default_threads() {
+        std::size_t cores = std::thread::hardware_concurrency();
+        return cores > 2 ? cores / 2 : 1;
+    }
+
+    void thread_pool::worker_loop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                task_cv_.wait(lock, [this]{ return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) return; // stopping and drained
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+                ++running_;
+            }
+            try {
+                task();
+            } catch (const std::exception& e) {
+                spdlog::error("thread_pool task error: {}", e.what());
+            } catch (...) {
+                spdlog::error("thread_pool task unknown error");
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --running_;
+                if (tasks_.empty() && running_ == 0) idle_cv_.notify_all();
+            }
+        }
+    }
+} // namespace drlog
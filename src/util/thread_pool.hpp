@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+namespace drlog {
+    // fixed size pool of worker threads running queued tasks in fifo order
+    class thread_pool {
+    public:
+        explicit thread_pool(std::size_t threads);
+        ~thread_pool();
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        void submit(std::function<void()> task);
+        // block until every submitted task has finished
+        void wait();
+        std::size_t size() const { return workers_.size(); }
+        // default worker count: half the cores, at least one
+        static std::size_t default_threads();
+
+    private:
+        void worker_loop();
+
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void()>> tasks_;
+        std::mutex mutex_;
+        std::condition_variable task_cv_;
+        std::condition_variable idle_cv_;
+        std::size_t running_{0};
+        bool stopping_{false};
+    };
+} // namespace drlog
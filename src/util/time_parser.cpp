@@ -0,0 +1,412 @@
+#include "time_parser.hpp"
+#include <cstring>
+#include <ctime>
+
+namespace drlog {
+    namespace {
+        struct civil_fields {
+            int64_t year{0};
+            unsigned month{0};
+            unsigned day{0};
+            unsigned hour{0};
+            unsigned minute{0};
+            unsigned second{0};
+        };
+
+        inline bool is_digit(char c) {
+            return static_cast<unsigned char>(c - '0') < 10;
+        }
+
+        template <int... I>
+        inline bool digits_at(const char* p) {
+            return (is_digit(p[I]) && ...);
+        }
+
+        inline unsigned d2(const char* p) {
+            return static_cast<unsigned>(p[0] - '0') * 10 + static_cast<unsigned>(p[1] - '0');
+        }
+
+        inline unsigned d4(const char* p) {
+            return d2(p) * 100 + d2(p + 2);
+        }
+
+        constexpr uint32_t abbr_key(char a, char b, char c) {
+            return (static_cast<uint32_t>(static_cast<unsigned char>(a | 0x20)) << 16) |
+                   (static_cast<uint32_t>(static_cast<unsigned char>(b | 0x20)) << 8) |
+                    static_cast<uint32_t>(static_cast<unsigned char>(c | 0x20));
+        }
+
+        // case-insensitive english month abbreviation, returns 1..12 or 0
+        inline unsigned month_from_abbr(const char* p) {
+            static constexpr uint32_t months[12] = {
+                abbr_key('j','a','n'), abbr_key('f','e','b'), abbr_key('m','a','r'), abbr_key('a','p','r'),
+                abbr_key('m','a','y'), abbr_key('j','u','n'), abbr_key('j','u','l'), abbr_key('a','u','g'),
+                abbr_key('s','e','p'), abbr_key('o','c','t'), abbr_key('n','o','v'), abbr_key('d','e','c')
+            };
+            uint32_t key = abbr_key(p[0], p[1], p[2]);
+            for (unsigned i = 0; i < 12; ++i) {
+                if (months[i] == key) return i + 1;
+            }
+            return 0;
+        }
+
+        inline bool is_alpha(char c) {
+            return static_cast<unsigned char>((c | 0x20) - 'a') < 26;
+        }
+
+        inline unsigned days_in_month(int64_t y, unsigned m) {
+            static constexpr unsigned days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+            if (m == 2 && (y % 4 == 0) && (y % 100 != 0 || y % 400 == 0)) return 29;
+            return days[m - 1];
+        }
+
+        // same range checks date::parse applies to these fields
+        inline bool fields_valid(const civil_fields& f) {
+            if (f.month < 1 || f.month > 12 || f.day < 1) return false;
+            if (f.day > days_in_month(f.year, f.month)) return false;
+            return f.hour < 24 && f.minute < 60 && f.second < 60;
+        }
+
+        // YYYY?MM?DD?HH:MM:SS
+        template <char DATE_SEP, char TIME_SEP>
+        struct ymd_layout {
+            static constexpr std::size_t length = 19;
+            static constexpr bool has_year = true;
+            static bool shape(const char* p) {
+                return p[4] == DATE_SEP && p[7] == DATE_SEP && p[10] == TIME_SEP &&
+                       p[13] == ':' && p[16] == ':' &&
+                       digits_at<0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, 17, 18>(p);
+            }
+            static bool fields(const char* p, civil_fields& f) {
+                f.year = d4(p);
+                f.month = d2(p + 5);
+                f.day = d2(p + 8);
+                f.hour = d2(p + 11);
+                f.minute = d2(p + 14);
+                f.second = d2(p + 17);
+                return true;
+            }
+        };
+
+        // DD/Mon/YYYY:HH:MM:SS
+        struct clf_layout {
+            static constexpr std::size_t length = 20;
+            static constexpr bool has_year = true;
+            static bool shape(const char* p) {
+                return p[2] == '/' && p[6] == '/' && p[11] == ':' && p[14] == ':' && p[17] == ':' &&
+                       is_alpha(p[3]) && is_alpha(p[4]) && is_alpha(p[5]) &&
+                       digits_at<0, 1, 7, 8, 9, 10, 12, 13, 15, 16, 18, 19>(p);
+            }
+            static bool fields(const char* p, civil_fields& f) {
+                f.month = month_from_abbr(p + 3);
+                if (f.month == 0) return false;
+                f.day = d2(p);
+                f.year = d4(p + 7);
+                f.hour = d2(p + 12);
+                f.minute = d2(p + 15);
+                f.second = d2(p + 18);
+                return true;
+            }
+        };
+
+        // Mon DD HH:MM:SS
+        struct syslog_layout {
+            static constexpr std::size_t length = 15;
+            // no year in this layout, so the line cannot be placed on the timeline
+            static constexpr bool has_year = false;
+            static bool shape(const char* p) {
+                return p[3] == ' ' && p[6] == ' ' && p[9] == ':' && p[12] == ':' &&
+                       is_alpha(p[0]) && is_alpha(p[1]) && is_alpha(p[2]) &&
+                       digits_at<4, 5, 7, 8, 10, 11, 13, 14>(p);
+            }
+            static bool fields(const char* p, civil_fields& f) {
+                f.month = month_from_abbr(p);
+                if (f.month == 0) return false;
+                f.day = d2(p + 4);
+                f.hour = d2(p + 7);
+                f.minute = d2(p + 10);
+                f.second = d2(p + 13);
+                return true;
+            }
+        };
+
+        // last converted timestamp per thread; consecutive lines usually share the same second
+        struct convert_memo {
+            int format{TIME_FMT_NONE};
+            char bytes[24];
+            int64_t seconds{0};
+        };
+        thread_local convert_memo memo_;
+
+        template <class Layout>
+        bool convert(const char* p, int format, int64_t& seconds) {
+            if (!Layout::has_year) return false;
+            if (memo_.format == format && std::memcmp(memo_.bytes, p, Layout::length) == 0) {
+                seconds = memo_.seconds;
+                return true;
+            }
+            civil_fields f;
+            if (!Layout::fields(p, f) || !fields_valid(f)) return false;
+            seconds = time_parser::days_from_civil(f.year, f.month, f.day) * 86400 +
+                      static_cast<int64_t>(f.hour) * 3600 + f.minute * 60 + f.second;
+            memo_.format = format;
+            std::memcpy(memo_.bytes, p, Layout::length);
+            memo_.seconds = seconds;
+            return true;
+        }
+
+        // leftmost shape match, then convert; a bad value gives up on the layout like the regex path did
+        template <class Layout>
+        bool scan_layout(const char* data, std::size_t size, int format, time_match& out) {
+            if (size < Layout::length) return false;
+            const std::size_t last = size - Layout::length;
+            for (std::size_t pos = 0; pos <= last; ++pos) {
+                if (!Layout::shape(data + pos)) continue;
+                int64_t seconds = 0;
+                if (!convert<Layout>(data + pos, format, seconds)) return false;
+                out.format = format;
+                out.offset = static_cast<uint32_t>(pos);
+                out.local_seconds = seconds;
+                return true;
+            }
+            return false;
+        }
+
+        template <class Layout>
+        bool parse_layout_at(const char* data, std::size_t size, uint32_t offset, int format, int64_t& seconds) {
+            if (offset + Layout::length > size) return false;
+            if (!Layout::shape(data + offset)) return false;
+            return convert<Layout>(data + offset, format, seconds);
+        }
+
+        struct layout_entry {
+            const char* format;
+            bool (*scan)(const char*, std::size_t, int, time_match&);
+            bool (*at)(const char*, std::size_t, uint32_t, int, int64_t&);
+        };
+
+        template <class Layout>
+        constexpr layout_entry make_entry(const char* format) {
+            return layout_entry{format, &scan_layout<Layout>, &parse_layout_at<Layout>};
+        }
+
+        constexpr layout_entry layouts[TIME_FMT_BUILTIN_COUNT] = {
+            make_entry<ymd_layout<'-', ' '>>("%Y-%m-%d %H:%M:%S"),
+            make_entry<ymd_layout<'/', ' '>>("%Y/%m/%d %H:%M:%S"),
+            make_entry<ymd_layout<'-', 'T'>>("%Y-%m-%dT%H:%M:%S"),
+            make_entry<clf_layout>("%d/%b/%Y:%H:%M:%S"),
+            make_entry<syslog_layout>("%b %d %H:%M:%S")
+        };
+    } // namespace
+
+    bool time_parser::parse(std::string_view line, time_match& out) {
+        const std::size_t size = line.size() < SCAN_PREFIX ? line.size() : SCAN_PREFIX;
+        for (int f = 0; f < TIME_FMT_BUILTIN_COUNT; ++f) {
+            if (layouts[f].scan(line.data(), size, f, out)) return true;
+        }
+        return false;
+    }
+
+    bool time_parser::parse_at(std::string_view line, int format, uint32_t offset, int64_t& local_seconds) {
+        if (format < 0 || format >= TIME_FMT_BUILTIN_COUNT) return false;
+        const std::size_t size = line.size() < SCAN_PREFIX ? line.size() : SCAN_PREFIX;
+        return layouts[format].at(line.data(), size, offset, format, local_seconds);
+    }
+
+    int64_t time_parser::days_from_civil(int64_t y, unsigned m, unsigned d) {
+        // Howard Hinnant's days_from_civil
+        y -= m <= 2;
+        const int64_t era = (y >= 0 ? y : y - 399) / 400;
+        const unsigned yoe = static_cast<unsigned>(y - era * 400);
+        const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<int64_t>(doe) - 719468;
+    }
+
+    void time_parser::civil_from_days(int64_t days, int64_t& y, unsigned& m, unsigned& d) {
+        // Howard Hinnant's civil_from_days
+        days += 719468;
+        const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        const unsigned doe = static_cast<unsigned>(days - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        d = doy - (153 * mp + 2) / 5 + 1;
+        m = mp < 10 ? mp + 3 : mp - 9;
+        y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+    }
+
+    civil_date civil_date::today() {
+        civil_date today;
+        unsigned day = 0;
+        time_parser::civil_from_days(static_cast<int64_t>(std::time(nullptr)) / 86400, today.year, today.month, day);
+        return today;
+    }
+
+    const char* time_parser::format_string(int format) {
+        if (format == TIME_FMT_CUSTOM) return "custom";
+        if (format < 0 || format >= TIME_FMT_BUILTIN_COUNT) return "";
+        return layouts[format].format;
+    }
+
+    bool time_pattern::compile(const std::string& pattern) {
+        pattern_ = pattern;
+        ops_.clear();
+        has_year_ = false;
+        min_length_ = 0;
+        if (pattern == "epoch" || pattern == "epoch_ms") {
+            ops_.push_back(op{pattern == "epoch" ? OP_EPOCH : OP_EPOCH_MS, 0});
+            has_year_ = true;
+            min_length_ = pattern == "epoch" ? 10 : 13;
+            return true;
+        }
+        bool has_month = false, has_day = false;
+        for (std::size_t i = 0; i < pattern.size(); ++i) {
+            if (pattern[i] != '%') {
+                ops_.push_back(op{OP_LITERAL, pattern[i]});
+                min_length_ += 1;
+                continue;
+            }
+            if (++i >= pattern.size()) return false;
+            switch (pattern[i]) {
+                case 'Y': ops_.push_back(op{OP_YEAR, 0}); min_length_ += 4; has_year_ = true; break;
+                case 'm': ops_.push_back(op{OP_MONTH, 0}); min_length_ += 2; has_month = true; break;
+                case 'b': ops_.push_back(op{OP_MONTH_ABBR, 0}); min_length_ += 3; has_month = true; break;
+                case 'd': ops_.push_back(op{OP_DAY, 0}); min_length_ += 2; has_day = true; break;
+                case 'e': ops_.push_back(op{OP_DAY_SPACE, 0}); min_length_ += 2; has_day = true; break;
+                case 'H': ops_.push_back(op{OP_HOUR, 0}); min_length_ += 2; break;
+                case 'M': ops_.push_back(op{OP_MINUTE, 0}); min_length_ += 2; break;
+                case 'S': ops_.push_back(op{OP_SECOND, 0}); min_length_ += 2; break;
+                case 'f': ops_.push_back(op{OP_FRACTION, 0}); min_length_ += 1; break;
+                case 'z': ops_.push_back(op{OP_ZONE, 0}); min_length_ += 1; break;
+                case '%': ops_.push_back(op{OP_LITERAL, '%'}); min_length_ += 1; break;
+                default: return false;
+            }
+        }
+        // a layout without a date can not be placed on the timeline
+        return has_month && has_day && min_length_ <= time_parser::SCAN_PREFIX;
+    }
+
+    bool time_pattern::match(const char* p, const char* end, const civil_date& today, int64_t& seconds, bool& is_utc) const {
+        civil_fields f;
+        f.month = 1;
+        f.day = 1;
+        int64_t zone_offset = 0;
+        is_utc = false;
+        for (const op& o : ops_) {
+            const std::size_t left = static_cast<std::size_t>(end - p);
+            switch (o.kind) {
+                case OP_LITERAL:
+                    if (left < 1 || *p != o.literal) return false;
+                    p += 1;
+                    break;
+                case OP_YEAR:
+                    if (left < 4 || !digits_at<0, 1, 2, 3>(p)) return false;
+                    f.year = d4(p);
+                    p += 4;
+                    break;
+                case OP_MONTH_ABBR:
+                    if (left < 3 || (f.month = month_from_abbr(p)) == 0) return false;
+                    p += 3;
+                    break;
+                case OP_DAY_SPACE:
+                    if (left < 2 || !is_digit(p[1]) || (p[0] != ' ' && !is_digit(p[0]))) return false;
+                    f.day = (p[0] == ' ' ? 0 : static_cast<unsigned>(p[0] - '0') * 10) + static_cast<unsigned>(p[1] - '0');
+                    p += 2;
+                    break;
+                case OP_MONTH:
+                case OP_DAY:
+                case OP_HOUR:
+                case OP_MINUTE:
+                case OP_SECOND: {
+                    if (left < 2 || !digits_at<0, 1>(p)) return false;
+                    unsigned v = d2(p);
+                    if (o.kind == OP_MONTH) f.month = v;
+                    else if (o.kind == OP_DAY) f.day = v;
+                    else if (o.kind == OP_HOUR) f.hour = v;
+                    else if (o.kind == OP_MINUTE) f.minute = v;
+                    else f.second = v;
+                    p += 2;
+                    break;
+                }
+                case OP_FRACTION:
+                    if (left < 1 || !is_digit(*p)) return false;
+                    while (p < end && is_digit(*p)) ++p;
+                    break;
+                case OP_ZONE:
+                    if (left >= 1 && (*p == 'Z' || *p == 'z')) {
+                        p += 1;
+                    } else {
+                        if (left < 5 || (*p != '+' && *p != '-')) return false;
+                        const int sign = *p == '-' ? -1 : 1;
+                        const char* q = p + 1;
+                        if (!digits_at<0, 1>(q)) return false;
+                        unsigned hh = d2(q);
+                        q += 2;
+                        if (q < end && *q == ':') ++q;
+                        if (end - q < 2 || !digits_at<0, 1>(q)) return false;
+                        zone_offset = sign * static_cast<int64_t>(hh * 3600 + d2(q) * 60);
+                        p = q + 2;
+                    }
+                    is_utc = true;
+                    break;
+                case OP_EPOCH:
+                case OP_EPOCH_MS: {
+                    const std::size_t width = o.kind == OP_EPOCH ? 10 : 13;
+                    if (left < width) return false;
+                    int64_t v = 0;
+                    for (std::size_t i = 0; i < width; ++i) {
+                        if (!is_digit(p[i])) return false;
+                        v = v * 10 + (p[i] - '0');
+                    }
+                    // part of a longer number
+                    if (left > width && is_digit(p[width])) return false;
+                    seconds = o.kind == OP_EPOCH ? v : v / 1000;
+                    is_utc = true;
+                    return true;
+                }
+            }
+        }
+        if (!has_year_) {
+            // syslog style: take the current year, or the previous one for a month still ahead of us
+            f.year = f.month > today.month + 1 ? today.year - 1 : today.year;
+        }
+        if (!fields_valid(f)) return false;
+        seconds = time_parser::days_from_civil(f.year, f.month, f.day) * 86400 +
+                  static_cast<int64_t>(f.hour) * 3600 + f.minute * 60 + f.second - zone_offset;
+        return true;
+    }
+
+    bool time_pattern::parse(std::string_view line, const civil_date& today, time_match& out, bool& is_utc) const {
+        if (ops_.empty()) return false;
+        const std::size_t size = line.size() < time_parser::SCAN_PREFIX ? line.size() : time_parser::SCAN_PREFIX;
+        if (size < min_length_) return false;
+        const char* data = line.data();
+        const std::size_t last = size - min_length_;
+        for (std::size_t pos = 0; pos <= last; ++pos) {
+            // cheap reject on the first field before running the whole program
+            const op& first = ops_.front();
+            if (first.kind == OP_LITERAL) {
+                if (data[pos] != first.literal) continue;
+            } else if (first.kind != OP_MONTH_ABBR && first.kind != OP_DAY_SPACE) {
+                // a numeric field never starts in the middle of a number
+                if (!is_digit(data[pos]) || (pos > 0 && is_digit(data[pos - 1]))) continue;
+            }
+            int64_t seconds = 0;
+            if (match(data + pos, data + size, today, seconds, is_utc)) {
+                out.format = TIME_FMT_CUSTOM;
+                out.offset = static_cast<uint32_t>(pos);
+                out.local_seconds = seconds;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool time_pattern::parse_at(std::string_view line, uint32_t offset, const civil_date& today, int64_t& seconds, bool& is_utc) const {
+        if (ops_.empty()) return false;
+        const std::size_t size = line.size() < time_parser::SCAN_PREFIX ? line.size() : time_parser::SCAN_PREFIX;
+        if (offset + min_length_ > size) return false;
+        return match(line.data() + offset, line.data() + size, today, seconds, is_utc);
+    }
+} // namespace drlog
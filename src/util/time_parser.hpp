@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace drlog {
+    // built-in timestamp layouts, listed in detection priority order
+    enum time_format_id : int {
+        TIME_FMT_NONE = -1,
+        TIME_FMT_YMD_DASH = 0,      // %Y-%m-%d %H:%M:%S
+        TIME_FMT_YMD_SLASH,         // %Y/%m/%d %H:%M:%S
+        TIME_FMT_ISO8601,           // %Y-%m-%dT%H:%M:%S
+        TIME_FMT_CLF,               // %d/%b/%Y:%H:%M:%S
+        TIME_FMT_SYSLOG,            // %b %d %H:%M:%S
+        TIME_FMT_BUILTIN_COUNT,
+        TIME_FMT_CUSTOM = 100       // RootPath::time_format_pattern
+    };
+
+    struct time_match {
+        int format{TIME_FMT_NONE};
+        uint32_t offset{0};         // column of the timestamp inside the line
+        int64_t local_seconds{0};   // civil time as seconds since 1970-01-01, no zone applied
+    };
+
+    // the date lines of a layout without a year are placed against, taken once per file pass
+    struct civil_date {
+        int64_t year{1970};
+        unsigned month{1};
+        static civil_date today();
+    };
+
+    // hand-written parser for the built-in layouts, works on the line bytes in place
+    class time_parser {
+    public:
+        // only the first SCAN_PREFIX bytes of a line are searched for a timestamp
+        static constexpr std::size_t SCAN_PREFIX = 50;
+
+        // find the first layout (in priority order) inside the line prefix
+        static bool parse(std::string_view line, time_match& out);
+        // parse one layout at a fixed column
+        static bool parse_at(std::string_view line, int format, uint32_t offset, int64_t& local_seconds);
+        // days since 1970-01-01 for a proleptic gregorian date
+        static int64_t days_from_civil(int64_t y, unsigned m, unsigned d);
+        static void civil_from_days(int64_t days, int64_t& y, unsigned& m, unsigned& d);
+        static const char* format_string(int format);
+    };
+
+    // user supplied layout, compiled once into a field program instead of a regex.
+    // strftime-like fields: %Y %m %d %e %H %M %S %b, %f (fraction digits, dropped), %z (+hh[:]mm or Z), %%;
+    // any other byte is a literal. The whole pattern "epoch" or "epoch_ms" matches unix seconds / milliseconds.
+    // Without %Y the year is inferred from the date passed in (syslog style).
+    class time_pattern {
+    public:
+        bool compile(const std::string& pattern);
+        // search the line prefix for the layout; is_utc is set when the value carried its own zone
+        bool parse(std::string_view line, const civil_date& today, time_match& out, bool& is_utc) const;
+        bool parse_at(std::string_view line, uint32_t offset, const civil_date& today, int64_t& seconds, bool& is_utc) const;
+        const std::string& pattern() const { return pattern_; }
+
+    private:
+        enum op_kind : uint8_t {
+            OP_LITERAL, OP_YEAR, OP_MONTH, OP_DAY, OP_DAY_SPACE, OP_HOUR, OP_MINUTE, OP_SECOND,
+            OP_MONTH_ABBR, OP_FRACTION, OP_ZONE, OP_EPOCH, OP_EPOCH_MS
+        };
+        struct op {
+            op_kind kind;
+            char literal;
+        };
+        bool match(const char* p, const char* end, const civil_date& today, int64_t& seconds, bool& is_utc) const;
+
+        std::string pattern_;
+        std::vector<op> ops_;
+        bool has_year_{false};
+        std::size_t min_length_{0};
+    };
+} // namespace drlog
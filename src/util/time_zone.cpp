@@ -0,0 +1,297 @@
+#include "time_zone.hpp"
+#include "time_parser.hpp"
+#include "util.hpp"
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <ctime>
+
+namespace drlog {
+    namespace {
+        // transitions from a POSIX rule are generated up to this year
+        constexpr int64_t RULE_LAST_YEAR = 2100;
+
+        int64_t be_int(const unsigned char* p, int size) {
+            uint64_t v = 0;
+            for (int i = 0; i < size; ++i) v = (v << 8) | p[i];
+            if (size == 4) return static_cast<int32_t>(static_cast<uint32_t>(v));
+            return static_cast<int64_t>(v);
+        }
+
+        // [+-]hh[[:]mm[[:]ss]], returns seconds with the written sign
+        bool parse_hms(const std::string& s, size_t& pos, int64_t& seconds) {
+            int sign = 1;
+            if (pos < s.size() && (s[pos] == '+' || s[pos] == '-')) {
+                if (s[pos] == '-') sign = -1;
+                ++pos;
+            }
+            int64_t parts[3] = {0, 0, 0};
+            for (int i = 0; i < 3; ++i) {
+                if (i > 0 && pos < s.size() && s[pos] == ':') ++pos;
+                size_t start = pos;
+                while (pos < s.size() && pos - start < (i == 0 ? 3u : 2u) && s[pos] >= '0' && s[pos] <= '9') {
+                    parts[i] = parts[i] * 10 + (s[pos] - '0');
+                    ++pos;
+                }
+                if (pos == start) {
+                    if (i == 0) return false;
+                    break;
+                }
+            }
+            seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+            return true;
+        }
+
+        bool parse_fixed_offset(const std::string& s, int32_t& offset) {
+            size_t pos = 0;
+            int64_t seconds = 0;
+            if (!parse_hms(s, pos, seconds) || pos != s.size()) return false;
+            offset = static_cast<int32_t>(seconds);
+            return true;
+        }
+
+        // zone name in a POSIX TZ string, either alphabetic or quoted in <>
+        bool skip_zone_name(const std::string& s, size_t& pos) {
+            size_t start = pos;
+            if (pos < s.size() && s[pos] == '<') {
+                pos = s.find('>', pos);
+                if (pos == std::string::npos) return false;
+                ++pos;
+                return true;
+            }
+            while (pos < s.size() && std::isalpha(static_cast<unsigned char>(s[pos]))) ++pos;
+            return pos - start >= 3;
+        }
+
+        struct posix_date {
+            char kind{'M'};     // 'M' month.week.day, 'J' julian 1..365 without leap day, 'N' zero based day of year
+            int month{0};
+            int week{0};
+            int weekday{0};
+            int day{0};
+            int64_t time{7200};
+        };
+
+        bool parse_posix_date(const std::string& s, size_t& pos, posix_date& d) {
+            auto number = [&](int& out) {
+                size_t start = pos;
+                out = 0;
+                while (pos < s.size() && s[pos] >= '0' && s[pos] <= '9') out = out * 10 + (s[pos++] - '0');
+                return pos > start;
+            };
+            if (pos < s.size() && s[pos] == 'M') {
+                ++pos;
+                d.kind = 'M';
+                if (!number(d.month) || pos >= s.size() || s[pos++] != '.') return false;
+                if (!number(d.week) || pos >= s.size() || s[pos++] != '.') return false;
+                if (!number(d.weekday)) return false;
+                if (d.month < 1 || d.month > 12 || d.week < 1 || d.week > 5 || d.weekday > 6) return false;
+            } else if (pos < s.size() && s[pos] == 'J') {
+                ++pos;
+                d.kind = 'J';
+                if (!number(d.day) || d.day < 1 || d.day > 365) return false;
+            } else {
+                d.kind = 'N';
+                if (!number(d.day) || d.day > 365) return false;
+            }
+            if (pos < s.size() && s[pos] == '/') {
+                ++pos;
+                if (!parse_hms(s, pos, d.time)) return false;
+            }
+            return true;
+        }
+
+        bool is_leap(int64_t y) {
+            return (y % 4 == 0) && (y % 100 != 0 || y % 400 == 0);
+        }
+
+        // days since epoch of the rule's date in year y
+        int64_t posix_date_days(int64_t y, const posix_date& d) {
+            int64_t jan1 = time_parser::days_from_civil(y, 1, 1);
+            if (d.kind == 'J') return jan1 + d.day - 1 + ((is_leap(y) && d.day >= 60) ? 1 : 0);
+            if (d.kind == 'N') return jan1 + d.day;
+            static constexpr int dim[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+            int64_t first = time_parser::days_from_civil(y, static_cast<unsigned>(d.month), 1);
+            int first_wd = static_cast<int>(((first + 4) % 7 + 7) % 7);   // 1970-01-01 was a thursday
+            int day = 1 + (d.weekday - first_wd + 7) % 7 + (d.week - 1) * 7;
+            int last = dim[d.month - 1] + ((d.month == 2 && is_leap(y)) ? 1 : 0);
+            while (day > last) day -= 7;
+            return first + day - 1;
+        }
+    } // namespace
+
+    std::shared_ptr<const time_zone> time_zone::load(const std::string& name) {
+        if (name.empty() || name == "local") return local();
+        auto tz = std::make_shared<time_zone>();
+        tz->name_ = name;
+        if (name == "UTC" || name == "GMT" || name == "Z") return tz;
+        if (name[0] == '+' || name[0] == '-') {
+            if (!parse_fixed_offset(name, tz->initial_offset_)) return nullptr;
+            return tz;
+        }
+        if (name.find("..") != std::string::npos) return nullptr;
+        std::string path = name;
+        if (name[0] != '/') {
+            const char* dir = std::getenv("TZDIR");
+            path = std::string(dir && *dir ? dir : "/usr/share/zoneinfo") + "/" + name;
+        }
+        if (tz->load_tzfile(path)) return tz;
+        // TZ may also carry a bare POSIX rule such as "CST-8"
+        if (tz->load_posix_rule(name, INT64_MIN)) return tz;
+        return nullptr;
+    }
+
+    std::shared_ptr<const time_zone> time_zone::local() {
+        static const std::shared_ptr<const time_zone> zone = [] {
+            std::shared_ptr<const time_zone> tz;
+            const char* env = std::getenv("TZ");
+            if (env && *env && std::strcmp(env, "local") != 0) {
+                tz = load(env[0] == ':' ? env + 1 : env);
+            } else {
+                auto file_tz = std::make_shared<time_zone>();
+                file_tz->name_ = "local";
+                if (file_tz->load_tzfile("/etc/localtime")) tz = file_tz;
+            }
+            if (!tz) {
+                // no zone data on this host, fall back to the offset in effect right now
+                auto fixed = std::make_shared<time_zone>();
+                fixed->name_ = "local";
+                fixed->initial_offset_ = util::get_local_utc_offset_seconds();
+                tz = fixed;
+            }
+            return tz;
+        }();
+        return zone;
+    }
+
+    int64_t time_zone::to_utc(int64_t local_seconds) const {
+        auto it = std::upper_bound(transitions_.begin(), transitions_.end(), local_seconds,
+            [](int64_t v, const transition& t) { return v < t.local; });
+        int32_t offset = (it == transitions_.begin()) ? initial_offset_ : std::prev(it)->offset;
+        return local_seconds - offset;
+    }
+
+    int32_t time_zone::utc_offset(int64_t utc_seconds) const {
+        auto it = std::upper_bound(transitions_.begin(), transitions_.end(), utc_seconds,
+            [](int64_t v, const transition& t) { return v < t.utc; });
+        return (it == transitions_.begin()) ? initial_offset_ : std::prev(it)->offset;
+    }
+
+    void time_zone::add_transition(int64_t utc, int32_t offset) {
+        int32_t current = transitions_.empty() ? initial_offset_ : transitions_.back().offset;
+        if (offset == current) return;
+        transitions_.push_back(transition{utc, utc + offset, offset});
+    }
+
+    bool time_zone::load_tzfile(const std::string& path) {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open()) return false;
+        std::vector<unsigned char> buf((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        if (buf.size() < 44 || std::memcmp(buf.data(), "TZif", 4) != 0) return false;
+
+        // header counts: isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt
+        auto counts_at = [&](size_t at, int64_t c[6]) {
+            for (int i = 0; i < 6; ++i) c[i] = be_int(buf.data() + at + 20 + i * 4, 4);
+        };
+        auto data_size = [](const int64_t c[6], int time_size) {
+            return static_cast<size_t>(c[3] * time_size + c[3] + c[4] * 6 + c[5] + c[2] * (time_size + 4) + c[1] + c[0]);
+        };
+        int64_t c[6];
+        counts_at(0, c);
+        size_t data = 44;
+        int time_size = 4;
+        const char version = static_cast<char>(buf[4]);
+        if (version >= '2') {
+            // skip the 32-bit block, the 64-bit one follows with its own header
+            size_t header2 = 44 + data_size(c, 4);
+            if (header2 + 44 > buf.size() || std::memcmp(buf.data() + header2, "TZif", 4) != 0) return false;
+            counts_at(header2, c);
+            data = header2 + 44;
+            time_size = 8;
+        }
+        const int64_t timecnt = c[3], typecnt = c[4];
+        if (typecnt < 1 || data + data_size(c, time_size) > buf.size()) return false;
+
+        const unsigned char* times = buf.data() + data;
+        const unsigned char* indexes = times + timecnt * time_size;
+        const unsigned char* types = indexes + timecnt;
+        auto type_offset = [&](int64_t i) { return static_cast<int32_t>(be_int(types + i * 6, 4)); };
+
+        transitions_.clear();
+        initial_offset_ = type_offset(0);
+        int64_t last_utc = INT64_MIN;
+        for (int64_t i = 0; i < timecnt; ++i) {
+            int64_t utc = be_int(times + i * time_size, time_size);
+            int64_t type = indexes[i];
+            if (type >= typecnt) return false;
+            add_transition(utc, type_offset(type));
+            last_utc = utc;
+        }
+
+        // the footer rule covers everything after the last stored transition
+        size_t footer = data + data_size(c, time_size);
+        if (version >= '2' && footer < buf.size() && buf[footer] == '\n') {
+            size_t end = footer + 1;
+            while (end < buf.size() && buf[end] != '\n') ++end;
+            std::string rule(reinterpret_cast<const char*>(buf.data()) + footer + 1, end - footer - 1);
+            if (!rule.empty()) load_posix_rule(rule, last_utc);
+        }
+        return true;
+    }
+
+    bool time_zone::load_posix_rule(const std::string& rule, int64_t from_utc) {
+        size_t pos = 0;
+        int64_t std_seconds = 0;
+        if (!skip_zone_name(rule, pos) || !parse_hms(rule, pos, std_seconds)) return false;
+        // POSIX offsets count west of utc
+        const int32_t std_offset = static_cast<int32_t>(-std_seconds);
+        if (pos == rule.size()) {
+            if (transitions_.empty() && from_utc == INT64_MIN) initial_offset_ = std_offset;
+            else add_transition(from_utc, std_offset);
+            return true;
+        }
+        if (!skip_zone_name(rule, pos)) return false;
+        int32_t dst_offset = std_offset + 3600;
+        if (pos < rule.size() && rule[pos] != ',') {
+            int64_t dst_seconds = 0;
+            if (!parse_hms(rule, pos, dst_seconds)) return false;
+            dst_offset = static_cast<int32_t>(-dst_seconds);
+        }
+        posix_date start, end;
+        if (pos == rule.size()) {
+            // no dates given, use the US rules like glibc does
+            start.month = 3; start.week = 2;
+            end.month = 11; end.week = 1;
+        } else {
+            if (rule[pos++] != ',' || !parse_posix_date(rule, pos, start)) return false;
+            if (pos >= rule.size() || rule[pos++] != ',' || !parse_posix_date(rule, pos, end)) return false;
+        }
+
+        int64_t first_year = 1970;
+        if (from_utc != INT64_MIN) {
+            int64_t y = 0;
+            unsigned m = 0, d = 0;
+            time_parser::civil_from_days(from_utc / 86400, y, m, d);
+            first_year = y;
+        } else {
+            initial_offset_ = std_offset;
+        }
+        for (int64_t y = first_year; y <= RULE_LAST_YEAR; ++y) {
+            // dst starts in standard time and ends in daylight time
+            int64_t dst_begin = posix_date_days(y, start) * 86400 + start.time - std_offset;
+            int64_t dst_end = posix_date_days(y, end) * 86400 + end.time - dst_offset;
+            if (dst_begin < dst_end) {
+                if (dst_begin > from_utc) add_transition(dst_begin, dst_offset);
+                if (dst_end > from_utc) add_transition(dst_end, std_offset);
+            } else {
+                // southern hemisphere, the year starts in dst
+                if (dst_end > from_utc) add_transition(dst_end, std_offset);
+                if (dst_begin > from_utc) add_transition(dst_begin, dst_offset);
+            }
+        }
+        return true;
+    }
+} // namespace drlog
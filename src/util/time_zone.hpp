@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace drlog {
+    // utc offsets of one zone, expanded from its tzfile into a sorted transition table
+    class time_zone {
+    public:
+        // "local", "UTC", a fixed offset such as "+08:00" / "-0500", or an IANA name such as "Asia/Shanghai".
+        // returns nullptr if the zone can not be loaded
+        static std::shared_ptr<const time_zone> load(const std::string& name);
+        // zone of the host (TZ or /etc/localtime), loaded once
+        static std::shared_ptr<const time_zone> local();
+
+        // convert civil seconds in this zone to utc seconds; in a DST gap the earlier offset
+        // is used, in a fold the later one
+        int64_t to_utc(int64_t local_seconds) const;
+        // offset east of utc in effect at the given utc instant
+        int32_t utc_offset(int64_t utc_seconds) const;
+        const std::string& name() const { return name_; }
+
+    private:
+        struct transition {
+            int64_t utc;        // instant the offset starts
+            int64_t local;      // same instant in the new local time
+            int32_t offset;     // seconds east of utc
+        };
+        bool load_tzfile(const std::string& path);
+        bool load_posix_rule(const std::string& rule, int64_t from_utc);
+        void add_transition(int64_t utc, int32_t offset);
+
+        std::string name_;
+        int32_t initial_offset_{0};
+        std::vector<transition> transitions_;
+    };
+} // namespace drlog
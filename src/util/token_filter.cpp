@@ -0,0 +1,151 @@
+#include "token_filter.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace drlog {
+    static constexpr std::array<bool, 256> TOKEN_CHARS = [] {
+        std::array<bool, 256> t {};
+        for (int c = '0'; c <= '9'; ++c) t[c] = true;
+        for (int c = 'A'; c <= 'Z'; ++c) t[c] = true;
+        for (int c = 'a'; c <= 'z'; ++c) t[c] = true;
+        return t;
+    }();
+    static constexpr uint64_t HASH_SEED = 0x746f6b656e666c74ULL;
+    static constexpr uint64_t HASH_PRIME = 0x9e3779b97f4a7c15ULL;
+
+    // murmur3 finalizer
+    static inline uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // the probes of a token all hit one 64 byte block, a single cache line per token. The block comes
+    // from the low bits and does not depend on the size of the filter, which makes folding work
+    static constexpr std::size_t BLOCK_WORDS = 8;
+    static inline std::size_t block_of(uint64_t hash, std::size_t count) {
+        return (static_cast<std::size_t>(hash) & (count / BLOCK_WORDS - 1)) * BLOCK_WORDS;
+    }
+    static inline uint32_t probe(uint64_t hash, uint32_t i) {
+        return static_cast<uint32_t>(hash >> (28 + 9 * i)) & 511;
+    }
+
+    // eight bytes per multiply, the finalizer spreads the result over all bits
+    static inline uint64_t hash_bytes(const unsigned char* p, std::size_t size) {
+        uint64_t h = HASH_SEED ^ (size * HASH_PRIME);
+        while (size >= 8) {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            h = (h ^ w) * HASH_PRIME;
+            h ^= h >> 31;
+            p += 8;
+            size -= 8;
+        }
+        if (size > 0) {
+            uint64_t w = 0;
+            for (std::size_t i = 0; i < size; ++i) w |= static_cast<uint64_t>(p[i]) << (8 * i);
+            h = (h ^ w) * HASH_PRIME;
+        }
+        return mix(h);
+    }
+
+    token_filter::token_filter() : words_(MAX_WORDS, 0) {
+    }
+
+    void token_filter::reset() {
+        std::fill(words_.begin(), words_.end(), 0);
+        unknown_ = false;
+    }
+
+    void token_filter::resume(const uint64_t* words, std::size_t count) {
+        if (count < BLOCK_WORDS || MAX_WORDS % count != 0) {
+            unknown_ = true;
+            return;
+        }
+        unknown_ = false;
+        for (std::size_t i = 0; i < MAX_WORDS; i += count) std::copy(words, words + count, words_.begin() + i);
+    }
+
+    void token_filter::merge(const uint64_t* words, std::size_t count) {
+        if (count < BLOCK_WORDS || MAX_WORDS % count != 0) {
+            unknown_ = true;
+            return;
+        }
+        for (std::size_t i = 0; i < MAX_WORDS; ++i) words_[i] |= words[i % count];
+    }
+
+    void token_filter::add_line(std::string_view line) {
+        if (unknown_) return;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(line.data());
+        const unsigned char* end = p + line.size();
+        while (p < end) {
+            while (p < end && !TOKEN_CHARS[*p]) ++p;
+            if (p == end) break;
+            const unsigned char* token = p;
+            while (p < end && TOKEN_CHARS[*p]) ++p;
+            if (static_cast<std::size_t>(p - token) < MIN_TOKEN_SIZE) continue;
+            const uint64_t h = hash_bytes(token, static_cast<std::size_t>(p - token));
+            uint64_t* block = words_.data() + block_of(h, MAX_WORDS);
+            for (uint32_t i = 0; i < PROBES; ++i) {
+                uint32_t bit = probe(h, i);
+                block[bit >> 6] |= uint64_t(1) << (bit & 63);
+            }
+        }
+    }
+
+    void token_filter::finish(std::vector<uint64_t>& out) {
+        if (unknown_) return;
+        uint64_t* w = words_.data();
+        std::size_t size = words_.size();
+        // fold the upper half onto the lower one while that stays at most half full
+        while (size > BLOCK_WORDS) {
+            const std::size_t half = size / 2;
+            std::size_t set = 0;
+            for (std::size_t i = 0; i < half; ++i) set += static_cast<std::size_t>(__builtin_popcountll(w[i] | w[i + half]));
+            if (set * 2 > half * 64) break;
+            for (std::size_t i = 0; i < half; ++i) w[i] |= w[i + half];
+            size = half;
+        }
+        std::size_t set = 0;
+        for (std::size_t i = 0; i < size; ++i) set += static_cast<std::size_t>(__builtin_popcountll(w[i]));
+        // past 5/8 full four probes let more than 15% of absent tokens through, not worth the space
+        if (set * 8 > size * 64 * 5) return;
+        out.insert(out.end(), w, w + size);
+    }
+
+    uint64_t token_filter::token_hash(const char* data, std::size_t size) {
+        return hash_bytes(reinterpret_cast<const unsigned char*>(data), size);
+    }
+
+    bool token_filter::may_contain(const uint64_t* words, std::size_t count, uint64_t hash) {
+        if (count < BLOCK_WORDS || (count & (count - 1)) != 0) return true;
+        const uint64_t* block = words + block_of(hash, count);
+        for (uint32_t i = 0; i < PROBES; ++i) {
+            uint32_t bit = probe(hash, i);
+            if (!(block[bit >> 6] & (uint64_t(1) << (bit & 63)))) return false;
+        }
+        return true;
+    }
+
+    void token_filter::required_tokens(std::string_view query, std::vector<uint64_t>& out) {
+        out.clear();
+        const std::size_t n = query.size();
+        std::size_t i = 0;
+        while (i < n) {
+            if (!TOKEN_CHARS[static_cast<unsigned char>(query[i])]) {
+                ++i;
+                continue;
+            }
+            std::size_t start = i;
+            while (i < n && TOKEN_CHARS[static_cast<unsigned char>(query[i])]) ++i;
+            if (start > 0 && i < n && i - start >= MIN_TOKEN_SIZE) {
+                uint64_t h = token_hash(query.data() + start, i - start);
+                if (std::find(out.begin(), out.end(), h) == out.end()) out.push_back(h);
+            }
+        }
+    }
+} // namespace drlog
@@ -0,0 +1,42 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace drlog {
+    // Bloom filter of the tokens of a block of log lines; a token is a run of [A-Za-z0-9], case kept.
+    // The probes of a token all fall in one cache line. Lines are added to a filter of MAX_WORDS words
+    // that finish() folds in halves, down to one cache line, while it stays at most half full. Every
+    // size is probed with the same hash bits, so a finished filter tiled back to MAX_WORDS takes more
+    // lines of the same block.
+    class token_filter {
+    public:
+        static constexpr std::size_t MAX_WORDS = 16 * 1024;  // 1 Mbit
+        static constexpr uint32_t PROBES = 4;
+        // shorter tokens (timestamp fields, small numbers) are in nearly every block and are left out
+        static constexpr std::size_t MIN_TOKEN_SIZE = 3;
+
+        token_filter();
+        // start an empty block
+        void reset();
+        // continue a block from its finished words, no words continues a block that rules nothing out
+        void resume(const uint64_t* words, std::size_t count);
+        // add the tokens of another finished filter
+        void merge(const uint64_t* words, std::size_t count);
+        void add_line(std::string_view line);
+        // append the folded words to out; nothing when the filter is too full to rule a token out
+        void finish(std::vector<uint64_t>& out);
+
+        static uint64_t token_hash(const char* data, std::size_t size);
+        // false if the token of hash was never added; a filter without words may contain anything
+        static bool may_contain(const uint64_t* words, std::size_t count, uint64_t hash);
+        // tokens every line containing query as a substring has: those with a non-token character
+        // on both sides inside the query, the ones at its ends may be part of a longer token
+        static void required_tokens(std::string_view query, std::vector<uint64_t>& out);
+
+    private:
+        std::vector<uint64_t> words_;
+        bool unknown_{false};
+    };
+} // namespace drlog
@@ -0,0 +1,148 @@
+#include "work_stealing_pool.hpp"
+#include <chrono>
+#include <spdlog/spdlog.h>
+
+namespace drlog {
+    namespace {
+        // the pool and index of a worker thread
+        thread_local const void* current_pool = nullptr;
+        thread_local std::size_t current_index = 0;
+    }
+
+    work_stealing_pool::work_stealing_pool(std::size_t threads) {
+        if (threads == 0) threads = 1;
+        for (std::size_t i = 0; i < threads; ++i) queues_.push_back(std::make_unique<worker_queue>());
+        workers_.reserve(threads);
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this, i]{ worker_loop(i); });
+        }
+    }
+
+    work_stealing_pool::~work_stealing_pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        sleep_cv_.notify_all();
+        for (auto& t : workers_) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    void work_stealing_pool::submit(std::function<void()> task) {
+        std::size_t index = 0;
+        worker_queue& queue = worker_index(index) ? *queues_[index] : shared_;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.emplace_back(std::move(task));
+        }
+        {
+            // a worker about to sleep checks queued_ under this lock
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            ++queued_;
+        }
+        sleep_cv_.notify_one();
+    }
+
+    void work_stealing_pool::wait_until(const std::function<bool()>& done, std::mutex& mutex, std::condition_variable& cv) {
+        std::size_t index = 0;
+        if (!worker_index(index)) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, done);
+            return;
+        }
+        // a worker waiting for its own tasks runs them, or any other, instead of blocking the pool
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (done()) return;
+            }
+            std::function<void()> task;
+            if (take(index, task)) {
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(1), done);
+        }
+    }
+
+    bool work_stealing_pool::worker_index(std::size_t& index) const {
+        if (current_pool != this) return false;
+        index = current_index;
+        return true;
+    }
+
+    bool work_stealing_pool::take(std::size_t index, std::function<void()>& task) {
+        if (queued_.load() == 0) return false;
+        auto pop = [&](worker_queue& queue, bool back) {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) return false;
+            if (back) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            --queued_;
+            return true;
+        };
+        if (pop(*queues_[index], true) || pop(shared_, false)) return true;
+        for (std::size_t i = 1; i < queues_.size(); ++i) {
+            if (pop(*queues_[(index + i) % queues_.size()], false)) return true;
+        }
+        return false;
+    }
+
+    void work_stealing_pool::run(std::function<void()>& task) {
+        try {
+            task();
+        } catch (const std::exception& e) {
+            spdlog::error("work_stealing_pool task error: {}", e.what());
+        } catch (...) {
+            spdlog::error("work_stealing_pool task unknown error");
+        }
+    }
+
+    void work_stealing_pool::worker_loop(std::size_t index) {
+        current_pool = this;
+        current_index = index;
+        while (true) {
+            std::function<void()> task;
+            if (take(index, task)) {
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            if (stopping_ && queued_.load() == 0) return;
+            sleep_cv_.wait(lock, [this]{ return stopping_ || queued_.load() > 0; });
+        }
+    }
+
+    task_group::~task_group() {
+        wait();
+    }
+
+    void task_group::run(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++pending_;
+        }
+        pool_.submit([this, task = std::move(task)] {
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--pending_ == 0) cv_.notify_all();
+                throw;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) cv_.notify_all();
+        });
+    }
+
+    void task_group::wait() {
+        pool_.wait_until([this]{ return pending_ == 0; }, mutex_, cv_);
+    }
+} // namespace drlog
@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+namespace drlog {
+    // fixed workers with a deque each. A worker pushes and pops its own tasks at the back and steals
+    // from the front of the others' once it runs dry; tasks from other threads go to a shared queue
+    // taken in fifo order. Only the workers run tasks, so the pool size bounds the concurrency
+    class work_stealing_pool {
+    public:
+        explicit work_stealing_pool(std::size_t threads);
+        ~work_stealing_pool();
+        work_stealing_pool(const work_stealing_pool&) = delete;
+        work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+        void submit(std::function<void()> task);
+        // until done() is true: a worker of this pool runs queued tasks meanwhile, another thread sleeps
+        void wait_until(const std::function<bool()>& done, std::mutex& mutex, std::condition_variable& cv);
+        std::size_t size() const { return workers_.size(); }
+
+    private:
+        struct worker_queue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+        void worker_loop(std::size_t index);
+        // own back, the shared queue, then the front of the others
+        bool take(std::size_t index, std::function<void()>& task);
+        void run(std::function<void()>& task);
+        // index of the calling thread when it is a worker of this pool
+        bool worker_index(std::size_t& index) const;
+
+        std::vector<std::unique_ptr<worker_queue>> queues_;
+        worker_queue shared_;
+        std::vector<std::thread> workers_;
+        std::atomic<std::size_t> queued_{0};
+        std::mutex sleep_mutex_;
+        std::condition_variable sleep_cv_;
+        bool stopping_{false};
+    };
+
+    // tasks submitted together and waited for together, e.g. the files of one search
+    class task_group {
+    public:
+        explicit task_group(work_stealing_pool& pool) : pool_(pool) {}
+        // waits for the tasks still running
+        ~task_group();
+        task_group(const task_group&) = delete;
+        task_group& operator=(const task_group&) = delete;
+
+        void run(std::function<void()> task);
+        void wait();
+
+    private:
+        work_stealing_pool& pool_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::size_t pending_{0};
+    };
+} // namespace drlog